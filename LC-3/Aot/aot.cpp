@@ -0,0 +1,99 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <string>
+#include <filesystem>
+#include <memory>
+#include <cstdlib>
+
+#include "memory.h"
+#include "aot.h"
+
+namespace fs = std::filesystem;
+
+#ifndef LC3_AOT_INCLUDE_DIR
+#define LC3_AOT_INCLUDE_DIR "."
+#endif
+
+/// <summary>
+/// Build the shared library with the host compiler, $CXX when set
+/// </summary>
+bool Compile(const fs::path& source, const fs::path& library, const fs::path& includeDir)
+{
+	auto cxx = std::getenv("CXX");
+	std::ostringstream command;
+#ifdef WIN32
+	command << (cxx ? cxx : "cl") << " /nologo /std:c++17 /O2 /LD /I\"" << includeDir.string() << "\" \""
+		<< source.string() << "\" /Fe\"" << library.string() << '"';
+#else
+	command << (cxx ? cxx : "c++") << " -std=c++17 -O2 -shared -fPIC -I\"" << includeDir.string() << "\" \""
+		<< source.string() << "\" -o \"" << library.string() << '"';
+#endif // WIN32
+
+	if (std::system(command.str().c_str()) != 0)
+	{
+		std::cerr << "Compilation failed: " << command.str() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	argc--;
+	argv++;
+
+	fs::path source;
+	fs::path library;
+	fs::path includeDir = LC3_AOT_INCLUDE_DIR;
+	fs::path obj;
+
+	for (; argc > 0; argc--, argv++)
+	{
+		auto arg = std::string_view(argv[0]);
+		if ((arg == "-o" || arg == "--so" || arg == "-I") && argc > 1)
+		{
+			(arg == "-o" ? source : arg == "--so" ? library : includeDir) = argv[1];
+			argc--;
+			argv++;
+		}
+		else {
+			obj = arg;
+		}
+	}
+
+	if (obj.empty())
+	{
+		std::cout << "Usage: lc3-aot [-o out.cpp] [--so out.so] [-I aotabi_dir] program.obj" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto mem = std::make_unique<Memory>();
+	std::ifstream is(obj, std::ios::in | std::ios::binary);
+	if (!is || !mem->ReadObj(is))
+	{
+		std::cerr << "Can't read " << obj << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (source.empty()) {
+		source = fs::path(obj).replace_extension(".cpp");
+	}
+
+	AotTranslator translator;
+	std::ofstream os(source, std::ios::out | std::ios::binary);
+	translator.Translate(*mem, os);
+	os.close();
+	if (!os)
+	{
+		std::cerr << "Can't write " << source << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << translator.BlockCount() << " blocks translated to " << source.string() << std::endl;
+
+	if (!library.empty() && !Compile(source, library, includeDir)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
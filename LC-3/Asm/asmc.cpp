@@ -4,156 +4,687 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <set>
+#include <utility>
 #include <cstdlib>
-#include <climits>
-#include <iomanip>
-#include <type_traits>
+#include <cctype>
 #include <bit>
-#include <cassert>
+#include <filesystem>
 
 #include "identifiers.h"
+#include "debuginfo.h"
+#include "peephole.h"
+#include "statement.h"
 
-int64_t ReverseBits(const char* p1, const char* p2)
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Two pass LC-3 assembler: statements are parsed and laid out first, then
+/// encoded once every label is known
+/// </summary>
+class Assembler
+{
+public:
+	Assembler(std::string_view file) : m_file(file) {};
+
+	bool Parse(std::istream& is);
+	/// <summary>
+	/// Peephole pass, between parsing and layout
+	/// </summary>
+	/// <returns>number of words saved</returns>
+	size_t Optimize() { return ::Optimize(m_statements, m_file); };
+	bool Layout();
+	bool Encode();
+
+	const std::vector<uint16_t>& Image() const { return m_image; };
+	const std::vector<Statement>& Statements() const { return m_statements; };
+	const std::map<std::string, uint16_t>& Labels() const { return m_labels; };
+
+private:
+	bool ParseLine(std::string_view text, uint32_t line, std::vector<std::string>& labels);
+	bool ParseOperand(std::string_view token, Operand& operand);
+	bool IsMnemonic(const std::string& upper) const;
+	/// <summary>
+	/// Mnemonics added to the LC-3 ISA, which older sources use as labels.
+	/// They are labels at the start of a line followed by an instruction,
+	/// and alone on a line when some operand names them.
+	/// </summary>
+	bool IsExtension(const std::string& upper) const;
+	void ResolveExtensions(std::vector<std::string>& labels);
+
+	uint16_t EncodeStatement(const Statement& st);
+	uint16_t FillValue(const Statement& st);
+	int32_t Register(const Statement& st, size_t i);
+	int32_t Offset(const Statement& st, size_t i, int bits);
+	int32_t Immediate(const Statement& st, size_t i, int bits);
+	bool Expect(const Statement& st, size_t count);
+	void Error(uint32_t line, std::string_view message);
+
+	std::string m_file;
+	std::vector<Statement> m_statements;
+	/// <summary>
+	/// Statements made of an extension mnemonic alone, with its spelling
+	/// </summary>
+	std::vector<std::pair<size_t, std::string>> m_bareExtensions;
+	std::map<std::string, uint16_t> m_labels;
+	std::vector<uint16_t> m_image;
+	bool m_failed{ false };
+};
+
+namespace
 {
-	assert(CHAR_BIT == 8);
-	constexpr int n = 64 / 8;
+	std::string Upper(std::string_view str)
+	{
+		std::string upper(str);
+		std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char ch) { return static_cast<char>(std::toupper(ch)); });
+		return upper;
+	}
+
+	/// <summary>
+	/// Split a line into tokens: words, string literals and commas are
+	/// separators, a semicolon outside strings starts a comment
+	/// </summary>
+	bool Split(std::string_view text, std::vector<std::string_view>& tokens)
+	{
+		size_t i = 0;
+		while (i < text.size())
+		{
+			auto ch = text[i];
+			if (ch == ';') {
+				break;
+			}
+			if (std::isspace(static_cast<unsigned char>(ch)) || ch == ',')
+			{
+				++i;
+				continue;
+			}
+
+			auto begin = i;
+			if (ch == '"')
+			{
+				for (++i; i < text.size() && text[i] != '"'; ++i)
+				{
+					if (text[i] == '\\') {
+						++i;
+					}
+				}
+				if (i >= text.size()) {
+					return false;
+				}
+				++i;
+			}
+			else
+			{
+				while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i])) && text[i] != ',' && text[i] != ';') {
+					++i;
+				}
+			}
+			tokens.push_back(text.substr(begin, i - begin));
+		}
+		return true;
+	}
 
-	int64_t result{ 0 };
-	int cnt{ 1 };
-	for (char* p = const_cast<char*>(p1); p < p2; ++p)
+	bool ParseNumber(std::string_view token, int32_t& value)
 	{
-		char raw = *p;
-		char rev = 0;
+		int base = 10;
+		if (!token.empty() && token[0] == '#') {
+			token.remove_prefix(1);
+		}
+		bool negative = !token.empty() && token[0] == '-';
+		if (negative) {
+			token.remove_prefix(1);
+		}
+		if (!token.empty() && (token[0] == 'x' || token[0] == 'X'))
+		{
+			base = 16;
+			token.remove_prefix(1);
+		}
+		else if (!token.empty() && (token[0] == 'b' || token[0] == 'B'))
+		{
+			base = 2;
+			token.remove_prefix(1);
+		}
+		if (token.empty() || token.size() > 16) {
+			return false;
+		}
 
-		for (auto i = 0; i < 8; ++i)
+		int64_t result = 0;
+		for (auto ch : token)
 		{
-			rev = rev << 1 | (raw & 1);
-			raw >>= 1;
+			int digit = std::isdigit(static_cast<unsigned char>(ch)) ? ch - '0' :
+				std::isxdigit(static_cast<unsigned char>(ch)) ? std::toupper(static_cast<unsigned char>(ch)) - 'A' + 10 : base;
+			if (digit >= base) {
+				return false;
+			}
+			result = result * base + digit;
 		}
+		value = static_cast<int32_t>(negative ? -result : result);
+		return true;
+	}
 
-		if (cnt <= 8)
+	bool Unescape(std::string_view literal, std::string& text)
+	{
+		literal = literal.substr(1, literal.size() - 2);
+		for (size_t i = 0; i < literal.size(); ++i)
 		{
-			int64_t mask = rev;
-			mask <<= (8 * (8 - (int64_t)cnt));
-			result += mask;
-			cnt++;
+			if (literal[i] != '\\')
+			{
+				text += literal[i];
+				continue;
+			}
+			if (++i == literal.size()) {
+				return false;
+			}
+			switch (literal[i])
+			{
+			case 'n': text += '\n'; break;
+			case 't': text += '\t'; break;
+			case 'r': text += '\r'; break;
+			case 'e': text += '\x1b'; break;
+			case '0': text += '\0'; break;
+			case '"': text += '"'; break;
+			case '\\': text += '\\'; break;
+			case 'x':
+			{
+				int32_t value;
+				if (i + 2 >= literal.size() || !ParseNumber(literal.substr(i, 3), value)) {
+					return false;
+				}
+				text += static_cast<char>(value);
+				i += 2;
+				break;
+			}
+			default: return false;
+			}
 		}
+		return true;
+	}
 
+	uint16_t Swap(uint16_t word)
+	{
+		if constexpr (std::endian::native != std::endian::big) {
+			return static_cast<uint16_t>(word << 8 | word >> 8);
+		}
+		return word;
 	}
-	return result;
 }
 
+void Assembler::Error(uint32_t line, std::string_view message)
+{
+	std::cerr << m_file << ':' << line << ": error: " << message << '\n';
+	m_failed = true;
+}
 
-enum class TokenType { Keyword, Number, Register, Pass};
+bool Assembler::IsMnemonic(const std::string& upper) const
+{
+	uint16_t nzp;
+	return upper[0] == '.' || FindInstruction(upper) != kNotIndex || FindTrap(upper) != kNotIndex ||
+		IsBranch(upper, nzp) || upper == "RET" || upper == "JSRR" || IsExtension(upper);
+}
 
-using Token = std::pair<TokenType, int16_t>;
+bool Assembler::IsExtension(const std::string& upper) const
+{
+	// NOTE: the host helper traps come after the LC-3 OS routines
+	auto trap = FindTrap(upper);
+	return upper == "XCHG" || upper == "CAS" ||
+		(trap != kNotIndex && trap >= static_cast<int64_t>(TR::FIRST_HOST) - static_cast<int64_t>(TR::FIRST));
+}
 
-void Tokenize(const std::string_view& str, std::vector<Token>& tokens)
+void Assembler::ResolveExtensions(std::vector<std::string>& labels)
 {
-	for (int i = 0; i < str.size(); ++i)
+	std::set<std::string> operands;
+	for (auto& st : m_statements)
 	{
-		auto ch = str[i];
+		for (auto& operand : st.operands)
+		{
+			if (operand.kind == Operand::Kind::Label) {
+				operands.insert(operand.text);
+			}
+		}
+	}
 
-		if (std::isspace(ch)) {
+	// NOTE: from the end, so that the indices ahead stay valid
+	for (auto it = m_bareExtensions.rbegin(); it != m_bareExtensions.rend(); ++it)
+	{
+		auto& [index, name] = *it;
+		if (!operands.count(name)) {
 			continue;
 		}
+		auto moved = std::move(m_statements[index].labels);
+		moved.push_back(name);
+		auto& next = index + 1 < m_statements.size() ? m_statements[index + 1].labels : labels;
+		next.insert(next.begin(), moved.begin(), moved.end());
+		m_statements.erase(m_statements.begin() + index);
+	}
+	m_bareExtensions.clear();
+}
+
+bool Assembler::Parse(std::istream& is)
+{
+	std::string text;
+	std::vector<std::string> labels;
+	for (uint32_t line = 1; std::getline(is, text); ++line)
+	{
+		if (!ParseLine(text, line, labels)) {
+			break;
+		}
+	}
+	ResolveExtensions(labels);
+	if (!labels.empty()) {
+		Error(static_cast<uint32_t>(m_statements.empty() ? 1 : m_statements.back().line), "label after the last statement");
+	}
+	return !m_failed;
+}
+
+/// <returns>false after .END</returns>
+bool Assembler::ParseLine(std::string_view text, uint32_t line, std::vector<std::string>& labels)
+{
+	std::vector<std::string_view> tokens;
+	if (!Split(text, tokens))
+	{
+		Error(line, "unterminated string");
+		return true;
+	}
+
+	size_t i = 0;
+	if (i < tokens.size() && (!IsMnemonic(Upper(tokens[i])) ||
+		(IsExtension(Upper(tokens[i])) && i + 1 < tokens.size() && IsMnemonic(Upper(tokens[i + 1])))))
+	{
+		auto label = std::string(tokens[i]);
+		if (label.back() == ':') {
+			label.pop_back();
+		}
+		if (label.empty() || !(std::isalpha(static_cast<unsigned char>(label[0])) || label[0] == '_')) {
+			Error(line, "bad label " + label);
+		}
+		labels.push_back(label);
+		++i;
+	}
+	if (i == tokens.size()) {
+		return true;
+	}
+
+	Statement st;
+	st.line = line;
+	st.op = Upper(tokens[i]);
+	if (!IsMnemonic(st.op))
+	{
+		Error(line, "unknown instruction " + std::string(tokens[i]));
+		return true;
+	}
+	if (st.op == ".END") {
+		return false;
+	}
+	for (++i; i < tokens.size(); ++i)
+	{
+		if (!ParseOperand(tokens[i], st.operands.emplace_back())) {
+			Error(line, "bad operand " + std::string(tokens[i]));
+		}
+	}
+	if (IsExtension(st.op) && st.operands.empty()) {
+		m_bareExtensions.emplace_back(m_statements.size(), std::string(tokens[i - 1]));
+	}
+	st.labels = std::move(labels);
+	labels.clear();
+	m_statements.push_back(std::move(st));
+	return true;
+}
 
-		int begin = i;
+bool Assembler::ParseOperand(std::string_view token, Operand& operand)
+{
+	if (token[0] == '"')
+	{
+		operand.kind = Operand::Kind::String;
+		return Unescape(token, operand.text);
+	}
 
-		if ((ch >= 'A' && ch <= 'Z')) 
+	auto upper = Upper(token);
+	auto reg = FindRegister(upper);
+	if (reg != kNotIndex && reg <= static_cast<int64_t>(R::R7))
+	{
+		operand.kind = Operand::Kind::Register;
+		operand.value = static_cast<int32_t>(reg);
+		return true;
+	}
+
+	// NOTE: as in the reference assembler x followed by hex digits is a
+	// number, never a label
+	if (ParseNumber(token, operand.value))
+	{
+		operand.kind = Operand::Kind::Number;
+		return true;
+	}
+	if (token[0] == '#') {
+		return false;
+	}
+	operand.kind = Operand::Kind::Label;
+	operand.text = token;
+	return std::isalpha(static_cast<unsigned char>(token[0])) || token[0] == '_';
+}
+
+bool Assembler::Layout()
+{
+	if (m_statements.empty() || m_statements.front().op != ".ORIG")
+	{
+		Error(m_statements.empty() ? 1 : m_statements.front().line, "the program must start with .ORIG");
+		return false;
+	}
+
+	uint32_t address = 0;
+	for (auto& st : m_statements)
+	{
+		if (st.op == ".ORIG")
 		{
-			while ((str[i] >= 'A' && str[i] <= 'Z')) {
-				++i;
+			if (&st != &m_statements.front() || st.operands.size() != 1 || st.operands[0].kind != Operand::Kind::Number) {
+				Error(st.line, ".ORIG takes one address and only starts the program");
 			}
+			address = static_cast<uint16_t>(st.operands.empty() ? 0 : st.operands[0].value);
+			st.address = static_cast<uint16_t>(address);
+			continue;
+		}
 
-			auto token = std::string_view(str.substr(begin, (size_t)i - (size_t)begin));
-			auto index = FindInstruction(token);
-			if (index != kNotIndex)
-			{
-				tokens.emplace_back(TokenType::Keyword, index);
+		st.size = 1;
+		if (st.op == ".BLKW")
+		{
+			if (st.operands.size() != 1 || st.operands[0].kind != Operand::Kind::Number || st.operands[0].value < 0) {
+				Error(st.line, ".BLKW takes a word count");
 			}
-			else {
-				index = FindRegister(token);
-				if (index != kNotIndex)
-				{
-					tokens.emplace_back(TokenType::Register, index);
-				}
+			st.size = static_cast<uint16_t>(st.operands.empty() ? 0 : st.operands[0].value);
+		}
+		else if (st.op == ".STRINGZ")
+		{
+			if (st.operands.size() != 1 || st.operands[0].kind != Operand::Kind::String) {
+				Error(st.line, ".STRINGZ takes a string");
 			}
+			st.size = static_cast<uint16_t>(st.operands.empty() ? 1 : st.operands[0].text.size() + 1);
+		}
+		else if (st.op[0] == '.' && st.op != ".FILL") {
+			Error(st.line, "unknown directive " + st.op);
 		}
-		else
-			if ((ch >= '0' && ch <= '9') || ch == '-')
-			{
-				char sign = 1;
-				if (ch == '-')
-				{
-					begin = ++i;
-					ch = str[i];
-					sign = -1;
-				}
-
-				auto nToken = (int16_t)ch - (int16_t)'0';
-				if (nToken > 0)
-				{
-					// NOTE: decimal
-					while (str[i] >= '0' && str[i] <= '9') {
-						++i;
-					} 
-					auto token = std::string_view(str.substr(begin, (size_t)i - (size_t)begin));
-					nToken = std::atoll(token.data());
-				}
-				else
-				{
-					if (str[i + (size_t)1] == 'x' || str[i + (size_t)1] == 'X')
-					{
-						// NOTE: hex
-						i += 2;
-						begin = i;
-						while ((str[i] >= '0' && str[i] <= '9') || (str[i] >= 'a' && str[i] <= 'f') || (str[i] >= 'A' && str[i] <= 'F')) {
-							++i;
-						}
-						auto token = std::string_view(str.substr(begin, (size_t)i - (size_t)begin));
-						auto ul = std::strtoul(token.data(), nullptr, 16);
-						nToken = static_cast<int16_t>(ul);
-					}
-					else
-					{
-						// NOTE: oct
-						++i;
-						begin = i;
-						while ((str[i] >= '0' && str[i] <= '7')) {
-							++i;
-						}
-						auto token = std::string_view(str.substr(begin, (size_t)i - (size_t)begin));
-						auto ul = std::strtoul(token.data(), nullptr, 8);
-						nToken = static_cast<int16_t>(ul);
-					}
-				}
 
-				tokens.emplace_back(TokenType::Number, static_cast<int16_t>(nToken * sign));
-			}
-			else if (ch == ';')
-			{
-				tokens.emplace_back(TokenType::Pass, 0);
-				return;
+		st.address = static_cast<uint16_t>(address);
+		for (auto& label : st.labels)
+		{
+			if (!m_labels.emplace(label, st.address).second) {
+				Error(st.line, "label " + label + " defined twice");
 			}
+		}
+		address += st.size;
+		if (address > Memory::kMemorySize) {
+			Error(st.line, "program doesn't fit in memory");
+		}
+	}
+	return !m_failed;
+}
+
+bool Assembler::Expect(const Statement& st, size_t count)
+{
+	if (st.operands.size() == count) {
+		return true;
+	}
+	Error(st.line, st.op + " takes " + std::to_string(count) + " operands");
+	return false;
+}
+
+int32_t Assembler::Register(const Statement& st, size_t i)
+{
+	if (i >= st.operands.size() || st.operands[i].kind != Operand::Kind::Register)
+	{
+		Error(st.line, st.op + " expects a register");
+		return 0;
+	}
+	return st.operands[i].value;
+}
+
+int32_t Assembler::Immediate(const Statement& st, size_t i, int bits)
+{
+	auto& operand = st.operands[i];
+	if (operand.kind != Operand::Kind::Number)
+	{
+		Error(st.line, st.op + " expects a number");
+		return 0;
+	}
+	if (operand.value < -(1 << (bits - 1)) || operand.value >= (1 << (bits - 1)))
+	{
+		Error(st.line, std::to_string(operand.value) + " doesn't fit in " + std::to_string(bits) + " bits");
+		return 0;
+	}
+	return operand.value & ((1 << bits) - 1);
+}
+
+int32_t Assembler::Offset(const Statement& st, size_t i, int bits)
+{
+	if (i >= st.operands.size())
+	{
+		Error(st.line, st.op + " expects a label or an offset");
+		return 0;
+	}
+	auto& operand = st.operands[i];
+	if (operand.kind != Operand::Kind::Label) {
+		return Immediate(st, i, bits);
+	}
 
+	auto it = m_labels.find(operand.text);
+	if (it == m_labels.end())
+	{
+		Error(st.line, "undefined label " + operand.text);
+		return 0;
+	}
+	int32_t offset = it->second - (st.address + 1);
+	if (offset < -(1 << (bits - 1)) || offset >= (1 << (bits - 1)))
+	{
+		Error(st.line, "label " + operand.text + " is too far for " + st.op);
+		return 0;
 	}
+	return offset & ((1 << bits) - 1);
 }
 
+uint16_t Assembler::EncodeStatement(const Statement& st)
+{
+	auto opcode = [](OP op) { return static_cast<uint16_t>(static_cast<uint16_t>(op) << 12); };
+	auto& op = st.op;
+
+	uint16_t nzp;
+	if (IsBranch(op, nzp))
+	{
+		if (!Expect(st, 1)) {
+			return 0;
+		}
+		return opcode(OP::BR) | nzp << 9 | Offset(st, 0, 9);
+	}
+	auto trap = FindTrap(op);
+	if (trap != kNotIndex)
+	{
+		Expect(st, 0);
+		return opcode(OP::TRAP) | static_cast<uint16_t>(static_cast<int64_t>(TR::FIRST) + trap);
+	}
+
+	if (op == "ADD" || op == "AND")
+	{
+		if (!Expect(st, 3)) {
+			return 0;
+		}
+		uint16_t word = opcode(op == "ADD" ? OP::ADD : OP::AND) | Register(st, 0) << 9 | Register(st, 1) << 6;
+		if (st.operands[2].kind == Operand::Kind::Register) {
+			return word | Register(st, 2);
+		}
+		return word | 1 << 5 | Immediate(st, 2, 5);
+	}
+	if (op == "NOT")
+	{
+		if (!Expect(st, 2)) {
+			return 0;
+		}
+		return opcode(OP::NOT) | Register(st, 0) << 9 | Register(st, 1) << 6 | 0x3F;
+	}
+	if (op == "LD" || op == "LDI" || op == "LEA" || op == "ST" || op == "STI")
+	{
+		if (!Expect(st, 2)) {
+			return 0;
+		}
+		auto code = op == "LD" ? OP::LD : op == "LDI" ? OP::LDI : op == "LEA" ? OP::LEA : op == "ST" ? OP::ST : OP::STI;
+		return opcode(code) | Register(st, 0) << 9 | Offset(st, 1, 9);
+	}
+	if (op == "LDR" || op == "STR")
+	{
+		if (!Expect(st, 3)) {
+			return 0;
+		}
+		return opcode(op == "LDR" ? OP::LDR : OP::STR) | Register(st, 0) << 9 | Register(st, 1) << 6 | Immediate(st, 2, 6);
+	}
+	if (op == "JMP" || op == "JSRR")
+	{
+		if (!Expect(st, 1)) {
+			return 0;
+		}
+		return opcode(op == "JMP" ? OP::JMP : OP::JSR) | Register(st, 0) << 6;
+	}
+	if (op == "RET")
+	{
+		Expect(st, 0);
+		return opcode(OP::JMP) | 7 << 6;
+	}
+	if (op == "JSR")
+	{
+		if (!Expect(st, 1)) {
+			return 0;
+		}
+		return opcode(OP::JSR) | 1 << 11 | Offset(st, 0, 11);
+	}
+	if (op == "TRAP")
+	{
+		if (!Expect(st, 1)) {
+			return 0;
+		}
+		auto& vector = st.operands[0];
+		if (vector.kind != Operand::Kind::Number || vector.value < 0 || vector.value > 0xFF)
+		{
+			Error(st.line, "TRAP expects an 8-bit vector");
+			return 0;
+		}
+		return opcode(OP::TRAP) | static_cast<uint16_t>(vector.value);
+	}
+	if (op == "XCHG" || op == "CAS")
+	{
+		// NOTE: atomics take the RES opcode, only SmpMachine executes them
+		if (!Expect(st, 3)) {
+			return 0;
+		}
+		return opcode(OP::RES) | Register(st, 0) << 9 | Register(st, 1) << 6 | (op == "CAS") << 5 | Register(st, 2);
+	}
+	if (op == "RTI")
+	{
+		Expect(st, 0);
+		return opcode(OP::RTI);
+	}
+
+	Error(st.line, op + " is not an instruction");
+	return 0;
+}
+
+uint16_t Assembler::FillValue(const Statement& st)
+{
+	if (!Expect(st, 1)) {
+		return 0;
+	}
+	auto& operand = st.operands[0];
+	if (operand.kind == Operand::Kind::Label)
+	{
+		auto it = m_labels.find(operand.text);
+		if (it == m_labels.end())
+		{
+			Error(st.line, "undefined label " + operand.text);
+			return 0;
+		}
+		return it->second;
+	}
+	if (operand.kind != Operand::Kind::Number || operand.value < -0x8000 || operand.value > 0xFFFF)
+	{
+		Error(st.line, ".FILL expects a 16-bit value or a label");
+		return 0;
+	}
+	return static_cast<uint16_t>(operand.value);
+}
+
+bool Assembler::Encode()
+{
+	m_image.assign(1, m_statements.front().address);
+	for (auto& st : m_statements)
+	{
+		if (st.op == ".ORIG") {
+			continue;
+		}
+		if (st.op == ".BLKW") {
+			m_image.insert(m_image.end(), st.size, 0);
+		}
+		else if (st.op == ".STRINGZ")
+		{
+			for (auto ch : st.operands[0].text) {
+				m_image.push_back(static_cast<unsigned char>(ch));
+			}
+			m_image.push_back(0);
+		}
+		else if (st.op == ".FILL") {
+			m_image.push_back(FillValue(st));
+		}
+		else {
+			m_image.push_back(EncodeStatement(st));
+		}
+	}
+	return !m_failed;
+}
+
+/// <summary>
+/// Sidecar for the profiler, the tracer and the debugger: the source line
+/// of every statement and every label
+/// </summary>
+bool WriteDebugInfo(const Assembler& assembler, std::string_view source, const fs::path& path)
+{
+	DebugInfo::Builder builder;
+	auto file = builder.AddFile(source);
+	uint32_t end = 0;
+	for (auto& st : assembler.Statements())
+	{
+		if (!st.size) {
+			continue;
+		}
+		builder.AddLine(st.address, file, st.line);
+		end = st.address + st.size;
+	}
+	if (end && end < Memory::kMemorySize) {
+		builder.AddGap(static_cast<uint16_t>(end));
+	}
+	for (auto& [label, address] : assembler.Labels())
+	{
+		builder.AddSymbol(label, address);
+	}
+
+	auto& image = assembler.Image();
+	return builder.Write(path, DebugInfo::ImageKey(image.data(), image.size()));
+}
 
 int main(int argc, char** argv)
 {
 	argc--;
 	argv++;
 
-	if (argc < 1) 
+	bool optimize = argc > 1 && std::string_view(argv[0]) == "-O";
+	if (optimize)
+	{
+		argc--;
+		argv++;
+	}
+
+	if (argc < 1)
 	{
-		std::cout << "Only one argument is supported - the filename (with sources) e.g. \"my_src.asm\"" << std::endl;
+		std::cout << "Usage: lc3-asm [-O] my_src.asm, -O removes redundant instructions" << std::endl;
 		return EXIT_FAILURE;
 	}
 
 	auto filename = std::string_view(argv[0]);
 	auto objfn = std::string(filename.substr(0, filename.size() - 4)) + ".obj";
+	auto dbgfn = std::string(filename.substr(0, filename.size() - 4)) + ".dbg";
 
 	std::ifstream is(filename.data(), std::ios::in | std::ios::binary);
 
@@ -168,26 +699,30 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
-	std::string line;
-	std::vector<Token> tokens;
-
-	while (std::getline(is, line))
+	Assembler assembler(filename);
+	if (!assembler.Parse(is)) {
+		return EXIT_FAILURE;
+	}
+	if (optimize)
 	{
-		Tokenize(line, tokens);
+		auto saved = assembler.Optimize();
+		std::cerr << filename << ": " << saved << " words saved by -O\n";
+	}
+	if (!assembler.Layout() || !assembler.Encode()) {
+		return EXIT_FAILURE;
 	}
 
 	std::ofstream os(objfn.data(), std::ios::out | std::ios::binary);
-
-	for (const auto& code : tokens) {
-		if constexpr (std::endian::native == std::endian::big)
-		{
-			auto val = ReverseBits(reinterpret_cast<const char*>(&code.second), reinterpret_cast<const char*>(&code.second) + (char)8);
-			os.write(reinterpret_cast<const char*>(&val), sizeof(int64_t));
-		}
-		else {
-			os.write(reinterpret_cast<const char*>(&code.second), sizeof(int64_t));
-		}
+	for (auto word : assembler.Image())
+	{
+		word = Swap(word);
+		os.write(reinterpret_cast<const char*>(&word), sizeof(word));
+	}
+	if (!os)
+	{
+		std::cerr << "Can't write " << objfn << std::endl;
+		return EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
-}
\ No newline at end of file
+	return WriteDebugInfo(assembler, filename, dbgfn) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
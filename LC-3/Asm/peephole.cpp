@@ -0,0 +1,248 @@
+#include "peephole.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+
+namespace
+{
+	/// <summary>
+	/// Register written and registers read by an instruction, the flags are
+	/// always set from the register written
+	/// </summary>
+	struct Effect
+	{
+		int dest{ -1 };
+		uint8_t reads{ 0 };
+		/// <summary>
+		/// Nothing but the register and the flags change, removing the
+		/// instruction can't be seen once both are overwritten
+		/// </summary>
+		bool pure{ false };
+	};
+
+	bool IsRegister(const Statement& st, size_t i)
+	{
+		return i < st.operands.size() && st.operands[i].kind == Operand::Kind::Register;
+	}
+
+	bool IsNumber(const Statement& st, size_t i, int32_t value)
+	{
+		return i < st.operands.size() && st.operands[i].kind == Operand::Kind::Number && st.operands[i].value == value;
+	}
+
+	Effect Analyze(const Statement& st)
+	{
+		Effect effect;
+		auto& op = st.op;
+		auto count = st.operands.size();
+		if ((op == "ADD" || op == "AND") && count == 3 && IsRegister(st, 0) && IsRegister(st, 1))
+		{
+			effect.dest = st.operands[0].value;
+			effect.pure = true;
+			// NOTE: AND with 0 doesn't depend on its source
+			if (op == "AND" && IsNumber(st, 2, 0)) {
+				return effect;
+			}
+			effect.reads = static_cast<uint8_t>(1 << st.operands[1].value);
+			if (IsRegister(st, 2)) {
+				effect.reads |= static_cast<uint8_t>(1 << st.operands[2].value);
+			}
+			else if (st.operands[2].kind != Operand::Kind::Number) {
+				return {};
+			}
+		}
+		else if (op == "NOT" && count == 2 && IsRegister(st, 0) && IsRegister(st, 1))
+		{
+			effect.dest = st.operands[0].value;
+			effect.reads = static_cast<uint8_t>(1 << st.operands[1].value);
+			effect.pure = true;
+		}
+		else if (op == "LEA" && count == 2 && IsRegister(st, 0))
+		{
+			effect.dest = st.operands[0].value;
+			effect.pure = true;
+		}
+		else if ((op == "LD" || op == "LDI") && count == 2 && IsRegister(st, 0)) {
+			effect.dest = st.operands[0].value;
+		}
+		else if (op == "LDR" && count == 3 && IsRegister(st, 0) && IsRegister(st, 1))
+		{
+			effect.dest = st.operands[0].value;
+			effect.reads = static_cast<uint8_t>(1 << st.operands[1].value);
+		}
+		return effect;
+	}
+
+	bool HasNumericOffset(const Statement& st)
+	{
+		uint16_t nzp;
+		auto& op = st.op;
+		if (!IsBranch(op, nzp) && op != "JSR" && op != "LD" && op != "LDI" && op != "LEA" && op != "ST" && op != "STI") {
+			return false;
+		}
+		return !st.operands.empty() && st.operands.back().kind == Operand::Kind::Number;
+	}
+
+	/// <summary>
+	/// Addresses the statements fill before optimization, sized as layout
+	/// will size them
+	/// </summary>
+	void ImageRange(const std::vector<Statement>& statements, uint32_t& begin, uint32_t& end)
+	{
+		begin = end = 0;
+		for (auto& st : statements)
+		{
+			if (st.op == ".ORIG") {
+				begin = end = st.operands.empty() ? 0 : static_cast<uint16_t>(st.operands[0].value);
+			}
+			else if (st.op == ".BLKW") {
+				end += st.operands.empty() ? 0 : std::max(st.operands[0].value, 0);
+			}
+			else if (st.op == ".STRINGZ") {
+				end += static_cast<uint32_t>(st.operands.empty() ? 1 : st.operands[0].text.size() + 1);
+			}
+			else {
+				++end;
+			}
+		}
+	}
+
+	std::string Text(const Statement& st)
+	{
+		auto text = st.op;
+		for (size_t i = 0; i < st.operands.size(); ++i)
+		{
+			auto& operand = st.operands[i];
+			text += i ? ", " : " ";
+			switch (operand.kind)
+			{
+			case Operand::Kind::Register: text += 'R' + std::to_string(operand.value); break;
+			case Operand::Kind::Number: text += '#' + std::to_string(operand.value); break;
+			default: text += operand.text; break;
+			}
+		}
+		return text;
+	}
+}
+
+size_t Optimize(std::vector<Statement>& statements, std::string_view file)
+{
+	auto note = [file](const Statement& st, const std::string& message) {
+		std::cerr << file << ':' << st.line << ": note: " << message << '\n';
+	};
+
+	uint32_t begin, end;
+	ImageRange(statements, begin, end);
+	for (auto& st : statements)
+	{
+		if (HasNumericOffset(st))
+		{
+			note(st, "numeric PC offset, the program is not optimized");
+			return 0;
+		}
+		// NOTE: likely a pointer into the program, which would move
+		auto& operands = st.operands;
+		if (st.op == ".FILL" && !operands.empty() && operands[0].kind == Operand::Kind::Number &&
+			static_cast<uint16_t>(operands[0].value) >= begin && static_cast<uint16_t>(operands[0].value) < end)
+		{
+			note(st, "numeric address inside the program, the program is not optimized");
+			return 0;
+		}
+	}
+
+	// NOTE: stored to or with their address taken, the words under these
+	// labels are not constants
+	std::set<std::string> variables;
+	for (auto& st : statements)
+	{
+		if (st.op != "ST" && st.op != "STI" && st.op != "LEA" && st.op != ".FILL") {
+			continue;
+		}
+		for (auto& operand : st.operands)
+		{
+			if (operand.kind == Operand::Kind::Label) {
+				variables.insert(operand.text);
+			}
+		}
+	}
+
+	// NOTE: labels of a removed statement move to the next one, which is
+	// where they point once it is gone
+	auto remove = [&statements](size_t i) {
+		auto& labels = statements[i].labels;
+		auto& next = statements[i + 1].labels;
+		next.insert(next.begin(), labels.begin(), labels.end());
+		statements.erase(statements.begin() + i);
+	};
+
+	size_t saved = 0;
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		std::map<std::string, size_t> labels;
+		for (size_t i = 0; i < statements.size(); ++i)
+		{
+			for (auto& label : statements[i].labels)
+			{
+				labels.emplace(label, i);
+			}
+		}
+
+		for (size_t i = 0; i < statements.size() && !changed; ++i)
+		{
+			auto& st = statements[i];
+			auto last = i + 1 == statements.size();
+			auto effect = Analyze(st);
+			uint16_t nzp;
+
+			if (!last && IsBranch(st.op, nzp) && st.operands.size() == 1 && st.operands[0].kind == Operand::Kind::Label &&
+				labels.count(st.operands[0].text) && labels[st.operands[0].text] == i + 1)
+			{
+				note(st, "removed " + Text(st) + ", it branches to the next instruction");
+				remove(i);
+				changed = true;
+				++saved;
+			}
+			if (!changed && !last && effect.pure)
+			{
+				auto& next = statements[i + 1];
+				auto after = Analyze(next);
+				if (after.dest == effect.dest && !(after.reads & (1 << effect.dest)))
+				{
+					note(st, "removed " + Text(st) + ", overwritten by " + Text(next) + " on line " + std::to_string(next.line));
+					remove(i);
+					changed = true;
+					++saved;
+				}
+			}
+			if (!changed && st.op == "ADD" && st.labels.empty() && i > 0 && IsRegister(st, 0) && IsRegister(st, 1) &&
+				st.operands[0].value == st.operands[1].value && IsNumber(st, 2, 0) &&
+				Analyze(statements[i - 1]).dest == st.operands[0].value)
+			{
+				note(st, "removed " + Text(st) + ", the flags are already set by line " + std::to_string(statements[i - 1].line));
+				statements.erase(statements.begin() + i);
+				changed = true;
+				++saved;
+			}
+			if (!changed && st.op == "LD" && effect.dest >= 0 && st.operands[1].kind == Operand::Kind::Label &&
+				labels.count(st.operands[1].text))
+			{
+				auto& constant = statements[labels[st.operands[1].text]];
+				bool variable = std::any_of(constant.labels.begin(), constant.labels.end(),
+					[&variables](auto& label) { return variables.count(label) != 0; });
+				if (constant.op == ".FILL" && IsNumber(constant, 0, 0) && !variable)
+				{
+					note(st, "replaced " + Text(st) + " with AND, the constant is 0");
+					st.op = "AND";
+					st.operands = { st.operands[0], st.operands[0], Operand{ Operand::Kind::Number, 0, {} } };
+					// NOTE: same size, one memory access less
+					changed = true;
+				}
+			}
+		}
+	}
+	return saved;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "statement.h"
+
+/// <summary>
+/// Optional lc3-asm pass removing redundant instructions before layout:
+/// writes overwritten by the next instruction (double AND Rx,Rx,#0...),
+/// ADD Rx,Rx,#0 right after an instruction that set the flags from Rx,
+/// branches to the next instruction, and LD of a zero constant, which
+/// becomes AND Rx,Rx,#0.
+/// </summary>
+/// <remarks>
+/// Registers and flags are kept exactly as they were at every label, so
+/// jumps into the code see no difference. Code addressed with numeric PC
+/// offsets or by .FILL words holding numbers inside the program is left
+/// alone, and constants read with LD are assumed not to be written through
+/// pointers. Every change is reported as a note.
+/// </remarks>
+/// <returns>number of words saved</returns>
+size_t Optimize(std::vector<Statement>& statements, std::string_view file);
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Instruction or directive argument
+/// </summary>
+struct Operand
+{
+	enum class Kind { Register, Number, Label, String };
+
+	Kind kind;
+	int32_t value{ 0 };
+	std::string text;
+};
+
+/// <summary>
+/// One source line with an instruction or a directive, labels on lines of
+/// their own are attached to the next statement
+/// </summary>
+struct Statement
+{
+	uint32_t line{ 0 };
+	std::vector<std::string> labels;
+	/// <summary>
+	/// Mnemonic or directive in upper case
+	/// </summary>
+	std::string op;
+	std::vector<Operand> operands;
+	uint16_t address{ 0 };
+	uint16_t size{ 0 };
+};
+
+/// <summary>
+/// BR with any of n, z, p in this order, plain BR branches always
+/// </summary>
+inline bool IsBranch(const std::string& upper, uint16_t& nzp)
+{
+	if (upper.rfind("BR", 0) != 0) {
+		return false;
+	}
+	auto flags = std::string_view(upper).substr(2);
+	if (flags.empty())
+	{
+		nzp = 0b111;
+		return true;
+	}
+	size_t pos = 0;
+	nzp = 0;
+	for (auto [ch, bit] : { std::pair{ 'N', 0b100 }, { 'Z', 0b010 }, { 'P', 0b001 } })
+	{
+		if (pos < flags.size() && flags[pos] == ch)
+		{
+			nzp |= bit;
+			++pos;
+		}
+	}
+	return pos == flags.size();
+}
@@ -0,0 +1,403 @@
+#include <iostream>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+
+#include "LC-3.h"
+#include "filelist.h"
+#include "hash.h"
+#include "lockstep.h"
+#include "pool.h"
+#include "resultcache.h"
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Outcome of one program run
+/// </summary>
+struct Result
+{
+	std::string output;
+	uint64_t instructions{ 0 };
+	/// <summary>
+	/// Final registers and memory, only computed for the cache and --verify
+	/// </summary>
+	Hash128 state;
+};
+
+/// <summary>
+/// Hash of registers R0-R7, PC, COND and of memory below the devices,
+/// whose content depends on how an engine models them
+/// </summary>
+template<typename RegisterFn, typename PeekFn>
+Hash128 StateDigest(RegisterFn reg, PeekFn peek)
+{
+	Hasher hasher;
+	for (auto r = static_cast<int>(R::FIRST); r < static_cast<int>(R::NREG); ++r)
+	{
+		hasher.Add(static_cast<uint16_t>(reg(static_cast<R>(r))));
+	}
+
+	std::vector<uint16_t> memory(Memory::kDeviceBase);
+	for (size_t addr = 0; addr < memory.size(); ++addr)
+	{
+		memory[addr] = peek(static_cast<uint16_t>(addr));
+	}
+	hasher.Update(memory.data(), memory.size() * sizeof(uint16_t));
+	return hasher.Digest();
+}
+
+bool ReadInput(const fs::path& path, std::string& input)
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (!is) {
+		std::cerr << "Can't read " << path << '\n';
+		return false;
+	}
+	std::ostringstream text;
+	text << is.rdbuf();
+	input = text.str();
+	return true;
+}
+
+/// <summary>
+/// Run every input on a fresh Machine, a VirtualMachine without translated
+/// code is the reference engine
+/// </summary>
+/// <returns>false when a machine can't be had or the program can't be
+/// loaded, the remaining inputs are not run</returns>
+template<typename Machine>
+bool RunScalar(const fs::path& program, const std::shared_ptr<const NativeCode>& native,
+	const std::vector<std::string>& inputs, bool digest, std::vector<Result>& results,
+	RuntimeMetrics* metrics = nullptr)
+{
+	// NOTE: recycled machines only clear the pages the previous run touched
+	MachinePool<Machine> pool;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		auto vm = pool.Acquire();
+		if (!vm)
+		{
+			std::cerr << "Out of memory for machines\n";
+			return false;
+		}
+		std::ostringstream out;
+		vm->SetOutput(&out);
+		vm->SetInput(inputs[i]);
+		if (!vm->LoadObj(program))
+		{
+			std::cerr << "Can't load " << program << '\n';
+			return false;
+		}
+		vm->SetNative(native);
+		vm->Run();
+		if (metrics) {
+			metrics->Add(vm->Metrics());
+		}
+
+		results[i].output = out.str();
+		results[i].instructions = vm->InstructionCount();
+		if (digest)
+		{
+			results[i].state = StateDigest([&](R r) { return vm->GetRegister(r); },
+				[&](uint16_t addr) { return vm->Peek(addr); });
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Run the inputs on a LockstepMachine, a lane takes the next input as soon
+/// as its run is over
+/// </summary>
+void RunLockstep(const Memory& image, size_t lanes, const std::vector<std::string>& inputs,
+	bool digest, std::vector<Result>& results, double& occupancy, RuntimeMetrics& metrics)
+{
+	lanes = std::min(lanes, inputs.size());
+	LockstepMachine machine(image, lanes);
+
+	std::vector<size_t> running(lanes);
+	size_t next = 0;
+	for (size_t lane = 0; lane < lanes; ++lane)
+	{
+		running[lane] = next;
+		machine.SetInput(lane, inputs[next++]);
+	}
+
+	machine.Run([&](size_t lane) {
+		auto& result = results[running[lane]];
+		result.output = machine.Output(lane);
+		result.instructions = machine.InstructionCount(lane);
+		metrics.Add(machine.Metrics(lane));
+		if (digest)
+		{
+			result.state = StateDigest([&](R r) { return machine.Register(lane, r); },
+				[&](uint16_t addr) { return machine.Peek(lane, addr); });
+		}
+
+		if (next < inputs.size())
+		{
+			running[lane] = next;
+			machine.Restart(lane, inputs[next++]);
+		}
+	});
+
+	occupancy = machine.Steps() ? static_cast<double>(machine.Retired()) / machine.Steps() : 0;
+}
+
+int main(int argc, char** argv)
+{
+	argc--;
+	argv++;
+
+	std::string_view engine = "lockstep";
+	size_t lanes = 256;
+	bool verify = false;
+	fs::path outDir;
+	fs::path nativePath;
+	fs::path cachePath;
+	fs::path metricsPath;
+	fs::path segmentPath;
+	fs::path program;
+	std::vector<fs::path> inputPaths;
+
+	for (; argc > 0; argc--, argv++)
+	{
+		auto arg = std::string_view(argv[0]);
+		if (arg == "--engine" && argc > 1)
+		{
+			engine = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--lanes" && argc > 1)
+		{
+			lanes = std::max(1, std::atoi(argv[1]));
+			argc--;
+			argv++;
+		}
+		else if (arg == "--native" && argc > 1)
+		{
+			engine = "native";
+			nativePath = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--cache" && argc > 1)
+		{
+			cachePath = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--metrics" && argc > 1)
+		{
+			metricsPath = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--metrics-shm" && argc > 1)
+		{
+			segmentPath = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--verify") {
+			verify = true;
+		}
+		else if (arg == "-o" && argc > 1)
+		{
+			outDir = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (program.empty()) {
+			program = arg;
+		}
+		else if (!CollectInputs(arg, inputPaths)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (program.empty() || inputPaths.empty() ||
+		(engine != "lockstep" && engine != "scalar" && !(engine == "native" && !nativePath.empty())))
+	{
+		std::cout << "Usage: lc3-batch [--engine lockstep | scalar | --native program.so] [--lanes N] [--cache file] [--metrics file.prom] [--metrics-shm segment] [--verify] [-o out_dir] program.obj input... | @input_list" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::shared_ptr<NativeCode> native;
+	if (!nativePath.empty())
+	{
+		native = std::make_shared<NativeCode>();
+		if (!native->Load(nativePath)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	auto image = std::make_unique<Memory>();
+	std::ifstream is(program, std::ios::in | std::ios::binary);
+	if (!is || !image->ReadObj(is))
+	{
+		std::cerr << "Can't read " << program << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> inputs(inputPaths.size());
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (!ReadInput(inputPaths[i], inputs[i])) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::error_code ec;
+	if (!outDir.empty() && !fs::create_directories(outDir, ec) && ec)
+	{
+		std::cerr << "Can't create output directory " << outDir << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	ResultCache cache;
+	if (!cachePath.empty() && !cache.Open(cachePath)) {
+		return EXIT_FAILURE;
+	}
+	bool digest = verify || !cachePath.empty();
+
+	// NOTE: runs taken from the cache are not counted, nothing ran them
+	RuntimeMetrics metrics;
+	if (!segmentPath.empty() && !metrics.Share(segmentPath)) {
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Result> results(inputs.size());
+	std::vector<Hash128> keys(inputs.size());
+	std::vector<size_t> pending;
+	double occupancy = 1;
+	auto start = std::chrono::steady_clock::now();
+
+	if (!cachePath.empty())
+	{
+		// NOTE: runs share the image and the initial registers, the input
+		// is hashed on top of them
+		Hasher base;
+		std::vector<uint16_t> words(image->LoadedSize());
+		for (size_t i = 0; i < words.size(); ++i)
+		{
+			words[i] = image->Fetch(static_cast<uint16_t>(image->Origin() + i));
+		}
+		base.Add(image->Origin()).Add(static_cast<uint64_t>(words.size()));
+		base.Update(words.data(), words.size() * sizeof(uint16_t));
+		std::array<uint16_t, static_cast<size_t>(R::NREG)> registers{};
+		registers[static_cast<size_t>(R::PC)] = 0x3000;
+		base.Add(registers);
+
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			auto key = base;
+			keys[i] = key.Add(static_cast<uint64_t>(inputs[i].size())).Update(inputs[i].data(), inputs[i].size()).Digest();
+
+			ResultCache::Entry entry;
+			if (cache.Find(keys[i], entry)) {
+				results[i] = { std::move(entry.output), entry.instructions, entry.state };
+			}
+			else {
+				pending.push_back(i);
+			}
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			pending.push_back(i);
+		}
+	}
+
+	std::vector<std::string> runInputs;
+	for (auto i : pending)
+	{
+		runInputs.push_back(inputs[i]);
+	}
+	std::vector<Result> runResults(pending.size());
+	// NOTE: nothing is left to run when everything came from the cache
+	if (engine == "lockstep" && !runInputs.empty()) {
+		RunLockstep(*image, lanes, runInputs, digest, runResults, occupancy, metrics);
+	}
+	else if (engine != "lockstep" && !RunScalar<ReleaseVirtualMachine>(program, native, runInputs, digest, runResults, &metrics)) {
+		return EXIT_FAILURE;
+	}
+
+	uint64_t executed = 0;
+	for (size_t j = 0; j < pending.size(); ++j)
+	{
+		executed += runResults[j].instructions;
+		if (!cachePath.empty()) {
+			cache.Insert(keys[pending[j]], { runResults[j].output, runResults[j].instructions, runResults[j].state });
+		}
+		results[pending[j]] = std::move(runResults[j]);
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t failed = 0;
+	if (!metricsPath.empty() && !metrics.WritePrometheus(metricsPath)) {
+		++failed;
+	}
+
+	if (verify)
+	{
+		// NOTE: the VM is the reference every other engine has to match
+		std::vector<Result> expected(inputs.size());
+		if (!RunScalar<VirtualMachine>(program, nullptr, inputs, true, expected)) {
+			return EXIT_FAILURE;
+		}
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (results[i].output != expected[i].output || results[i].instructions != expected[i].instructions ||
+				results[i].state != expected[i].state)
+			{
+				std::cerr << "Mismatch on " << inputPaths[i] << ": " << results[i].instructions
+					<< " instructions, expected " << expected[i].instructions << '\n';
+				++failed;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (outDir.empty()) {
+			continue;
+		}
+
+		auto out = outDir / inputPaths[i].stem();
+		out += ".out";
+		std::ofstream os(out, std::ios::out | std::ios::binary);
+		os << results[i].output;
+		if (!os)
+		{
+			std::cerr << "Can't write " << out << '\n';
+			++failed;
+		}
+	}
+
+	std::cout << inputs.size() << " runs";
+	if (!cachePath.empty()) {
+		std::cout << " (" << inputs.size() - pending.size() << " from cache)";
+	}
+	std::cout << ", " << executed << " instructions in "
+		<< static_cast<uint64_t>(elapsed * 1000) << " ms, "
+		<< static_cast<uint64_t>(elapsed > 0 ? executed / elapsed / 1e6 : 0) << " MIPS";
+	if (engine == "lockstep") {
+		std::cout << ", " << occupancy << " lanes per step";
+	}
+	std::cout << std::endl;
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
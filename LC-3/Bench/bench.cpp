@@ -0,0 +1,229 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+
+#include "LC-3.h"
+#include "pool.h"
+
+/// <summary>
+/// Built-in workload: Collatz step counts of 1..400 stored in a table at
+/// x4000 through an indirect pointer, then summed. About 23M instructions,
+/// no input, mostly ALU ops and branches with a share of loads and stores.
+/// Assembled from workload.asm at build time.
+/// </summary>
+const VMProgram kWorkload =
+{
+#include "workload.inc"
+};
+
+/// <summary>
+/// Helper workloads: 800 rounds of a multiply, a divide, a 64 word copy, a
+/// 64 word fill and a string compare, checksummed and printed in binary.
+/// kGuestHelpers calls shift-and-add, shift-and-subtract and LDR/STR loop
+/// routines, kHostHelpers the MUL, DIV, MEMCPY, MEMSET and STRCMP traps.
+/// Assembled from guesthelpers.asm and hosthelpers.asm at build time.
+/// </summary>
+const VMProgram kGuestHelpers =
+{
+#include "guesthelpers.inc"
+};
+
+const VMProgram kHostHelpers =
+{
+#include "hosthelpers.inc"
+};
+
+struct Sample
+{
+	double seconds{ 0 };
+	uint64_t instructions{ 0 };
+	std::string output;
+};
+
+/// <summary>
+/// Best of runs executions of the program on a Machine
+/// </summary>
+template<typename Machine>
+bool Measure(const VMProgram& program, const std::string& input, int runs, Sample& best)
+{
+	for (int run = 0; run < runs; ++run)
+	{
+		auto vm = std::make_unique<Machine>(false);
+		std::ostringstream out;
+		vm->SetOutput(&out);
+		vm->SetInput(input);
+		if (!vm->LoadProgram(program)) {
+			return false;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		vm->Run();
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (!run || elapsed < best.seconds) {
+			best.seconds = elapsed;
+		}
+		best.instructions = vm->InstructionCount();
+		best.output = out.str();
+	}
+	return true;
+}
+
+/// <summary>
+/// Average cost of a run of a one instruction program on a new machine
+/// and on one recycled by a pool
+/// </summary>
+template<typename Machine>
+void MeasureStartup(int runs, double& fresh, double& pooled)
+{
+	const VMProgram halt = { 0x3000, 0xF025 };
+	std::ostringstream out;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; ++run)
+	{
+		auto vm = std::make_unique<Machine>(false);
+		vm->SetOutput(&out);
+		vm->LoadProgram(halt);
+		vm->Run();
+	}
+	fresh = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+
+	// NOTE: the pool constructs its only machine before timing starts
+	MachinePool<Machine> pool;
+	pool.Acquire();
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; ++run)
+	{
+		auto vm = pool.Acquire();
+		vm->SetOutput(&out);
+		vm->LoadProgram(halt);
+		vm->Run();
+	}
+	pooled = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+bool ReadFile(std::string_view path, std::string& data)
+{
+	std::ifstream is(std::string(path), std::ios::in | std::ios::binary);
+	if (!is) {
+		std::cerr << "Can't read " << path << '\n';
+		return false;
+	}
+	std::ostringstream text;
+	text << is.rdbuf();
+	data = text.str();
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	argc--;
+	argv++;
+
+	int runs = 5;
+	std::string_view obj;
+	std::string_view inputPath;
+
+	for (; argc > 0; argc--, argv++)
+	{
+		auto arg = std::string_view(argv[0]);
+		if (arg == "--runs" && argc > 1)
+		{
+			runs = std::max(1, std::atoi(argv[1]));
+			argc--;
+			argv++;
+		}
+		else if (obj.empty()) {
+			obj = arg;
+		}
+		else if (inputPath.empty()) {
+			inputPath = arg;
+		}
+		else
+		{
+			std::cout << "Usage: lc3-bench [--runs N] [program.obj [input.txt]]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	VMProgram program = kWorkload;
+	if (!obj.empty())
+	{
+		// NOTE: .obj files are big endian
+		std::string data;
+		if (!ReadFile(obj, data) || data.size() < 2) {
+			return EXIT_FAILURE;
+		}
+		program.resize(data.size() / 2);
+		for (size_t i = 0; i < program.size(); ++i)
+		{
+			program[i] = static_cast<uint16_t>(static_cast<uint8_t>(data[2 * i]) << 8 | static_cast<uint8_t>(data[2 * i + 1]));
+		}
+	}
+
+	std::string input;
+	if (!inputPath.empty() && !ReadFile(inputPath, input)) {
+		return EXIT_FAILURE;
+	}
+
+	Sample debug, release, profile;
+	if (!Measure<VirtualMachine>(program, input, runs, debug) ||
+		!Measure<ReleaseVirtualMachine>(program, input, runs, release) ||
+		!Measure<ProfilingVirtualMachine>(program, input, runs, profile))
+	{
+		std::cerr << "Can't load the program\n";
+		return EXIT_FAILURE;
+	}
+
+	int failed = 0;
+	auto report = [&](std::string_view name, const Sample& sample) {
+		std::cout << name << ": " << sample.instructions << " instructions in "
+			<< static_cast<uint64_t>(sample.seconds * 1000) << " ms, "
+			<< static_cast<uint64_t>(sample.seconds > 0 ? sample.instructions / sample.seconds / 1e6 : 0) << " MIPS, "
+			<< (sample.seconds > 0 ? debug.seconds / sample.seconds : 0) << "x debug";
+		// NOTE: every configuration has to run the program exactly as the
+		// checked one does
+		if (sample.instructions != debug.instructions || sample.output != debug.output)
+		{
+			std::cout << ", MISMATCH";
+			++failed;
+		}
+		std::cout << std::endl;
+	};
+	report("debug    ", debug);
+	report("release  ", release);
+	report("profiling", profile);
+
+	double fresh, pooled;
+	MeasureStartup<ReleaseVirtualMachine>(runs * 2000, fresh, pooled);
+	std::cout << "startup  : " << static_cast<uint64_t>(fresh * 1e9) << " ns per run on a new machine, "
+		<< static_cast<uint64_t>(pooled * 1e9) << " ns on a pooled one" << std::endl;
+
+	// NOTE: the same work and output, the difference is what host helpers
+	// save guest libraries
+	Sample guest, host;
+	if (!Measure<ReleaseVirtualMachine>(kGuestHelpers, "", runs, guest) ||
+		!Measure<ReleaseVirtualMachine>(kHostHelpers, "", runs, host))
+	{
+		std::cerr << "Can't load the helper workloads\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "helpers  : " << static_cast<uint64_t>(guest.seconds * 1e6) << " us with guest routines, "
+		<< static_cast<uint64_t>(host.seconds * 1e6) << " us with host traps, "
+		<< (host.seconds > 0 ? guest.seconds / host.seconds : 0) << "x faster";
+	if (guest.output != host.output)
+	{
+		std::cout << ", MISMATCH";
+		++failed;
+	}
+	std::cout << std::endl;
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
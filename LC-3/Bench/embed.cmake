@@ -0,0 +1,6 @@
+# Turns a big endian .obj into the words of a VMProgram initializer
+#
+# cmake -DOBJ=program.obj -DOUT=program.inc -P embed.cmake
+file(READ ${OBJ} data HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f][0-9a-f][0-9a-f])" "0x\\1, " words "${data}")
+file(WRITE ${OUT} "${words}\n")
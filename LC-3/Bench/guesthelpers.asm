@@ -0,0 +1,175 @@
+; lc3-bench helper workload with guest routines: shift-and-add multiply,
+; shift-and-subtract divide and LDR/STR loops. Same work and output as
+; hosthelpers.asm.
+; 800 rounds of a multiply, a divide, a 64 word copy, a 64 word fill and a
+; string compare, checksummed in R6 and printed in binary.
+;
+; The routines only match the host traps on what this program gives them:
+; GDIV is unsigned where DIV truncates signed operands, GMEMCPY copies
+; forward only, GSTRCMP orders by the signed difference of the words.
+;
+	.ORIG x3000
+	AND R6, R6, #0
+	LD R5, ROUNDS
+LOOP	ADD R0, R5, #0
+	LD R1, K37
+	JSR GMUL
+	ADD R6, R6, R0
+	LD R1, K11
+	JSR GDIV
+	ADD R6, R6, R0
+	ADD R6, R6, R1
+	LD R0, PDST
+	LD R1, PSRC
+	LD R2, K64
+	JSR GMEMCPY
+	LD R0, PFILL
+	ADD R1, R5, #0
+	LD R2, K64
+	JSR GMEMSET
+	LD R0, PDST
+	LD R1, PSTR
+	JSR GSTRCMP
+	ADD R6, R6, R0
+	ADD R5, R5, #-1
+	BRp LOOP
+	LD R2, K16
+BITS	LD R0, ZERO      ; top bit of the checksum first
+	ADD R6, R6, #0
+	BRzp PUT
+	ADD R0, R0, #1
+PUT	OUT
+	ADD R6, R6, R6
+	ADD R2, R2, #-1
+	BRp BITS
+	AND R0, R0, #0
+	ADD R0, R0, #10
+	OUT
+	HALT
+ROUNDS	.FILL #800
+K37	.FILL #37
+K11	.FILL #11
+K16	.FILL #16
+K64	.FILL #64
+ZERO	.FILL x30
+PDST	.FILL DST
+PSRC	.FILL SRC
+PSTR	.FILL TEXT
+PFILL	.FILL FILL
+GMUL	ST R2, S2      ; R0 = R0 * R1
+	ST R3, S3
+	ST R4, S4
+	AND R2, R2, #0
+	ADD R3, R1, #0
+	LD R4, K16
+MLOOP	ADD R2, R2, R2
+	ADD R3, R3, #0
+	BRzp MNEXT
+	ADD R2, R2, R0
+MNEXT	ADD R3, R3, R3
+	ADD R4, R4, #-1
+	BRp MLOOP
+	ADD R0, R2, #0
+	LD R2, S2
+	LD R3, S3
+	LD R4, S4
+	ADD R0, R0, #0
+	RET
+GDIV	ST R2, S2      ; R0 = R0 / R1, R1 = R0 % R1
+	ST R3, S3
+	ST R4, S4
+	ST R5, S5
+	NOT R5, R1
+	ADD R5, R5, #1
+	AND R2, R2, #0
+	ADD R3, R0, #0
+	AND R0, R0, #0
+	LD R4, K16
+DLOOP	ADD R0, R0, R0
+	ADD R2, R2, R2
+	ADD R3, R3, #0
+	BRzp DBIT
+	ADD R2, R2, #1
+DBIT	ADD R3, R3, R3
+	ADD R1, R2, R5
+	BRn DNEXT
+	ADD R2, R1, #0
+	ADD R0, R0, #1
+DNEXT	ADD R4, R4, #-1
+	BRp DLOOP
+	ADD R1, R2, #0
+	LD R2, S2
+	LD R3, S3
+	LD R4, S4
+	LD R5, S5
+	ADD R0, R0, #0
+	RET
+GMEMCPY	ST R0, S0      ; R2 words from R1 to R0
+	ST R1, S1
+	ST R2, S2
+	ST R3, S3
+	ADD R2, R2, #0
+	BRz CDONE
+CLOOP	LDR R3, R1, #0
+	STR R3, R0, #0
+	ADD R0, R0, #1
+	ADD R1, R1, #1
+	ADD R2, R2, #-1
+	BRp CLOOP
+CDONE	LD R0, S0
+	LD R1, S1
+	LD R2, S2
+	LD R3, S3
+	RET
+GMEMSET	ST R0, S0      ; R2 words of R1 at R0
+	ST R2, S2
+	ADD R2, R2, #0
+	BRz SDONE
+SLOOP	STR R1, R0, #0
+	ADD R0, R0, #1
+	ADD R2, R2, #-1
+	BRp SLOOP
+SDONE	LD R0, S0
+	LD R2, S2
+	RET
+GSTRCMP	ST R1, S1      ; R0 = -1, 0 or 1 comparing strings at R0 and R1
+	ST R2, S2
+	ST R3, S3
+	ST R4, S4
+CMPL	LDR R2, R0, #0
+	LDR R3, R1, #0
+	NOT R4, R3
+	ADD R4, R4, #1
+	ADD R4, R2, R4
+	BRnp CDIFF
+	ADD R2, R2, #0
+	BRz CEQ
+	ADD R0, R0, #1
+	ADD R1, R1, #1
+	BR CMPL
+CDIFF	AND R0, R0, #0
+	ADD R4, R4, #0
+	BRn CNEG
+	ADD R0, R0, #1
+	BR CRET
+CNEG	ADD R0, R0, #-1
+	BR CRET
+CEQ	AND R0, R0, #0
+CRET	LD R1, S1
+	LD R2, S2
+	LD R3, S3
+	LD R4, S4
+	ADD R0, R0, #0
+	RET
+S0	.BLKW 1
+S1	.BLKW 1
+S2	.BLKW 1
+S3	.BLKW 1
+S4	.BLKW 1
+S5	.BLKW 1
+SRC	.STRINGZ "the quick brown fox jumps over the lazy dog twice over"
+	.BLKW 8
+TEXT	.STRINGZ "the quick brown fox jumps over the lazy cat"
+DST	.BLKW 64
+FILL	.BLKW 64
+	.END
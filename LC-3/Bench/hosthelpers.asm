@@ -0,0 +1,59 @@
+; lc3-bench helper workload with the MUL, DIV, MEMCPY, MEMSET and STRCMP
+; host traps. Same work and output as guesthelpers.asm.
+; 800 rounds of a multiply, a divide, a 64 word copy, a 64 word fill and a
+; string compare, checksummed in R6 and printed in binary.
+;
+	.ORIG x3000
+	AND R6, R6, #0
+	LD R5, ROUNDS
+LOOP	ADD R0, R5, #0
+	LD R1, K37
+	MUL
+	ADD R6, R6, R0
+	LD R1, K11
+	DIV
+	ADD R6, R6, R0
+	ADD R6, R6, R1
+	LD R0, PDST
+	LD R1, PSRC
+	LD R2, K64
+	MEMCPY
+	LD R0, PFILL
+	ADD R1, R5, #0
+	LD R2, K64
+	MEMSET
+	LD R0, PDST
+	LD R1, PSTR
+	STRCMP
+	ADD R6, R6, R0
+	ADD R5, R5, #-1
+	BRp LOOP
+	LD R2, K16
+BITS	LD R0, ZERO      ; top bit of the checksum first
+	ADD R6, R6, #0
+	BRzp PUT
+	ADD R0, R0, #1
+PUT	OUT
+	ADD R6, R6, R6
+	ADD R2, R2, #-1
+	BRp BITS
+	AND R0, R0, #0
+	ADD R0, R0, #10
+	OUT
+	HALT
+ROUNDS	.FILL #800
+K37	.FILL #37
+K11	.FILL #11
+K16	.FILL #16
+K64	.FILL #64
+ZERO	.FILL x30
+PDST	.FILL DST
+PSRC	.FILL SRC
+PSTR	.FILL TEXT
+PFILL	.FILL FILL
+SRC	.STRINGZ "the quick brown fox jumps over the lazy dog twice over"
+	.BLKW 8
+TEXT	.STRINGZ "the quick brown fox jumps over the lazy cat"
+DST	.BLKW 64
+FILL	.BLKW 64
+	.END
@@ -0,0 +1,61 @@
+; Built-in lc3-bench workload: Collatz step counts of 1..400 stored in a
+; table at x4000 through an indirect pointer, then summed. About 23M
+; instructions, no input, mostly ALU ops and branches with a share of
+; loads and stores.
+;
+	.ORIG x3000
+	LD R6,TABP        ; table of step counts
+	LD R5,LIMIT
+	AND R1,R1,#0
+OUTER	ADD R1,R1,#1       ; next start value
+	ADD R7,R1,#0
+	NOT R2,R1
+	ADD R2,R2,#1
+	ADD R2,R2,R5
+	BRn SUM
+	ST R1,CUR
+	AND R4,R4,#0
+LOOP	ADD R2,R1,#-1      ; R4 counts steps until R1 is 1
+	BRz DONE
+	AND R2,R1,#1
+	BRz EVEN
+	ADD R3,R1,R1
+	ADD R1,R3,R1
+	ADD R1,R1,#1
+	BR NEXT
+EVEN	JSR HALF
+NEXT	ADD R4,R4,#1
+	BR LOOP
+DONE	LDI R1,CURP
+	ADD R3,R6,R1
+	STR R4,R3,#0
+	BR OUTER
+SUM	AND R0,R0,#0       ; sum the table, print its low bits as a digit
+	ADD R1,R5,#0
+SL	ADD R3,R6,R1
+	LDR R2,R3,#0
+	ADD R0,R0,R2
+	ADD R1,R1,#-1
+	BRp SL
+	LEA R1,MASK
+	LDR R1,R1,#0
+	AND R0,R0,R1
+	ADD R0,R0,#15
+	ADD R0,R0,#15
+	ADD R0,R0,#15
+	ADD R0,R0,#3
+	OUT
+	HALT
+HALF	AND R3,R3,#0      ; R1 / 2 by repeated subtraction
+HL	ADD R1,R1,#-2
+	BRn HD
+	ADD R3,R3,#1
+	BR HL
+HD	ADD R1,R3,#0
+	RET
+LIMIT	.FILL #400
+TABP	.FILL x4000
+CURP	.FILL CUR
+CUR	.FILL #0
+MASK	.FILL #7
+	.END
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+
+#include "memory.h"
+#include "cfg.h"
+#include "filelist.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv)
+{
+	argc--;
+	argv++;
+
+	bool json = false;
+	fs::path outDir;
+	std::vector<fs::path> inputs;
+
+	for (; argc > 0; argc--, argv++)
+	{
+		auto arg = std::string_view(argv[0]);
+		if (arg == "--json") {
+			json = true;
+		}
+		else if (arg == "--dot") {
+			json = false;
+		}
+		else if (arg == "-o" && argc > 1)
+		{
+			outDir = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (!CollectInputs(arg, inputs)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (inputs.empty())
+	{
+		std::cout << "Usage: lc3-cfg [--dot | --json] [-o out_dir] file.obj... | @file_list" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// NOTE: a single image without output directory goes to stdout
+	bool toStdout = inputs.size() == 1 && outDir.empty();
+
+	std::error_code ec;
+	if (!outDir.empty() && !fs::create_directories(outDir, ec) && ec)
+	{
+		std::cerr << "Can't create output directory " << outDir << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> failed{ 0 };
+	std::atomic<size_t> blocks{ 0 };
+	std::atomic<size_t> loops{ 0 };
+
+	auto worker = [&]() {
+		auto mem = std::make_unique<Memory>();
+		auto cfg = std::make_unique<ControlFlowGraph>();
+		std::ostringstream text;
+
+		for (size_t i; (i = next++) < inputs.size();)
+		{
+			const auto& input = inputs[i];
+			// NOTE: the previous image must not show through the gaps of
+			// this one
+			mem->Reset();
+			std::ifstream is(input, std::ios::in | std::ios::binary);
+			if (!is || !mem->ReadObj(is))
+			{
+				std::cerr << "Can't read " << input << '\n';
+				++failed;
+				continue;
+			}
+
+			cfg->Build(*mem);
+			blocks += cfg->Blocks().size();
+			loops += cfg->LoopCount();
+
+			text.str({});
+			json ? cfg->WriteJson(text) : cfg->WriteDot(text);
+
+			if (toStdout)
+			{
+				std::cout << text.str();
+				continue;
+			}
+
+			auto out = (outDir.empty() ? input.parent_path() : outDir) / input.stem();
+			out += json ? ".json" : ".dot";
+			std::ofstream os(out, std::ios::out | std::ios::binary);
+			os << text.str();
+			if (!os)
+			{
+				std::cerr << "Can't write " << out << '\n';
+				++failed;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	auto nThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), inputs.size());
+	for (size_t i = 1; i < nThreads; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	if (!toStdout)
+	{
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		std::cout << inputs.size() - failed << " images, " << blocks << " blocks, " << loops << " loops in " << ms << " ms" << std::endl;
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,461 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include <cstdlib>
+
+#ifndef WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // WIN32
+
+#include "LC-3.h"
+#include "coverage.h"
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// How a run on one input ended
+/// </summary>
+enum class Verdict
+{
+	Ok,
+	/// <summary>
+	/// Illegal instruction: RES, RTI or an unknown trap vector
+	/// </summary>
+	Crash,
+	/// <summary>
+	/// Still running when the instruction budget ran out
+	/// </summary>
+	Hang
+};
+
+/// <summary>
+/// Program under test, run in process on one input after another
+/// </summary>
+class Target
+{
+public:
+	Target(const VMProgram& program, CoverageMap& map, uint64_t budget) :
+		m_vm(std::make_unique<FuzzingVirtualMachine>(false)),
+		m_program(program),
+		m_budget(budget)
+	{
+		m_vm->Coverage().map = &map;
+	};
+
+	/// <summary>
+	/// Run input from the loaded image, its edges are added to the map
+	/// </summary>
+	Verdict Run(const std::string& input)
+	{
+		// NOTE: persistent mode, the machine is reset instead of rebuilt and
+		// only the pages the last run touched are cleared
+		m_vm->Reset();
+		m_vm->LoadProgram(m_program);
+		m_vm->SetInput(input);
+		m_vm->SetOutput(&m_muted);
+
+		// NOTE: an input ends where its bytes do, waiting for more would
+		// only spin until the next service tick
+		for (uint64_t n = 0; m_vm->Step(); ++n)
+		{
+			if (m_vm->InputExhausted()) {
+				return Verdict::Ok;
+			}
+			if (n == m_budget) {
+				return Verdict::Hang;
+			}
+		}
+		return m_vm->Peek(StopAddress()) == kHalt ? Verdict::Ok : Verdict::Crash;
+	};
+
+	/// <summary>
+	/// Address of the last instruction executed
+	/// </summary>
+	uint16_t StopAddress() { return static_cast<uint16_t>(m_vm->GetRegister(R::PC) - 1); };
+
+private:
+	inline static const uint16_t kHalt = 0xF025;
+
+	std::unique_ptr<FuzzingVirtualMachine> m_vm;
+	const VMProgram& m_program;
+	uint64_t m_budget;
+	std::ostream m_muted{ nullptr };
+};
+
+/// <summary>
+/// Havoc style mutations of keyboard input: bit flips, byte changes,
+/// insertions, deletions, duplicated blocks and splices with other inputs
+/// </summary>
+std::string Mutate(const std::vector<std::string>& corpus, const std::string& parent, std::mt19937_64& rng)
+{
+	static const size_t kMaxInput = 1024;
+	// NOTE: keys programs commonly look for
+	static const std::string_view kInteresting = "\n\r 0019azAZwasdqy\x1b\x7f";
+
+	auto pick = [&rng](size_t n) { return static_cast<size_t>(rng() % n); };
+	std::string input = parent;
+	auto stack = size_t(1) << pick(4);
+	for (size_t i = 0; i < stack; ++i)
+	{
+		switch (input.empty() ? 3 : pick(7))
+		{
+		case 0:
+			input[pick(input.size())] ^= static_cast<char>(1 << pick(8));
+			break;
+		case 1:
+			input[pick(input.size())] = static_cast<char>(rng());
+			break;
+		case 2:
+			input[pick(input.size())] = kInteresting[pick(kInteresting.size())];
+			break;
+		case 3:
+			input.insert(input.begin() + pick(input.size() + 1), kInteresting[pick(kInteresting.size())]);
+			break;
+		case 4:
+		{
+			auto at = pick(input.size());
+			input.erase(at, 1 + pick(std::min<size_t>(input.size() - at, 8)));
+		}
+		break;
+		case 5:
+		{
+			auto at = pick(input.size());
+			auto block = input.substr(at, 1 + pick(std::min<size_t>(input.size() - at, 16)));
+			input.insert(pick(input.size() + 1), block);
+		}
+		break;
+		case 6:
+		default:
+		{
+			auto& other = corpus[pick(corpus.size())];
+			input = input.substr(0, pick(input.size() + 1)) + other.substr(pick(other.size() + 1));
+		}
+		break;
+		}
+	}
+	if (input.size() > kMaxInput) {
+		input.resize(kMaxInput);
+	}
+	return input;
+}
+
+bool ReadInput(const fs::path& path, std::string& input)
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (!is) {
+		std::cerr << "Can't read " << path << '\n';
+		return false;
+	}
+	std::ostringstream text;
+	text << is.rdbuf();
+	input = text.str();
+	return true;
+}
+
+#ifndef WIN32
+/// <summary>
+/// afl-fuzz greps targets for this to run them in persistent mode
+/// </summary>
+const char* volatile kPersistentSignature = "##SIG_AFL_PERSISTENT##";
+const int kForkServerFd = 198;
+/// <summary>
+/// Inputs a forked child runs before the server forks a fresh one
+/// </summary>
+const int kPersistentRuns = 10000;
+
+/// <summary>
+/// Fork server of afl-fuzz: report a child per input and its exit status.
+/// A persistent child stops itself after each input, a stopped child is
+/// resumed for the next one instead of forking again.
+/// </summary>
+/// <returns>false when no fuzzer listens, returns only in children otherwise</returns>
+bool ServeForks()
+{
+	uint32_t hello = 0;
+	if (write(kForkServerFd + 1, &hello, sizeof(hello)) != sizeof(hello)) {
+		return false;
+	}
+
+	pid_t child = -1;
+	bool stopped = false;
+	for (;;)
+	{
+		uint32_t killed;
+		if (read(kForkServerFd, &killed, sizeof(killed)) != sizeof(killed)) {
+			_exit(EXIT_SUCCESS);
+		}
+		// NOTE: the fuzzer killed a stopped child on timeout
+		if (stopped && killed)
+		{
+			stopped = false;
+			waitpid(child, nullptr, 0);
+		}
+
+		if (stopped)
+		{
+			kill(child, SIGCONT);
+			stopped = false;
+		}
+		else
+		{
+			child = fork();
+			if (child < 0) {
+				_exit(EXIT_FAILURE);
+			}
+			if (!child)
+			{
+				close(kForkServerFd);
+				close(kForkServerFd + 1);
+				return true;
+			}
+		}
+
+		int status;
+		if (write(kForkServerFd + 1, &child, sizeof(child)) != sizeof(child) ||
+			waitpid(child, &status, WUNTRACED) < 0)
+		{
+			_exit(EXIT_FAILURE);
+		}
+		stopped = WIFSTOPPED(status);
+		if (write(kForkServerFd + 1, &status, sizeof(status)) != sizeof(status)) {
+			_exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/// <summary>
+/// Child of the fork server: run inputs from inputPath, or stdin when
+/// empty, reporting crashes and hangs the way afl-fuzz expects them
+/// </summary>
+int RunPersistent(Target& target, CoverageMap& map, const fs::path& inputPath, int runs)
+{
+	for (int i = 0; i < runs; ++i)
+	{
+		if (i) {
+			raise(SIGSTOP);
+		}
+
+		std::string input;
+		if (inputPath.empty())
+		{
+			lseek(STDIN_FILENO, 0, SEEK_SET);
+			char buffer[4096];
+			for (ssize_t n; (n = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0;) {
+				input.append(buffer, static_cast<size_t>(n));
+			}
+		}
+		else if (!ReadInput(inputPath, input)) {
+			return EXIT_FAILURE;
+		}
+
+		map.Clear();
+		switch (target.Run(input))
+		{
+		case Verdict::Crash:
+			std::abort();
+		case Verdict::Hang:
+			// NOTE: left to the fuzzer's timeout, which reports hangs
+			for (;;) {
+				pause();
+			}
+		case Verdict::Ok:
+		default:
+			break;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+#endif // WIN32
+
+int main(int argc, char** argv)
+{
+	argc--;
+	argv++;
+
+	uint64_t executions = 1'000'000;
+	uint64_t budget = 1'000'000;
+	uint64_t seed = 0;
+	fs::path outDir;
+	fs::path program;
+	std::vector<fs::path> seedPaths;
+
+	for (; argc > 0; argc--, argv++)
+	{
+		auto arg = std::string_view(argv[0]);
+		if (arg == "-n" && argc > 1)
+		{
+			executions = std::strtoull(argv[1], nullptr, 10);
+			argc--;
+			argv++;
+		}
+		else if (arg == "--budget" && argc > 1)
+		{
+			budget = std::max<uint64_t>(1, std::strtoull(argv[1], nullptr, 10));
+			argc--;
+			argv++;
+		}
+		else if (arg == "--seed" && argc > 1)
+		{
+			seed = std::strtoull(argv[1], nullptr, 10);
+			argc--;
+			argv++;
+		}
+		else if (arg == "-o" && argc > 1)
+		{
+			outDir = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (program.empty()) {
+			program = arg;
+		}
+		else {
+			seedPaths.emplace_back(arg);
+		}
+	}
+
+	if (program.empty())
+	{
+		std::cout << "Usage: lc3-fuzz [-n executions] [--budget instructions] [--seed n] [-o out_dir] program.obj [seed_file | seed_dir]..." << std::endl;
+		std::cout << "       afl-fuzz -i seeds -o findings -- lc3-fuzz program.obj [@@]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto image = std::make_unique<Memory>();
+	std::ifstream is(program, std::ios::in | std::ios::binary);
+	if (!is || !image->ReadObj(is))
+	{
+		std::cerr << "Can't read " << program << std::endl;
+		return EXIT_FAILURE;
+	}
+	VMProgram words{ image->Origin() };
+	for (size_t i = 0; i < image->LoadedSize(); ++i)
+	{
+		words.push_back(image->Fetch(static_cast<uint16_t>(image->Origin() + i)));
+	}
+
+	CoverageMap map;
+	if (!map.AttachShared()) {
+		return EXIT_FAILURE;
+	}
+	Target target(words, map, budget);
+
+#ifndef WIN32
+	if (map.Shared())
+	{
+		// NOTE: without a fork server listening the fuzzer runs us once per
+		// input
+		fs::path inputPath = seedPaths.empty() ? fs::path() : seedPaths.front();
+		return RunPersistent(target, map, inputPath, ServeForks() ? kPersistentRuns : 1);
+	}
+#endif // WIN32
+
+	std::vector<std::string> corpus;
+	for (auto& path : seedPaths)
+	{
+		std::error_code ec;
+		std::vector<fs::path> files;
+		if (fs::is_directory(path, ec))
+		{
+			for (auto& entry : fs::directory_iterator(path, ec))
+			{
+				if (entry.is_regular_file()) {
+					files.push_back(entry.path());
+				}
+			}
+			std::sort(files.begin(), files.end());
+		}
+		else {
+			files.push_back(path);
+		}
+		for (auto& file : files)
+		{
+			if (!ReadInput(file, corpus.emplace_back())) {
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	if (corpus.empty()) {
+		corpus.emplace_back("\n");
+	}
+
+	std::error_code ec;
+	if (!outDir.empty() && !fs::create_directories(outDir, ec) && ec)
+	{
+		std::cerr << "Can't create output directory " << outDir << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto save = [&outDir](std::string_view kind, size_t n, const std::string& input) {
+		if (outDir.empty()) {
+			return;
+		}
+		std::ofstream os(outDir / (std::string(kind) + '-' + std::to_string(n)), std::ios::out | std::ios::binary);
+		os << input;
+	};
+
+	// NOTE: seeds are kept whatever they cover, mutations only when they
+	// reach a new edge or a new hit count bucket
+	std::vector<uint8_t> virgin(CoverageMap::kSize, 0xFF);
+	std::set<uint16_t> crashSites;
+	std::set<uint16_t> hangSites;
+	for (auto& input : corpus)
+	{
+		target.Run(input);
+		map.Harvest(virgin);
+	}
+
+	std::mt19937_64 rng(seed);
+	auto start = std::chrono::steady_clock::now();
+	auto report = start;
+	uint64_t execution = 0;
+	auto status = [&](std::ostream& os) {
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		os << execution << " executions, " << static_cast<uint64_t>(elapsed > 0 ? execution / elapsed : 0)
+			<< " per second, " << corpus.size() << " inputs, "
+			<< CoverageMap::kSize - std::count(virgin.begin(), virgin.end(), uint8_t(0xFF))
+			<< " edges, " << crashSites.size() << " crashes, " << hangSites.size() << " hangs";
+	};
+
+	for (; execution < executions; ++execution)
+	{
+		auto input = Mutate(corpus, corpus[rng() % corpus.size()], rng);
+		auto verdict = target.Run(input);
+		bool fresh = map.Harvest(virgin);
+
+		// NOTE: one input kept per address the program stopped or spun at
+		if (verdict == Verdict::Crash && crashSites.insert(target.StopAddress()).second) {
+			save("crash", crashSites.size(), input);
+		}
+		else if (verdict == Verdict::Hang && hangSites.insert(target.StopAddress()).second) {
+			save("hang", hangSites.size(), input);
+		}
+		else if (verdict == Verdict::Ok && fresh)
+		{
+			corpus.push_back(input);
+			save("input", corpus.size(), input);
+		}
+
+		if (!(execution & 0xFFF) && std::chrono::steady_clock::now() - report > std::chrono::seconds(1))
+		{
+			report = std::chrono::steady_clock::now();
+			status(std::cerr);
+			std::cerr << '\n';
+		}
+	}
+
+	status(std::cout);
+	std::cout << std::endl;
+	// NOTE: scripts can tell a crash was found
+	return crashSites.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
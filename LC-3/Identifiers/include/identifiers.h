@@ -1,7 +1,10 @@
 #pragma once
 #pragma  warning (disable : 26812)
-#include <string_view>
+#include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
 #ifdef WIN32
 #undef OUT
@@ -115,7 +118,7 @@ inline const std::string_view Str(R regCode)
 };
 
 inline static const int kNotIndex{ -1 };
-template<int N> 
+template<std::size_t N>
 int64_t FindIndex(const std::array<std::string_view, N>& arr, const std::string_view& str)
 {
 	int64_t index{ kNotIndex };
@@ -155,10 +158,19 @@ enum class TR
 	IN = 0x23, /* get character from keyboard, echoed onto the terminal */
 	PUTSP = 0x24, /* output a byte string */
 
-	LAST = 0x25, 
-	HALT = LAST, /* halt the program */
+	HALT = 0x25, /* halt the program */
+
+	/* helpers run by the host, see HostTraps */
+	FIRST_HOST = 0x26,
+	MUL = FIRST_HOST, /* R0 = R0 * R1 */
+	DIV = 0x27, /* R0 = R0 / R1, R1 = R0 % R1, signed */
+	MEMCPY = 0x28, /* copy R2 words from R1 on to R0 on */
+	MEMSET = 0x29, /* set R2 words from R0 on to R1 */
+
+	LAST = 0x2A,
+	STRCMP = LAST, /* compare the strings at R0 and R1, R0 = -1, 0 or 1 */
 
-	NTR = 6
+	NTR = 11
 };
 
 static inline std::array<std::string_view, static_cast<size_t>(TR::NTR)> g_trap =
@@ -168,7 +180,12 @@ static inline std::array<std::string_view, static_cast<size_t>(TR::NTR)> g_trap
 	"PUTS",
 	"IN",
 	"PUTSP",
-	"HALT"
+	"HALT",
+	"MUL",
+	"DIV",
+	"MEMCPY",
+	"MEMSET",
+	"STRCMP"
 };
 
 inline const std::string_view Str(TR trap)
@@ -1,22 +1,67 @@
 ﻿
 #include "LC-3.h"
 
+#include <algorithm>
+#include <iomanip>
+
 #ifdef WIN32
 #undef OUT
 #undef IN
 #undef max
 #endif
 
-VirtualMachine::VirtualMachine(bool traceModeOn) :
+template<typename Policy>
+BasicVirtualMachine<Policy>::BasicVirtualMachine(bool traceModeOn) :
+	m_register{},
 	m_traceMode(traceModeOn),
 	m_isRunning(false),
-	m_register{}
+	m_instructionCount(0),
+	m_out(&std::cout),
+	m_replaying(false),
+	m_hostTraps(HostTraps::BuiltIn()),
+	m_parkIdle(false),
+	m_breakpointHit(false),
+	m_resumeTick(0),
+	m_watchHit(0)
 {
 	// NOTE: program for LC-3 starts here
 	m_(R::PC) = 0x3000;
+	m_mem.Input().SetClock(&m_instructionCount);
+	if constexpr (Policy::Sanitize::kEnabled) {
+		m_mem.Sanitize(true);
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Reset()
+{
+	m_register = {};
+	m_(R::PC) = 0x3000;
+	m_isRunning = false;
+	m_instructionCount = 0;
+	m_breakpoints.clear();
+	m_mem.Reset();
+	m_timeTravel.reset();
+	m_native.reset();
+	m_display.reset();
+	m_debugInfo.reset();
+	m_out = &std::cout;
+	m_replaying = false;
+	m_breakpointHit = false;
+	m_resumeTick = 0;
+	m_watchHit = 0;
+	m_idle = IdleLoop();
+	m_parkIdle = false;
+	m_metrics = VmMetrics();
+	m_hostTraps = HostTraps::BuiltIn();
+	if constexpr (Policy::Profile::kEnabled) {
+		m_profile = typename Policy::Profile();
+	}
+	m_coverage.Restart();
 }
 
-bool VirtualMachine::LoadObj(std::filesystem::path obj)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::LoadObj(std::filesystem::path obj)
 {
 	std::ifstream is(obj, std::ios::in | std::ios::binary);
 	if (!is) {
@@ -33,107 +78,748 @@ bool VirtualMachine::LoadObj(std::filesystem::path obj)
 	return m_mem.ReadObj(is);
 }
 
-void VirtualMachine::Run()
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::SaveSnapshot(PageStore& store, PageStore::Snapshot& snapshot)
+{
+	PatchBreakpoints(false);
+	auto saved = store.Save(m_mem, snapshot);
+	PatchBreakpoints(true);
+
+	snapshot.registers = m_register;
+	snapshot.instructions = m_instructionCount;
+	return saved;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::LoadSnapshot(PageStore& store, const PageStore::Snapshot& snapshot)
+{
+	if (!store.Load(snapshot, m_mem)) {
+		return false;
+	}
+	m_register = snapshot.registers;
+	m_instructionCount = snapshot.instructions;
+
+	SaveBreakpointOriginals();
+	PatchBreakpoints(true);
+	if (m_timeTravel)
+	{
+		m_timeTravel = std::make_unique<TimeTravel>(m_mem);
+		Checkpoint();
+	}
+	return true;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::LoadDebugInfo(const std::filesystem::path& path)
+{
+	auto debugInfo = std::make_unique<DebugInfo>();
+	if (!debugInfo->Open(path)) {
+		return false;
+	}
+	if (debugInfo->Image() != DebugInfo::ImageKey(m_mem))
+	{
+		std::cerr << "Debug info " << path << " was built for another image\n";
+		return false;
+	}
+	m_debugInfo = std::move(debugInfo);
+	return true;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Record(const std::filesystem::path& journal)
+{
+	return m_mem.Input().Record(journal);
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Replay(const std::filesystem::path& journal)
+{
+	return m_mem.Input().Replay(journal);
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::LoadNative(const std::filesystem::path& library)
+{
+	auto native = std::make_shared<NativeCode>();
+	if (!native->Load(library)) {
+		return false;
+	}
+	m_native = std::move(native);
+	return true;
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::EnableDisplay(std::ostream* terminal, unsigned fps)
+{
+	m_display = std::make_unique<Display>(m_mem, terminal, fps);
+	m_out = &m_display->Console();
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Run()
 {
 
-	if (m_traceMode)
+	if (Tracing())
 	{
 		std::cout << "LC-3 VM: is running..." << std::endl;
 	}
 
 	m_isRunning = true;
 
+	if (m_native && !m_native->Matches(m_mem))
+	{
+		std::cerr << "LC-3 VM: translated code doesn't match the loaded program, interpreting\n";
+		m_native.reset();
+	}
+
+	// NOTE: translated code knows nothing of tracing, profiling, coverage,
+	// the sanitizer, breakpoints and history
+	bool native = m_native && !Tracing() && !Policy::Profile::kEnabled &&
+		!Policy::Coverage::kEnabled && !Policy::Sanitize::kEnabled && !m_timeTravel && m_breakpoints.empty();
+	// NOTE: skipped iterations would be missing from traces, profiles and
+	// edge counts, and history replays must not depend on how long the host
+	// slept
+	m_parkIdle = !Tracing() && !Policy::Profile::kEnabled && !Policy::Coverage::kEnabled &&
+		!m_timeTravel;
+
 	while (m_isRunning)
 	{
-		auto instruction = Fetch();
-		//ValueType opcode = instruction >> ((sizeof(ValueType) - kInstructionSizeInBits));
-		ValueType opcode = instruction >> 12;
+		// NOTE: the interpreter runs up to the next translated block
+		if (native && m_native && m_native->IsEntry(m_(R::PC)))
+		{
+			auto retired = m_instructionCount;
+			RunNative();
+			if (m_instructionCount != retired) {
+				m_metrics.tier = EngineTier::Native;
+			}
+			if (!m_isRunning) {
+				break;
+			}
+		}
+		Step();
+	}
+	m_parkIdle = false;
+
+	if (m_display) {
+		m_display->Refresh(true);
+	}
+}
+
+template<typename Policy>
+VmMetrics BasicVirtualMachine<Policy>::Metrics() const
+{
+	auto metrics = m_metrics;
+	metrics.instructions = m_instructionCount;
+	metrics.deviceReads = m_mem.DeviceReads();
+	metrics.deviceWrites = m_mem.DeviceWrites();
+	metrics.inputBlockedNs = m_mem.Input().Blocked().count();
+	return metrics;
+}
 
+template<typename Policy>
+void BasicVirtualMachine<Policy>::RunNative()
+{
+	AotContext ctx{ m_register.data(), m_mem.Get(0), &m_instructionCount, this,
+		&NativeRead, &NativeWrite, &NativeTrap };
+	// NOTE: only stores of traps run from translated code are checked
+	ValueType addr;
+	size_t count;
+	m_mem.TakeBulkStore(addr, count);
+
+	auto status = m_native->Run(ctx);
+	// NOTE: translated code stores straight to RAM
+	m_mem.MarkRamStored();
+
+	switch (status)
+	{
+	case kAotHalted:
+		m_isRunning = false;
+		break;
+	case kAotCodeWritten:
+		// NOTE: the program patched its own code, translation is stale
+		m_native.reset();
+		break;
+	case kAotInterpret:
+	default:
+		break;
+	}
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::RegisterTrap(ValueType vector, HostTraps::Function fn)
+{
+	// NOTE: the table may be shared with other machines, it is copied
+	auto traps = std::make_shared<HostTraps>(*m_hostTraps);
+	if (!traps->Register(vector, std::move(fn))) {
+		return false;
+	}
+	m_hostTraps = std::move(traps);
+	return true;
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::UnregisterTrap(ValueType vector)
+{
+	auto traps = std::make_shared<HostTraps>(*m_hostTraps);
+	traps->Unregister(vector);
+	m_hostTraps = std::move(traps);
+}
+
+template<typename Policy>
+uint16_t BasicVirtualMachine<Policy>::NativeRead(void* vm, uint16_t addr)
+{
+	return static_cast<BasicVirtualMachine*>(vm)->m_mem.Read(addr);
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::NativeWrite(void* vm, uint16_t addr, uint16_t val)
+{
+	static_cast<BasicVirtualMachine*>(vm)->Store(addr, val);
+}
+
+template<typename Policy>
+int BasicVirtualMachine<Policy>::NativeTrap(void* vm, uint16_t instr)
+{
+	auto self = static_cast<BasicVirtualMachine*>(vm);
+	if (!self->ProcessTrapOperation(instr)) {
+		return kAotHalted;
+	}
+	// NOTE: host functions store in bulk, translated code can't see it
+	ValueType addr;
+	size_t count;
+	if (self->m_mem.TakeBulkStore(addr, count) && self->m_native->Covers(addr, count)) {
+		return kAotCodeWritten;
+	}
+	return kAotInterpret;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Step()
+{
+	if (!(m_instructionCount & kServiceMask) && !Service()) {
+		return m_isRunning = false;
+	}
+
+	auto pc = m_(R::PC);
+	auto instruction = Fetch();
+	m_isRunning = Execute(instruction);
+	if constexpr (Policy::Sanitize::kEnabled)
+	{
+		if (!m_mem.Reports().empty()) {
+			ReportViolations(pc);
+		}
+	}
+
+	++m_instructionCount;
+	return m_isRunning;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Execute(ValueType instruction)
+{
+	//ValueType opcode = instruction >> ((sizeof(ValueType) - kInstructionSizeInBits));
+	ValueType opcode = instruction >> 12;
+
+	if constexpr (Policy::Decode::kChecked)
+	{
 		if ((opcode > static_cast<ValueType>(OP::NOP)) ||
 			(opcode < static_cast<ValueType>(OP::FIRST))) {
 			std::cerr << "Unknown opcode!\n";
-			return;
+			return false;
 		}
-		auto ic = static_cast<OP>(opcode);
+	}
+	auto ic = static_cast<OP>(opcode);
+
+	if (Tracing())
+	{
+		Show(ic);
+	}
+	if constexpr (Policy::Profile::kEnabled) {
+		m_profile.Count(m_(R::PC) - 1, ic);
+	}
 
-		if (m_traceMode)
-		{
-			Show(ic);
-		}
 
+	switch (ic)
+	{
+	case OP::ADD:
+		return ProcessAddAndOperations(instruction);
+	case OP::AND:
+		return ProcessAddAndOperations(instruction, false);
+	case OP::NOT:
+		return ProcessNotOperation(instruction);
+	case OP::BR:
+		return ProcessBranchOperation(instruction);
+	case OP::JMP:
+		return ProcessJumpOperation(instruction);
+	case OP::JSR:
+		return ProcessJumpRegOperation(instruction);
+	case OP::LD:
+		return ProcessLoadOperation(instruction);
+	case OP::LDI:
+		return ProcessLoadIndirectOperation(instruction);
+	case OP::LDR:
+		return ProcessLoadRegisterOperation(instruction);
+	case OP::LEA:
+		return ProcessLoadEffectiveAddressOperation(instruction);
+	case OP::ST:
+		return ProcessStoreOperation(instruction);
+	case OP::STI:
+		return ProcessStoreIndirectOperation(instruction);
+	case OP::STR:
+		return ProcessStoreRegisterOperation(instruction);
+	case OP::TRAP:
+		return ProcessTrapOperation(instruction);
+	case OP::RTI:
+		return ProcessBreakpoint();
+	case OP::RES:
+	default:
+		return false;
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Show(OP opCode)
+{
+	std::cout << "OpCode: " << Str(opCode);
+	if (m_debugInfo) {
+		std::cout << '\t' << m_debugInfo->Describe(m_(R::PC) - 1);
+	}
+	std::cout << std::endl;
+}
 
-		switch (ic)
+template<typename Policy>
+void BasicVirtualMachine<Policy>::ReportViolations(ValueType pc)
+{
+	m_out->flush();
+	for (auto& report : m_mem.Reports())
+	{
+		std::cerr << "LC-3 VM: sanitizer: ";
+		switch (report.kind)
 		{
-		case OP::ADD:
-			m_isRunning = ProcessAddAndOperations(instruction);
-			break;
-		case OP::AND:
-			m_isRunning = ProcessAddAndOperations(instruction, false);
-			break;
-		case OP::NOT:
-			m_isRunning = ProcessNotOperation(instruction);
-			break;
-		case OP::BR:
-			m_isRunning = ProcessBranchOperation(instruction);
-			break;
-		case OP::JMP:
-			m_isRunning = ProcessJumpOperation(instruction);
-			break;
-		case OP::JSR:
-			m_isRunning = ProcessJumpRegOperation(instruction);
-			break;
-		case OP::LD:
-			m_isRunning = ProcessLoadOperation(instruction);
-			break;
-		case OP::LDI:
-			m_isRunning = ProcessLoadIndirectOperation(instruction);
-			break;
-		case OP::LDR:
-			m_isRunning = ProcessLoadRegisterOperation(instruction);
+		case Memory::Violation::UninitializedRead:
+			std::cerr << "load of uninitialized x";
 			break;
-		case OP::LEA:
-			m_isRunning = ProcessLoadEffectiveAddressOperation(instruction);
+		case Memory::Violation::CodeWrite:
+			std::cerr << "store to code at x";
 			break;
-		case OP::ST:
-			m_isRunning = ProcessStoreOperation(instruction);
-			break;
-		case OP::STI:
-			m_isRunning = ProcessStoreIndirectOperation(instruction);
-			break;
-		case OP::STR:
-			m_isRunning = ProcessStoreRegisterOperation(instruction);
-			break;
-		case OP::TRAP:
-			m_isRunning = ProcessTrapOperation(instruction);
-			break;
-		case OP::RES:
-		case OP::RTI:
-		default:
-			m_isRunning = false;
+		case Memory::Violation::DataExecution:
+			std::cerr << "execution of data at x";
 			break;
 		}
+		std::cerr << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << report.addr
+			<< " by the instruction at x" << std::setw(4) << pc << std::dec << std::nouppercase << std::setfill(' ');
+		if (m_debugInfo) {
+			std::cerr << '\t' << m_debugInfo->Describe(pc);
+		}
+		std::cerr << '\n';
+	}
+	m_mem.ClearReports();
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Service()
+{
+	if (m_timeTravel) {
+		Checkpoint();
+	}
+	if (m_display) {
+		m_display->Refresh();
+	}
+
+	if (m_mem.Input().Starved())
+	{
+		// NOTE: a guest polling KBSR would spin forever once replay input ends
+		std::cerr << "LC-3 VM: input exhausted after " << m_instructionCount << " instructions\n";
+		return false;
+	}
+	return true;
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Idle()
+{
+	if (!m_parkIdle || !m_idle.Spin(m_(R::PC) - 1, m_instructionCount, m_register)) {
+		return;
+	}
+
+	uint64_t due;
+	if (m_mem.Input().NextKeyTick(due))
+	{
+		// NOTE: Service runs at its tick as if the loop was interpreted, it
+		// stops guests waiting for input that will never come
+		due = std::min(due, (m_instructionCount | kServiceMask) + 1);
+	}
+	else
+	{
+		if (m_display) {
+			m_display->Refresh(true);
+		}
+		auto start = std::chrono::steady_clock::now();
+		m_mem.Input().WaitKey(kIdleTimeout);
+		auto slept = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		due = m_instructionCount + slept.count() * kIdleClock / 1'000'000;
+	}
+
+	// NOTE: land on the last iteration before due, the poll there still
+	// finds no key
+	if (due > m_instructionCount + 1)
+	{
+		auto period = m_idle.Period();
+		auto skipped = (due - 1 - m_instructionCount) / period * period;
+		m_instructionCount += skipped;
+		m_idle.Skip(skipped);
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::ShowFrame()
+{
+	// NOTE: a guest about to wait for the user must show what it asks for
+	uint64_t due;
+	if (m_display) {
+		m_display->Refresh(!m_mem.Input().NextKeyTick(due));
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::EnableTimeTravel()
+{
+	if (m_timeTravel) {
+		return;
+	}
+	m_timeTravel = std::make_unique<TimeTravel>(m_mem);
+	Checkpoint();
+	m_mem.Input().KeepHistory();
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Checkpoint()
+{
+	// NOTE: checkpoints hold original code, breakpoints are patched back
+	// in after every restore
+	PatchBreakpoints(false);
+	m_timeTravel->Checkpoint(m_instructionCount, m_register);
+	PatchBreakpoints(true);
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::Rewind(uint64_t tick)
+{
+	uint64_t restored;
+	if (!m_timeTravel || !m_timeTravel->Restore(tick, restored, m_register)) {
+		return false;
+	}
+	PatchBreakpoints(true);
+	m_instructionCount = restored;
+	m_mem.Input().Rewind(restored);
+	return true;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ReplayTo(uint64_t tick)
+{
+	// NOTE: the guest already produced this output once. The display
+	// console writes to guest memory, which has to be rebuilt as well.
+	static std::ostream muted(nullptr);
+	auto out = m_out;
+	if (!m_display) {
+		m_out = &muted;
+	}
+
+	m_replaying = true;
+	m_isRunning = true;
+	while (m_instructionCount < tick && Step())
+	{
+	}
+	m_replaying = false;
+
+	ValueType addr;
+	m_mem.TakeWatchHit(addr);
+	m_out = out;
+	return m_instructionCount == tick;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::GoTo(uint64_t tick)
+{
+	if (tick < m_instructionCount && !Rewind(tick)) {
+		return false;
+	}
+	return ReplayTo(tick);
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::StepBack(uint64_t n)
+{
+	return GoTo(m_instructionCount - std::min(n, m_instructionCount));
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ReverseContinue(const std::function<bool(ValueType)>& stop)
+{
+	if (!m_timeTravel) {
+		return false;
+	}
+
+	// NOTE: search segments between checkpoints from the latest one back,
+	// replaying each to find the last tick where stop holds
+	auto end = m_instructionCount;
+	while (end > m_timeTravel->OldestTick())
+	{
+		if (!Rewind(end - 1)) {
+			return false;
+		}
+		auto start = m_instructionCount;
+
+		auto hit = end;
+		while (m_instructionCount < end)
+		{
+			if (stop(m_(R::PC))) {
+				hit = m_instructionCount;
+			}
+			if (!ReplayTo(m_instructionCount + 1)) {
+				break;
+			}
+		}
 
+		if (hit != end) {
+			return GoTo(hit);
+		}
+		end = start;
 	}
+
+	GoTo(end);
+	return false;
+}
+
+template<typename Policy>
+const TimeTravel::WriteRecord* BasicVirtualMachine<Policy>::LastWriter(ValueType addr) const
+{
+	return m_timeTravel ? m_timeTravel->LastWriter(addr, m_instructionCount) : nullptr;
 }
 
-void VirtualMachine::Show(OP opCode)
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::ValueType BasicVirtualMachine<Policy>::Peek(ValueType addr)
 {
-	if (m_traceMode) {
-		std::cout << "OpCode: " << Str(opCode) << std::endl;
+	auto it = m_breakpoints.find(addr);
+	return it != m_breakpoints.end() ? it->second : *m_mem.Get(addr);
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Poke(ValueType addr, ValueType val)
+{
+	m_mem.Poke(addr, val);
+	KeepBreakpoint(addr);
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::InsertBreakpoint(ValueType addr)
+{
+	if (m_breakpoints.count(addr)) {
+		return true;
+	}
+	m_breakpoints[addr] = *m_mem.Get(addr);
+	m_mem.Patch(addr, kBreakpoint);
+	return true;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::RemoveBreakpoint(ValueType addr)
+{
+	auto it = m_breakpoints.find(addr);
+	if (it == m_breakpoints.end()) {
+		return false;
 	}
+	m_mem.Patch(addr, it->second);
+	m_breakpoints.erase(it);
+	return true;
 }
 
-R VirtualMachine::RegisterNameFromRegisterCode(ValueType code)
+template<typename Policy>
+void BasicVirtualMachine<Policy>::ClearBreakpoints()
 {
-	if (code > static_cast<ValueType>(R::LAST) ||
-		(code < static_cast<ValueType>(R::FIRST)))
+	PatchBreakpoints(false);
+	m_breakpoints.clear();
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::PatchBreakpoints(bool on)
+{
+	for (const auto& [addr, original] : m_breakpoints)
 	{
-		return R::NREG;
+		m_mem.Patch(addr, on ? kBreakpoint : original);
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::SaveBreakpointOriginals()
+{
+	for (auto& [addr, original] : m_breakpoints)
+	{
+		original = *m_mem.Get(addr);
+	}
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::KeepBreakpoint(ValueType addr)
+{
+	// NOTE: the store replaced the instruction under the breakpoint, the
+	// breakpoint now stops before the new one
+	auto it = m_breakpoints.find(addr);
+	if (it != m_breakpoints.end())
+	{
+		it->second = *m_mem.Get(addr);
+		m_mem.Patch(addr, kBreakpoint);
+	}
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::InsertWatchpoint(ValueType addr, ValueType len, Memory::Access access)
+{
+	for (ValueType i = 0; i < len; ++i)
+	{
+		m_mem.Watch(addr + i, access, true);
+	}
+	return true;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::RemoveWatchpoint(ValueType addr, ValueType len, Memory::Access access)
+{
+	for (ValueType i = 0; i < len; ++i)
+	{
+		m_mem.Watch(addr + i, access, false);
+	}
+	return true;
+}
+
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::StopReason BasicVirtualMachine<Policy>::Continue(const std::function<bool()>& interrupted)
+{
+	m_resumeTick = m_instructionCount;
+	m_breakpointHit = false;
+	m_isRunning = true;
+
+	while (Step())
+	{
+		if (m_mem.TakeWatchHit(m_watchHit)) {
+			return StopReason::Watchpoint;
+		}
+		if (!(m_instructionCount & 0xFFF) && interrupted()) {
+			return StopReason::Interrupted;
+		}
+	}
+	return m_breakpointHit ? StopReason::Breakpoint : StopReason::Halted;
+}
+
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::StopReason BasicVirtualMachine<Policy>::StepInstruction()
+{
+	m_resumeTick = m_instructionCount;
+	m_breakpointHit = false;
+	m_isRunning = true;
+
+	if (!Step()) {
+		return m_breakpointHit ? StopReason::Breakpoint : StopReason::Halted;
+	}
+	return m_mem.TakeWatchHit(m_watchHit) ? StopReason::Watchpoint : StopReason::Stepped;
+}
+
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::StopReason BasicVirtualMachine<Policy>::ReverseStep()
+{
+	if (m_instructionCount <= (m_timeTravel ? m_timeTravel->OldestTick() : m_instructionCount)) {
+		return StopReason::HistoryStart;
+	}
+	return StepBack() ? StopReason::Stepped : StopReason::HistoryStart;
+}
+
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::StopReason BasicVirtualMachine<Policy>::ReverseContinue()
+{
+	return ReverseContinue([this](ValueType pc) { return m_breakpoints.count(pc) != 0; }) ?
+		StopReason::Breakpoint : StopReason::HistoryStart;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessBreakpoint()
+{
+	auto pc = static_cast<ValueType>(m_(R::PC) - 1);
+	auto it = m_breakpoints.find(pc);
+	if (it == m_breakpoints.end()) {
+		// NOTE: genuine RTI, not supported
+		return false;
+	}
+
+	if (m_replaying || m_instructionCount == m_resumeTick) {
+		return Execute(it->second);
+	}
+
+	// NOTE: the instruction under the breakpoint has not been executed,
+	// Step() will count it as retired otherwise
+	m_(R::PC) = pc;
+	--m_instructionCount;
+	m_breakpointHit = true;
+	return false;
+}
+
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::DebugHostTrap(ValueType vector)
+{
+	auto pc = static_cast<ValueType>(m_(R::PC) - 1);
+	ValueType addr;
+	size_t count;
+	m_mem.TakeBulkStore(addr, count);
+
+	// NOTE: helpers copy and compare the original code, and what they
+	// store under a breakpoint becomes its new original
+	PatchBreakpoints(false);
+	auto ok = m_hostTraps->Call(vector, m_register, m_mem);
+	SaveBreakpointOriginals();
+	PatchBreakpoints(true);
+
+	// NOTE: history sees the bulk store as the words a guest loop would
+	// have stored
+	if (m_timeTravel && m_mem.TakeBulkStore(addr, count))
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto word = static_cast<ValueType>(addr + i);
+			m_timeTravel->LogWrite(m_instructionCount, pc, word, Peek(word));
+		}
+	}
+	return ok;
+}
+
+template<typename Policy>
+void BasicVirtualMachine<Policy>::Store(ValueType addr, ValueType val)
+{
+	if (m_timeTravel) {
+		m_timeTravel->LogWrite(m_instructionCount, m_(R::PC) - 1, addr, val);
+	}
+	m_idle.Touch();
+	m_mem.Write(addr, val);
+	if (!m_breakpoints.empty()) {
+		KeepBreakpoint(addr);
+	}
+}
+
+template<typename Policy>
+R BasicVirtualMachine<Policy>::RegisterNameFromRegisterCode(ValueType code)
+{
+	if constexpr (Policy::Decode::kChecked)
+	{
+		if (code > static_cast<ValueType>(R::LAST) ||
+			(code < static_cast<ValueType>(R::FIRST)))
+		{
+			return R::NREG;
+		}
 	}
 	return static_cast<R>(code);
 }
 
-inline TR VirtualMachine::TrapNameFromTrapCode(ValueType code)
+template<typename Policy>
+inline TR BasicVirtualMachine<Policy>::TrapNameFromTrapCode(ValueType code)
 {
 	if (code > static_cast<ValueType>(TR::LAST) ||
 		(code < static_cast<ValueType>(TR::FIRST)))
@@ -143,7 +829,8 @@ inline TR VirtualMachine::TrapNameFromTrapCode(ValueType code)
 	return static_cast<TR>(code);
 }
 
-bool VirtualMachine::ProcessAddAndOperations(ValueType instr, bool addOpFlag)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessAddAndOperations(ValueType instr, bool addOpFlag)
 {
 	// 2 modes
 
@@ -188,7 +875,8 @@ bool VirtualMachine::ProcessAddAndOperations(ValueType instr, bool addOpFlag)
 	return true;
 }
 
-bool VirtualMachine::ProcessNotOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessNotOperation(ValueType instr)
 {
 	//bits |15   12|11 9|8   6| 5 |4         0|
 	//data | 1001  | DR | SR  | 1 |   11111   |
@@ -209,39 +897,51 @@ bool VirtualMachine::ProcessNotOperation(ValueType instr)
 	return true;
 }
 
-bool VirtualMachine::ProcessBranchOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessBranchOperation(ValueType instr)
 {
 	// bits |15    12| 11 | 10 | 9 |8         0|
 	// data |  0000  | n  | z  | p | PCoffset9 |
 	const ValueType mPCoffset9 = 0x1FF;
 	//const ValueType NZP = instr >> 9;
 
-	if ((instr >> 9) & m_(R::COND)) {
+	if ((instr >> 9) & m_(R::COND))
+	{
 		m_(R::PC) += SignExtend(instr & mPCoffset9, 9);
+		// NOTE: nothing but an interrupt gets a guest out of a branch to
+		// itself, and there are none
+		if ((instr & mPCoffset9) == mPCoffset9) {
+			Idle();
+		}
 	}
+	// NOTE: the fall through is an edge as well
+	m_coverage.Edge(m_(R::PC));
 
 	return true;
 }
 
-bool VirtualMachine::ProcessJumpOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessJumpOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8     6| 5            0 |
 	//data | 1100  | 000 | BaseR |    000000      | JMP
 	//data | 1100  | 000 |  111  |    000000      | RET
 	const ValueType mBaseR = 0b111 << 6;
 
-	auto reg_val = (instr & mBaseR) >> 9;
+	auto reg_val = (instr & mBaseR) >> 6;
 	auto reg = RegisterNameFromRegisterCode(reg_val);
 	if (R::NREG == reg) {
 		return false;
 	}
 
 	m_(R::PC) = m_(reg);
+	m_coverage.Edge(m_(R::PC));
 
 	return true;
 }
 
-bool VirtualMachine::ProcessJumpRegOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessJumpRegOperation(ValueType instr)
 {
 	//bits |15   12| 11  | 10                  0 |
 	//data | 0100  | 1   |      PCoffset11       | JSR
@@ -253,24 +953,28 @@ bool VirtualMachine::ProcessJumpRegOperation(ValueType instr)
 	const ValueType mBaseR = 0b111 << 6;
 	const ValueType mPCoffset11 = 0x7FF;
 
-	auto reg_val = (instr & mBaseR) >> 9;
+	auto reg_val = (instr & mBaseR) >> 6;
 	auto reg = RegisterNameFromRegisterCode(reg_val);
 	if (R::NREG == reg) {
 		return false;
 	}
 
-	m_(R::R7) = m_(R::PC);
+	// NOTE: JSRR R7 jumps to the old R7 value
+	auto link = m_(R::PC);
 	if (instr & mBit11) {
 		m_(R::PC) += SignExtend(instr & mPCoffset11, 11);
 	}
 	else {
 		m_(R::PC) = m_(reg);
 	}
+	m_(R::R7) = link;
+	m_coverage.Edge(m_(R::PC));
 
 	return true;
 }
 
-bool VirtualMachine::ProcessLoadOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessLoadOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8              0 |
 	//data | 0010  |  DR |  PCoffset9      |
@@ -284,13 +988,14 @@ bool VirtualMachine::ProcessLoadOperation(ValueType instr)
 		return false;
 	}
 
-	m_(destReg) = m_mem.Read(m_(R::PC) + SignExtend(instr & mPCoffset9, 9));
+	m_(destReg) = Load(m_(R::PC) + SignExtend(instr & mPCoffset9, 9));
 
 	UpdateFlags(destReg);
 	return true;
 }
 
-VirtualMachine::ValueType VirtualMachine::SignExtend(VirtualMachine::ValueType x, int bit_count)
+template<typename Policy>
+typename BasicVirtualMachine<Policy>::ValueType BasicVirtualMachine<Policy>::SignExtend(ValueType x, int bit_count)
 {
 	if ((x >> (bit_count - 1)) & 1) {
 		x |= (0xFFFF << bit_count);
@@ -298,23 +1003,14 @@ VirtualMachine::ValueType VirtualMachine::SignExtend(VirtualMachine::ValueType x
 	return x;
 }
 
-void VirtualMachine::UpdateFlags(R r)
+template<typename Policy>
+void BasicVirtualMachine<Policy>::UpdateFlags(R r)
 {
-	if (m_(r) == 0)
-	{
-		m_(R::COND) = static_cast<ValueType>(FL::ZRO);
-	}
-	else if (m_(r) >> 15)
-	{
-		m_(R::COND) = static_cast<ValueType>(FL::NEG);
-	}
-	else
-	{
-		m_(R::COND) = static_cast<ValueType>(FL::POS);
-	}
+	m_(R::COND) = Policy::Flags::Of(m_(r));
 }
 
-bool VirtualMachine::ProcessLoadIndirectOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessLoadIndirectOperation(ValueType instr)
 {
 	// bits |15    12|11  9|8         0|
 	// data | OpCode |  DR | PCoffset9 |
@@ -328,13 +1024,14 @@ bool VirtualMachine::ProcessLoadIndirectOperation(ValueType instr)
 		return false;
 	}
 
-	m_(destReg) = m_mem.Read(m_mem.Read(m_(R::PC) + SignExtend(instr & mPCoffset9, 9)));
+	m_(destReg) = Load(Load(m_(R::PC) + SignExtend(instr & mPCoffset9, 9)));
 
 	UpdateFlags(destReg);
 	return true;
 }
 
-bool VirtualMachine::ProcessLoadRegisterOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessLoadRegisterOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8     6| 5            0 |
 	//data | 0110  |  DR | BaseR |    PCoffset6   |
@@ -348,19 +1045,20 @@ bool VirtualMachine::ProcessLoadRegisterOperation(ValueType instr)
 		return false;
 	}
 
-	auto reg_val = (instr & mBaseR) >> 9;
+	auto reg_val = (instr & mBaseR) >> 6;
 	auto reg = RegisterNameFromRegisterCode(reg_val);
 	if (R::NREG == reg) {
 		return false;
 	}
 
-	m_(destReg) = m_mem.Read(m_(reg) + SignExtend(instr & mPCoffset6, 6));
+	m_(destReg) = Load(m_(reg) + SignExtend(instr & mPCoffset6, 6));
 
 	UpdateFlags(destReg);
 	return true;
 }
 
-bool VirtualMachine::ProcessLoadEffectiveAddressOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessLoadEffectiveAddressOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8              0 |
 	//data | 1110  |  DR |  PCoffset9      |
@@ -379,7 +1077,8 @@ bool VirtualMachine::ProcessLoadEffectiveAddressOperation(ValueType instr)
 	return true;
 }
 
-bool VirtualMachine::ProcessStoreOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessStoreOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8              0 |
 	//data | 0011  |  SR |  PCoffset9      |
@@ -392,12 +1091,13 @@ bool VirtualMachine::ProcessStoreOperation(ValueType instr)
 		return false;
 	}
 
-	m_mem.Write(m_(R::PC) + SignExtend(instr & mPCoffset9, 9), m_(srcReg));
+	Store(m_(R::PC) + SignExtend(instr & mPCoffset9, 9), m_(srcReg));
 
 	return true;
 }
 
-bool VirtualMachine::ProcessStoreIndirectOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessStoreIndirectOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8              0 |
 	//data | 1011  |  SR |  PCoffset9      |
@@ -411,12 +1111,13 @@ bool VirtualMachine::ProcessStoreIndirectOperation(ValueType instr)
 		return false;
 	}
 
-	m_mem.Write(m_mem.Read(m_(R::PC) + SignExtend(instr & mPCoffset9, 9)), m_(srcReg));
+	Store(Load(m_(R::PC) + SignExtend(instr & mPCoffset9, 9)), m_(srcReg));
 
 	return true;
 }
 
-bool VirtualMachine::ProcessStoreRegisterOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessStoreRegisterOperation(ValueType instr)
 {
 	//bits |15   12|11  9|8     6| 5            0 |
 	//data | 0111  |  SR | BaseR |    PCoffset6   |
@@ -430,27 +1131,36 @@ bool VirtualMachine::ProcessStoreRegisterOperation(ValueType instr)
 		return false;
 	}
 
-	auto reg_val = (instr & mBaseR) >> 9;
+	auto reg_val = (instr & mBaseR) >> 6;
 	auto reg = RegisterNameFromRegisterCode(reg_val);
 	if (R::NREG == reg) {
 		return false;
 	}
 
-	m_mem.Write(m_(reg) + SignExtend(instr & mPCoffset6, 6), m_(srcReg));
+	Store(m_(reg) + SignExtend(instr & mPCoffset6, 6), m_(srcReg));
 
-	UpdateFlags(srcReg);
 	return true;
 }
 
-bool VirtualMachine::ProcessTrapOperation(ValueType instr)
+template<typename Policy>
+bool BasicVirtualMachine<Policy>::ProcessTrapOperation(ValueType instr)
 {
 	//bits |15   12|11  8|8              0 |
 	//data | 1111  |0000 |  trapvect8      |
-	const ValueType mtrapvect8 = 0x1FF;
+	const ValueType mtrapvect8 = 0xFF;
 
 	auto tr_val = (instr & mtrapvect8);
 	auto tr = TrapNameFromTrapCode(tr_val);
-	if (TR::NTR == tr) {
+	++m_metrics.traps[tr_val];
+	m_idle.Touch();
+	if (m_hostTraps->Has(tr_val))
+	{
+		if (m_breakpoints.empty() && !m_timeTravel) {
+			return m_hostTraps->Call(tr_val, m_register, m_mem);
+		}
+		return DebugHostTrap(tr_val);
+	}
+	if (TR::NTR == tr || tr >= TR::FIRST_HOST) {
 		return false;
 	}
 
@@ -458,35 +1168,34 @@ bool VirtualMachine::ProcessTrapOperation(ValueType instr)
 	{
 	case TR::IN:
 	{
-		std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-		std::cout << "Enter a character: ";
-		char c;
-		std::cin.getline(&c, sizeof(c));
-		std::cout << c;
-		std::cout.flush();
+		(*m_out) << "Enter a character: ";
+		ShowFrame();
+		char c = m_mem.Input().GetChar(true);
+		(*m_out) << c;
+		(*m_out).flush();
 		m_(R::R0) = c;
 		UpdateFlags(R::R0);
 	}
 	break;
 	case TR::GETC:
 	{
-		char c;
-		std::cin.getline(&c, sizeof(c));
+		ShowFrame();
+		char c = m_mem.Input().GetChar();
 		m_(R::R0) = c;
 		UpdateFlags(R::R0);
 	}
 	break;
 	case TR::OUT:
-		std::cout << static_cast<char>(m_(R::R0));
-		std::cout.flush();
+		(*m_out) << static_cast<char>(m_(R::R0));
+		(*m_out).flush();
 		break;
 	case TR::PUTS:
 	{
 		for (ValueType* _char = m_mem.Get(m_(R::R0)); *_char; ++_char)
 		{
-			std::cout.put(static_cast<char>(*_char));
+			(*m_out).put(static_cast<char>(*_char));
 		}
-		std::cout.flush();
+		(*m_out).flush();
 	}
 	break;
 	case TR::PUTSP:
@@ -494,20 +1203,28 @@ bool VirtualMachine::ProcessTrapOperation(ValueType instr)
 		for (ValueType* _char = m_mem.Get(m_(R::R0)); *_char; ++_char)
 		{
 			char ch1 = (*_char) & 0xFF;
-			std::cout.put(ch1);
+			(*m_out).put(ch1);
 			char ch2 = (*_char) >> 8;
 			if (ch2) {
-				std::cout.put(ch2);
+				(*m_out).put(ch2);
 			}
 		}
-		std::cout.flush();
+		(*m_out).flush();
 	}
 	break;
 	case TR::HALT:
 	default:
-		std::cout << "HALT\n";
+		(*m_out) << "HALT\n";
 		return false;
 	}
 
 	return true;
 }
+
+// NOTE: the configurations named in LC-3.h, the interpreter is compiled
+// once for each
+template class BasicVirtualMachine<policy::Debug>;
+template class BasicVirtualMachine<policy::Release>;
+template class BasicVirtualMachine<policy::Profile>;
+template class BasicVirtualMachine<policy::Fuzz>;
+template class BasicVirtualMachine<policy::Sanitize>;
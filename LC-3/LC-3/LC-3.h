@@ -1,25 +1,216 @@
 ﻿#pragma once
 
 #include <iostream>
+#include <chrono>
 #include <vector>
 #include <string_view>
 #include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
 
 #include "identifiers.h"
+#include "private/debuginfo.h"
+#include "private/display.h"
+#include "private/hosttraps.h"
+#include "private/idle.h"
 #include "private/memory.h"
+#include "private/metrics.h"
+#include "private/native.h"
+#include "private/pagestore.h"
+#include "private/policies.h"
+#include "private/timetravel.h"
 
 using VMProgram = std::vector<uint16_t>;
 
-class VirtualMachine
+/// <summary>
+/// LC-3 interpreter, Policy picks tracing, profiling, the memory mapped
+/// I/O model, the condition code computation, decode checks and coverage
+/// at compile time (see policies.h). Instantiated in LC-3.cpp for the configurations
+/// named below the class.
+/// </summary>
+template<typename Policy>
+class BasicVirtualMachine
 {
 public:
 	using ValueType = uint16_t;
 
-	VirtualMachine(bool traceModeOn = true);
+	enum class StopReason
+	{
+		Stepped,
+		Halted,
+		Breakpoint,
+		Watchpoint,
+		Interrupted,
+		HistoryStart /* reverse execution reached the oldest checkpoint */
+	};
+
+	/// <param name="traceModeOn">ignored by configurations built without tracing</param>
+	BasicVirtualMachine(bool traceModeOn = true);
 
 	bool LoadObj(std::filesystem::path obj);
+
+	/// <summary>
+	/// Source map lc3-asm wrote for the loaded image, refused when it was
+	/// built for another one. Traces show source lines from then on.
+	/// </summary>
+	bool LoadDebugInfo(const std::filesystem::path& path);
+	const DebugInfo* GetDebugInfo() const { return m_debugInfo.get(); };
+
+	/// <summary>
+	/// Back to the state right after construction, for reuse by
+	/// <see cref="MachinePool"/>. Memory pages the last run never touched
+	/// are not cleared again.
+	/// </summary>
+	void Reset();
+	/// <summary>
+	/// Load an image held in memory, origin first as in .obj files
+	/// </summary>
+	bool LoadProgram(const VMProgram& program) { return m_mem.Load(program.data(), program.size()); };
+
+	/// <summary>
+	/// Registers, instruction count and memory as a manifest of pages kept
+	/// in store, code under breakpoints is saved as it was
+	/// </summary>
+	bool SaveSnapshot(PageStore& store, PageStore::Snapshot& snapshot);
+	/// <summary>
+	/// Continue from a snapshot saved to store, time travel history starts
+	/// over from it
+	/// </summary>
+	bool LoadSnapshot(PageStore& store, const PageStore::Snapshot& snapshot);
 	void Run();
 
+	/// <summary>
+	/// Log every keyboard event of the session to the journal file
+	/// </summary>
+	bool Record(const std::filesystem::path& journal);
+
+	/// <summary>
+	/// Feed keyboard events from a recorded journal instead of the terminal
+	/// </summary>
+	bool Replay(const std::filesystem::path& journal);
+
+	/// <summary>
+	/// Let Run() execute the program translated by lc3-aot, it falls back to
+	/// interpreting when the library doesn't match the loaded image
+	/// </summary>
+	bool LoadNative(const std::filesystem::path& library);
+	void SetNative(std::shared_ptr<const NativeCode> native) { m_native = std::move(native); };
+
+	/// <summary>
+	/// Run fn for a TRAP vector the LC-3 OS leaves unused, see HostTraps.
+	/// Reset drops the functions registered.
+	/// </summary>
+	bool RegisterTrap(ValueType vector, HostTraps::Function fn);
+	void UnregisterTrap(ValueType vector);
+
+	/// <summary>
+	/// Run on fixed keyboard input, the program stops once it wants more
+	/// </summary>
+	void SetInput(std::string input) { m_mem.Input().Feed(std::move(input)); };
+
+	/// <summary>
+	/// Stream receiving the guest output, std::cout by default
+	/// </summary>
+	void SetOutput(std::ostream* out) { m_out = out; };
+
+	/// <summary>
+	/// Map a text framebuffer at Display::kBase and send the guest output
+	/// through its console. Frames go to terminal at most fps times a
+	/// second, or nowhere when it is nullptr.
+	/// </summary>
+	void EnableDisplay(std::ostream* terminal, unsigned fps = 30);
+	const Display* GetDisplay() const { return m_display.get(); };
+
+	uint64_t InstructionCount() const { return m_instructionCount; };
+
+	/// <summary>
+	/// Counters of the machine since construction or Reset, for monitoring.
+	/// Tier is Native when translated code ran any part of the program.
+	/// </summary>
+	VmMetrics Metrics() const;
+
+	/// <summary>
+	/// Counters of the profiling policy, empty when not profiling
+	/// </summary>
+	const typename Policy::Profile& Profile() const { return m_profile; };
+
+	/// <summary>
+	/// Edge recorder of the coverage policy, its map is set by the owner
+	/// </summary>
+	typename Policy::Coverage& Coverage() { return m_coverage; };
+
+	/// <summary>
+	/// The program asked for more keys than SetInput gave it
+	/// </summary>
+	bool InputExhausted() { return m_mem.Input().Starved(); };
+
+	/// <summary>
+	/// Execute a single instruction
+	/// </summary>
+	/// <returns>false when the program has stopped</returns>
+	bool Step();
+
+	/// <summary>
+	/// Start taking checkpoints and logging stores, required by the reverse
+	/// execution calls below
+	/// </summary>
+	void EnableTimeTravel();
+
+	/// <summary>
+	/// Bring the machine to the state right before instruction number tick,
+	/// earlier states are reconstructed from checkpoints
+	/// </summary>
+	bool GoTo(uint64_t tick);
+	bool StepBack(uint64_t n = 1);
+
+	/// <summary>
+	/// Go back to the latest earlier moment when stop(PC) holds, or to the
+	/// oldest known state when it never does
+	/// </summary>
+	/// <returns>true if stop was hit</returns>
+	bool ReverseContinue(const std::function<bool(ValueType)>& stop);
+
+	/// <summary>
+	/// Latest store to addr before the current instruction
+	/// </summary>
+	const TimeTravel::WriteRecord* LastWriter(ValueType addr) const;
+
+	ValueType GetRegister(R r) { return m_(r); };
+	void SetRegister(R r, ValueType val) { m_(r) = val; };
+
+	/// <summary>
+	/// Debugger view of memory: no device side effects, breakpoints hidden
+	/// </summary>
+	ValueType Peek(ValueType addr);
+	void Poke(ValueType addr, ValueType val);
+
+	/// <summary>
+	/// Software breakpoints patch the code with an RTI instruction, so
+	/// execution only pays for them when one is actually reached
+	/// </summary>
+	bool InsertBreakpoint(ValueType addr);
+	bool RemoveBreakpoint(ValueType addr);
+	void ClearBreakpoints();
+	bool InsertWatchpoint(ValueType addr, ValueType len, Memory::Access access);
+	bool RemoveWatchpoint(ValueType addr, ValueType len, Memory::Access access);
+	ValueType WatchpointAddress() const { return m_watchHit; };
+	/// <summary>
+	/// Access that hit the last watchpoint, a load or a store
+	/// </summary>
+	Memory::Access WatchpointAccess() const { return m_mem.WatchHitAccess(); };
+
+	/// <summary>
+	/// Run until the program halts, a breakpoint or a watchpoint is hit,
+	/// or interrupted() returns true. A breakpoint at the current PC is
+	/// stepped over.
+	/// </summary>
+	StopReason Continue(const std::function<bool()>& interrupted);
+	StopReason StepInstruction();
+	StopReason ReverseStep();
+	StopReason ReverseContinue();
+
 private:
 	/// <summary>
 	/// Register values storage
@@ -27,10 +218,102 @@ private:
 	std::array<ValueType, static_cast<ValueType>(R::NREG)> m_register;
 	bool m_traceMode;
 	bool m_isRunning;
+	/// <summary>
+	/// Instructions retired since start, the clock of the input journal
+	/// </summary>
+	uint64_t m_instructionCount;
 	Memory m_mem;
+	std::unique_ptr<TimeTravel> m_timeTravel;
+	std::shared_ptr<const NativeCode> m_native;
+	/// <summary>
+	/// Guest output, muted while replaying history
+	/// </summary>
+	std::ostream* m_out;
+	std::unique_ptr<Display> m_display;
+	std::unique_ptr<DebugInfo> m_debugInfo;
+	bool m_replaying;
+	typename Policy::Profile m_profile;
+	typename Policy::Coverage m_coverage;
+	/// <summary>
+	/// Traps and tier, the other counters are kept by memory and keyboard
+	/// </summary>
+	VmMetrics m_metrics;
+	/// <summary>
+	/// Back to the built-in table on Reset, a pooled machine must not carry
+	/// the functions of its previous user
+	/// </summary>
+	std::shared_ptr<const HostTraps> m_hostTraps;
+
+	/// <summary>
+	/// Spin loop detection, only Run() parks idle guests
+	/// </summary>
+	IdleLoop m_idle;
+	bool m_parkIdle;
+	/// <summary>
+	/// Longest sleep of an idle guest waiting for the terminal, and the rate
+	/// its instruction count advances at meanwhile
+	/// </summary>
+	inline static const std::chrono::milliseconds kIdleTimeout{ 10 };
+	inline static const uint64_t kIdleClock = 100'000'000;
+
+	/// <summary>
+	/// Breakpoint addresses and the original instructions under them
+	/// </summary>
+	std::map<ValueType, ValueType> m_breakpoints;
+	bool m_breakpointHit;
+	uint64_t m_resumeTick;
+	ValueType m_watchHit;
+	inline static const ValueType kBreakpoint = static_cast<ValueType>(OP::RTI) << 12;
+
+	/// <summary>
+	/// Housekeeping is done once per this many instructions
+	/// </summary>
+	inline static const uint64_t kServiceMask = 0xFFFF;
 
 private:
+	bool Tracing() const
+	{
+		if constexpr (Policy::Trace::kAvailable) {
+			return m_traceMode;
+		}
+		return false;
+	};
 	void Show(OP opCode);
+	bool Service();
+	/// <summary>
+	/// Print the sanitizer findings of the instruction at pc, the run goes on
+	/// </summary>
+	void ReportViolations(ValueType pc);
+	/// <summary>
+	/// Draw the display before reading the keyboard, right away when the
+	/// input comes from the terminal
+	/// </summary>
+	void ShowFrame();
+	/// <summary>
+	/// The current instruction polled KBSR in vain or branched to itself:
+	/// sleep and fast-forward when the guest is known to spin
+	/// </summary>
+	void Idle();
+	/// <summary>
+	/// Run translated code until it hands back to the interpreter
+	/// </summary>
+	void RunNative();
+	static uint16_t NativeRead(void* vm, uint16_t addr);
+	static void NativeWrite(void* vm, uint16_t addr, uint16_t val);
+	static int NativeTrap(void* vm, uint16_t instr);
+	void Checkpoint();
+	bool Rewind(uint64_t tick);
+	void PatchBreakpoints(bool on);
+	/// <summary>
+	/// Take the words under the breakpoints as their originals, for
+	/// breakpoints unpatched while memory changed
+	/// </summary>
+	void SaveBreakpointOriginals();
+	/// <summary>
+	/// Keep the breakpoint at addr, if any, over a word just stored there
+	/// </summary>
+	void KeepBreakpoint(ValueType addr);
+	bool Execute(ValueType instr);
 
 	void Skip(ValueType n);
 
@@ -47,6 +330,12 @@ private:
 	bool ProcessStoreIndirectOperation(ValueType instr);
 	bool ProcessStoreRegisterOperation(ValueType instr);
 	bool ProcessTrapOperation(ValueType instr);
+	/// <summary>
+	/// Host function call with breakpoints set or history on, which have to
+	/// see its stores
+	/// </summary>
+	bool DebugHostTrap(ValueType vector);
+	bool ProcessBreakpoint();
 	ValueType SignExtend(ValueType x, int bit_count);
 
 	/// <summary>
@@ -57,8 +346,33 @@ private:
 
 private:
 	constexpr ValueType& m_(R regName) { return m_register[static_cast<ValueType>(regName)]; }
-	ValueType Fetch() { return m_mem.Read(m_(R::PC)++); };
+	ValueType Fetch()
+	{
+		if constexpr (Policy::Sanitize::kEnabled) {
+			return m_mem.Execute(m_(R::PC)++);
+		}
+		return m_mem.Fetch(m_(R::PC)++);
+	};
+	ValueType Load(ValueType addr)
+	{
+		auto val = Policy::Mmio::Read(m_mem, addr);
+		if (addr == Memory::kKeyboardStatus && !(val >> 15)) {
+			Idle();
+		}
+		return val;
+	};
+	void Store(ValueType addr, ValueType val);
+	bool ReplayTo(uint64_t tick);
 	inline R RegisterNameFromRegisterCode(ValueType code);
 	inline TR TrapNameFromTrapCode(ValueType code);
 
 };
+
+/// <summary>
+/// Reference configuration with every check, used by debuggers
+/// </summary>
+using VirtualMachine = BasicVirtualMachine<policy::Debug>;
+using ReleaseVirtualMachine = BasicVirtualMachine<policy::Release>;
+using ProfilingVirtualMachine = BasicVirtualMachine<policy::Profile>;
+using FuzzingVirtualMachine = BasicVirtualMachine<policy::Fuzz>;
+using SanitizingVirtualMachine = BasicVirtualMachine<policy::Sanitize>;
@@ -1,6 +1,8 @@
+﻿#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <bit>
+#include <string_view>
 
 #include <signal.h> // SIGINT
 #ifdef WIN32
@@ -27,6 +29,37 @@ void restore_input_buffering()
 	SetConsoleMode(hStdin, fdwOldMode);
 }
 
+void handle_interrupt(int signal)
+{
+	restore_input_buffering();
+	printf("\n");
+	exit(-2);
+}
+#else
+#include <termios.h>
+#include <unistd.h>
+
+struct termios original_tio;
+bool tio_saved = false;
+
+void disable_input_buffering()
+{
+	if (tcgetattr(STDIN_FILENO, &original_tio) != 0) {
+		return; // NOTE: not a terminal, input is already unbuffered
+	}
+	tio_saved = true;
+	struct termios new_tio = original_tio;
+	new_tio.c_lflag &= ~(ICANON | ECHO);
+	tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
+}
+
+void restore_input_buffering()
+{
+	if (tio_saved) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
+	}
+}
+
 void handle_interrupt(int signal)
 {
 	restore_input_buffering();
@@ -36,6 +69,76 @@ void handle_interrupt(int signal)
 #endif
 
 #include "LC-3.h"
+#include "gdbstub.h"
+#include "smp.h"
+
+/// <summary>
+/// Text display settings, off when fps is 0
+/// </summary>
+struct Video
+{
+	unsigned fps{ 0 };
+	/// <summary>
+	/// Headless displays draw nothing, the last screen is saved here
+	/// </summary>
+	std::string_view screen;
+};
+
+/// <summary>
+/// Input source, program and its debug info, translated code and display
+/// for any machine configuration
+/// </summary>
+template<typename Machine>
+bool Prepare(Machine& lc3, std::string_view record, std::string_view replay,
+	std::string_view obj, std::string_view native, const Video& video)
+{
+	if (video.fps) {
+		lc3.EnableDisplay(video.screen.empty() ? &std::cout : nullptr, video.fps);
+	}
+	if (!record.empty() && !lc3.Record(record)) {
+		return false;
+	}
+	if (!replay.empty() && !lc3.Replay(replay)) {
+		return false;
+	}
+
+	// NOTE: a partial image would run garbage
+	if (!lc3.LoadObj(obj)) {
+		return false;
+	}
+
+	// NOTE: the source map lc3-asm writes next to the program, if any
+	auto debugInfo = std::filesystem::path(obj).replace_extension(".dbg");
+	if (std::filesystem::exists(debugInfo)) {
+		lc3.LoadDebugInfo(debugInfo);
+	}
+	return native.empty() || lc3.LoadNative(native);
+}
+
+template<typename Machine>
+void SaveScreen(const Machine& lc3, const Video& video)
+{
+	if (!video.fps || video.screen.empty()) {
+		return;
+	}
+	std::ofstream os{ std::string(video.screen) };
+	if (!os) {
+		std::cerr << "Can't write screen to " << video.screen << '\n';
+		return;
+	}
+	os << lc3.GetDisplay()->Text();
+}
+
+template<typename Machine>
+void SaveMetrics(const Machine& lc3, std::string_view path)
+{
+	if (path.empty()) {
+		return;
+	}
+	RuntimeMetrics metrics;
+	metrics.Add(lc3.Metrics());
+	metrics.WritePrometheus(path);
+}
 
 int main(int argc, char** argv)
 {
@@ -46,17 +149,165 @@ int main(int argc, char** argv)
 	argc--;
 	argv++;
 
-	if (argc < 1)
+	std::string_view record;
+	std::string_view replay;
+	std::string_view native;
+	std::string_view obj;
+	std::string_view metrics;
+	int gdbPort = 0;
+	size_t cores = 1;
+	bool profile = false;
+	bool sanitize = false;
+	Video video;
+	unsigned fps = 30;
+
+	for (; argc > 0; argc--, argv++)
 	{
-		std::cout << "Only one argument is supported - the filename (object file) e.g. \"my_src.obj\"" << std::endl;
+		auto arg = std::string_view(argv[0]);
+		if ((arg == "--record" || arg == "--replay") && argc > 1)
+		{
+			(arg == "--record" ? record : replay) = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--native" && argc > 1)
+		{
+			native = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--gdb" && argc > 1)
+		{
+			gdbPort = std::atoi(argv[1]);
+			argc--;
+			argv++;
+		}
+		else if (arg == "--cores" && argc > 1)
+		{
+			cores = static_cast<size_t>(std::max(std::atoi(argv[1]), 1));
+			argc--;
+			argv++;
+		}
+		else if (arg == "--metrics" && argc > 1)
+		{
+			metrics = argv[1];
+			argc--;
+			argv++;
+		}
+		else if (arg == "--profile") {
+			profile = true;
+		}
+		else if (arg == "--sanitize") {
+			sanitize = true;
+		}
+		else if (arg == "--video") {
+			video.fps = fps;
+		}
+		else if (arg == "--fps" && argc > 1)
+		{
+			fps = std::max(std::atoi(argv[1]), 1);
+			video.fps = video.fps ? fps : 0;
+			argc--;
+			argv++;
+		}
+		else if (arg == "--headless" && argc > 1)
+		{
+			video.screen = argv[1];
+			argc--;
+			argv++;
+		}
+		else {
+			obj = arg;
+		}
+	}
+
+	if (!video.screen.empty()) {
+		video.fps = fps;
+	}
+
+	if (obj.empty())
+	{
+		std::cout << "Usage: LC-3 [--record journal | --replay journal] [--native my_src.so] [--video [--fps n] | --headless screen.txt] [--gdb port | --profile | --sanitize | --cores n] [--metrics file.prom] my_src.obj" << std::endl;
 		//return EXIT_FAILURE;
+		obj = "2048.obj";
 	}
 
 
-	VirtualMachine lc3(false);
-	//lc3.LoadObj(argv[1]);
-	lc3.LoadObj("2048.obj");
-	lc3.Run();
+	if (cores > 1)
+	{
+		// NOTE: SMP cores have no journal, translated code, debugger,
+		// profiler, sanitizer, display or metrics
+		if (!record.empty() || !replay.empty() || !native.empty() || gdbPort || profile || sanitize ||
+			video.fps || !metrics.empty())
+		{
+			std::cerr << "--cores can't be combined with --record, --replay, --native, --gdb, --profile, --sanitize, --video, --headless or --metrics\n";
+			return EXIT_FAILURE;
+		}
+
+		auto image = std::make_unique<Memory>();
+		std::ifstream is(std::string(obj), std::ios::in | std::ios::binary);
+		if (!is || !image->ReadObj(is))
+		{
+			std::cerr << "Can't load " << obj << '\n';
+			return EXIT_FAILURE;
+		}
+		SmpMachine smp(*image, cores);
+		smp.Run();
+		restore_input_buffering();
+		return EXIT_SUCCESS;
+	}
+
+	// NOTE: only debugging sessions pay for watchpoint and decode checks
+	if (gdbPort)
+	{
+		VirtualMachine lc3(false);
+		if (!Prepare(lc3, record, replay, obj, native, video)) {
+			return EXIT_FAILURE;
+		}
+
+		// NOTE: debugging sessions can always step and continue backwards
+		lc3.EnableTimeTravel();
+		GdbStub stub(lc3);
+		if (!stub.Listen(static_cast<uint16_t>(gdbPort))) {
+			return EXIT_FAILURE;
+		}
+		if (stub.Serve()) {
+			lc3.Run();
+		}
+		SaveScreen(lc3, video);
+		SaveMetrics(lc3, metrics);
+	}
+	else if (profile)
+	{
+		ProfilingVirtualMachine lc3(false);
+		if (!Prepare(lc3, record, replay, obj, native, video)) {
+			return EXIT_FAILURE;
+		}
+		lc3.Run();
+		lc3.Profile().Report(std::cerr, lc3.GetDebugInfo());
+		SaveScreen(lc3, video);
+		SaveMetrics(lc3, metrics);
+	}
+	else if (sanitize)
+	{
+		SanitizingVirtualMachine lc3(false);
+		if (!Prepare(lc3, record, replay, obj, native, video)) {
+			return EXIT_FAILURE;
+		}
+		lc3.Run();
+		SaveScreen(lc3, video);
+		SaveMetrics(lc3, metrics);
+	}
+	else
+	{
+		ReleaseVirtualMachine lc3(false);
+		if (!Prepare(lc3, record, replay, obj, native, video)) {
+			return EXIT_FAILURE;
+		}
+		lc3.Run();
+		SaveScreen(lc3, video);
+		SaveMetrics(lc3, metrics);
+	}
 
 	restore_input_buffering();
 
@@ -0,0 +1,301 @@
+#include "aot.h"
+
+#include <iomanip>
+
+#include "aotabi.h"
+#include "masks.h"
+
+namespace
+{
+	struct Hex
+	{
+		uint16_t value;
+	};
+
+	std::ostream& operator<<(std::ostream& os, Hex hex)
+	{
+		auto flags = os.flags();
+		os << "0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << hex.value;
+		os.flags(flags);
+		return os;
+	}
+
+	struct Label
+	{
+		uint16_t addr;
+	};
+
+	std::ostream& operator<<(std::ostream& os, Label label)
+	{
+		auto flags = os.flags();
+		os << "b_" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << label.addr;
+		os.flags(flags);
+		return os;
+	}
+
+	struct Reg
+	{
+		uint16_t index;
+	};
+
+	std::ostream& operator<<(std::ostream& os, Reg reg)
+	{
+		return os << 'r' << reg.index;
+	}
+
+	/// <summary>
+	/// Exported array of a bit per address, set where has(addr)
+	/// </summary>
+	template<typename Predicate>
+	void EmitBitmap(const char* name, Predicate has, std::ostream& os)
+	{
+		os << "LC3_AOT_EXPORT const uint8_t " << name << "[" << Memory::kMemorySize / 8 << "] = {";
+		for (size_t byte = 0; byte < Memory::kMemorySize / 8; ++byte)
+		{
+			unsigned bits = 0;
+			for (unsigned bit = 0; bit < 8; ++bit)
+			{
+				bits |= has(static_cast<Memory::ValueType>(byte * 8 + bit)) << bit;
+			}
+			os << (byte ? "," : "") << (byte % 32 ? "" : "\n\t") << bits;
+		}
+		os << "\n};\n";
+	}
+
+	const char* kPrologue = R"(
+namespace
+{
+	inline bool IsCode(uint16_t addr) { return (lc3_aot_code[addr >> 3] >> (addr & 7)) & 1; }
+	inline uint16_t Flags(uint16_t v) { return v == 0 ? 2 : (v >> 15 ? 4 : 1); }
+}
+
+LC3_AOT_EXPORT int lc3_aot_run(AotContext* ctx)
+{
+	uint16_t r0 = ctx->reg[0], r1 = ctx->reg[1], r2 = ctx->reg[2], r3 = ctx->reg[3];
+	uint16_t r4 = ctx->reg[4], r5 = ctx->reg[5], r6 = ctx->reg[6], r7 = ctx->reg[7];
+	uint16_t pc = ctx->reg[8];
+	uint16_t cond = ctx->reg[9];
+	uint16_t* const mem = ctx->mem;
+	uint64_t n = *ctx->count;
+	// NOTE: translated code always leaves before the next housekeeping tick,
+	// the one after n when n is a tick itself
+	const uint64_t tick = (n | 0xFFFF) + 1;
+	int status = kAotInterpret;
+	uint16_t a = 0;
+
+#define SYNC() (ctx->reg[0] = r0, ctx->reg[1] = r1, ctx->reg[2] = r2, ctx->reg[3] = r3, \
+	ctx->reg[4] = r4, ctx->reg[5] = r5, ctx->reg[6] = r6, ctx->reg[7] = r7, \
+	ctx->reg[9] = cond, *ctx->count = n)
+#define LOAD(addr) ((a = static_cast<uint16_t>(addr)) >= kAotDeviceBase ? (SYNC(), ctx->read(ctx->vm, a)) : mem[a])
+#define STORE(addr, val, next) \
+	if ((a = static_cast<uint16_t>(addr)) >= kAotDeviceBase) { SYNC(); ctx->write(ctx->vm, a, val); } \
+	else { mem[a] = val; } \
+	if (IsCode(a)) { ++n; pc = next; status = kAotCodeWritten; goto leave; }
+#define TRAP(instr, next) \
+	ctx->reg[8] = next; SYNC(); \
+	status = ctx->trap(ctx->vm, instr); \
+	r0 = ctx->reg[0]; r1 = ctx->reg[1]; r2 = ctx->reg[2]; r3 = ctx->reg[3]; \
+	r4 = ctx->reg[4]; r5 = ctx->reg[5]; r6 = ctx->reg[6]; r7 = ctx->reg[7]; cond = ctx->reg[9]; \
+	if (status != kAotInterpret) { ++n; pc = next; goto leave; }
+
+	goto dispatch;
+)";
+
+	const char* kEpilogue = R"(
+leave:
+	SYNC();
+	ctx->reg[8] = pc;
+	return status;
+
+#undef SYNC
+#undef LOAD
+#undef STORE
+#undef TRAP
+}
+)";
+}
+
+void AotTranslator::Translate(const Memory& mem, ValueType entry, std::ostream& os)
+{
+	m_cfg.Build(mem, entry);
+
+	auto origin = mem.Origin();
+	auto size = mem.LoadedSize();
+
+	os << "// Translated by lc3-aot from " << size << " words at " << Hex{ origin } << ", do not edit\n";
+	os << "#include \"aotabi.h\"\n\n";
+	os << "LC3_AOT_EXPORT const uint32_t lc3_aot_abi = " << kAotAbiVersion << ";\n";
+	os << "LC3_AOT_EXPORT const uint16_t lc3_aot_origin = " << Hex{ origin } << ";\n";
+	os << "LC3_AOT_EXPORT const uint32_t lc3_aot_size = " << size << ";\n";
+	os << "LC3_AOT_EXPORT const uint16_t lc3_aot_image[" << std::max<size_t>(size, 1) << "] = {";
+	for (size_t i = 0; i < size; ++i)
+	{
+		os << (i % 8 ? " " : "\n\t") << Hex{ mem.Fetch(static_cast<ValueType>(origin + i)) } << ',';
+	}
+	os << "\n};\n\n";
+
+	// NOTE: stores are checked against the translated code, a hit hands the
+	// program back to the interpreter for good
+	EmitBitmap("lc3_aot_code", [this](ValueType addr) { return m_cfg.IsCode(addr); }, os);
+	// NOTE: the VM interprets up to the next block start, entering the code
+	// anywhere else would return at once
+	EmitBitmap("lc3_aot_entry", [this](ValueType addr) { return m_cfg.BlockAt(addr) != ControlFlowGraph::kExternal; }, os);
+
+	os << kPrologue;
+	for (const auto& block : m_cfg.Blocks())
+	{
+		EmitBlock(block, os);
+	}
+
+	os << "\ndispatch:\n\tswitch (pc)\n\t{\n";
+	for (const auto& block : m_cfg.Blocks())
+	{
+		os << "\tcase " << Hex{ block.start } << ": goto " << Label{ block.start } << ";\n";
+	}
+	os << "\tdefault: goto leave;\n\t}\n";
+	os << kEpilogue;
+}
+
+void AotTranslator::EmitBlock(const ControlFlowGraph::BasicBlock& block, std::ostream& os) const
+{
+	os << '\n' << Label{ block.start } << ":\n";
+	// NOTE: the VM does housekeeping before every 64K-th instruction, a
+	// block containing one is interpreted instead
+	os << "\tif (n + " << block.size << " > tick) { pc = " << Hex{ block.start } << "; goto leave; }\n";
+
+	for (ValueType i = 0; i < block.size; ++i)
+	{
+		ValueType addr = block.start + i;
+		EmitInstruction(addr, m_cfg.Instruction(addr), os);
+	}
+
+	// NOTE: blocks ending without a control transfer run into the next one
+	ValueType last = block.start + block.size - 1;
+	auto instr = m_cfg.Instruction(last);
+	bool transfers = false;
+	switch (masks::OpCode(instr))
+	{
+	case OP::BR:
+		transfers = masks::NZP(instr) == 0b111;
+		break;
+	case OP::JMP:
+	case OP::RTI:
+	case OP::RES:
+		transfers = true;
+		break;
+	case OP::JSR:
+		transfers = !masks::IsJsrOffset(instr);
+		break;
+	default:
+		break;
+	}
+	if (!transfers)
+	{
+		os << '\t';
+		EmitGoto(last + 1, os);
+	}
+}
+
+void AotTranslator::EmitGoto(ValueType target, std::ostream& os) const
+{
+	if (m_cfg.BlockAt(target) != ControlFlowGraph::kExternal) {
+		os << "goto " << Label{ target } << ";\n";
+	}
+	else {
+		os << "{ pc = " << Hex{ target } << "; goto leave; }\n";
+	}
+}
+
+void AotTranslator::EmitInstruction(ValueType addr, ValueType instr, std::ostream& os) const
+{
+	ValueType next = addr + 1;
+	auto op = masks::OpCode(instr);
+	Reg dr{ masks::DR(instr) };
+	Reg sr1{ masks::SR1(instr) };
+	Reg base{ masks::BaseR(instr) };
+
+	os << "\t// " << Hex{ addr } << ": " << Str(op) << '\n';
+
+	switch (op)
+	{
+	case OP::ADD:
+	case OP::AND:
+	{
+		auto sign = op == OP::ADD ? " + " : " & ";
+		os << '\t' << dr << " = static_cast<uint16_t>(" << sr1 << sign;
+		if (masks::IsImmediate(instr)) {
+			os << Hex{ masks::Imm5(instr) };
+		}
+		else {
+			os << Reg{ masks::SR2(instr) };
+		}
+		os << "); cond = Flags(" << dr << ");\n";
+	}
+	break;
+	case OP::NOT:
+		os << '\t' << dr << " = static_cast<uint16_t>(~" << sr1 << "); cond = Flags(" << dr << ");\n";
+		break;
+	case OP::LEA:
+		os << '\t' << dr << " = " << Hex{ static_cast<ValueType>(next + masks::PCOffset9(instr)) } << "; cond = Flags(" << dr << ");\n";
+		break;
+	case OP::LD:
+		os << '\t' << dr << " = LOAD(" << Hex{ static_cast<ValueType>(next + masks::PCOffset9(instr)) } << "); cond = Flags(" << dr << ");\n";
+		break;
+	case OP::LDI:
+		os << '\t' << dr << " = LOAD(LOAD(" << Hex{ static_cast<ValueType>(next + masks::PCOffset9(instr)) } << ")); cond = Flags(" << dr << ");\n";
+		break;
+	case OP::LDR:
+		os << '\t' << dr << " = LOAD(" << base << " + " << Hex{ masks::Offset6(instr) } << "); cond = Flags(" << dr << ");\n";
+		break;
+	case OP::ST:
+		os << "\tSTORE(" << Hex{ static_cast<ValueType>(next + masks::PCOffset9(instr)) } << ", " << Reg{ masks::SR(instr) } << ", " << Hex{ next } << ")\n";
+		break;
+	case OP::STI:
+		os << "\tSTORE(LOAD(" << Hex{ static_cast<ValueType>(next + masks::PCOffset9(instr)) } << "), " << Reg{ masks::SR(instr) } << ", " << Hex{ next } << ")\n";
+		break;
+	case OP::STR:
+		os << "\tSTORE(" << base << " + " << Hex{ masks::Offset6(instr) } << ", " << Reg{ masks::SR(instr) } << ", " << Hex{ next } << ")\n";
+		break;
+	case OP::TRAP:
+		os << "\tTRAP(" << Hex{ instr } << ", " << Hex{ next } << ")\n";
+		break;
+	case OP::BR:
+	{
+		os << "\t++n;\n";
+		auto nzp = masks::NZP(instr);
+		ValueType target = next + masks::PCOffset9(instr);
+		if (nzp == 0b111)
+		{
+			os << '\t';
+			EmitGoto(target, os);
+		}
+		else if (nzp)
+		{
+			os << "\tif (cond & " << nzp << ") ";
+			EmitGoto(target, os);
+		}
+		return;
+	}
+	case OP::JMP:
+		os << "\t++n; pc = " << base << "; goto dispatch;\n";
+		return;
+	case OP::JSR:
+		if (masks::IsJsrOffset(instr))
+		{
+			os << "\t++n; r7 = " << Hex{ next } << "; ";
+			EmitGoto(next + masks::PCOffset11(instr), os);
+		}
+		else {
+			// NOTE: JSRR R7 jumps to the old R7 value
+			os << "\t++n; pc = " << base << "; r7 = " << Hex{ next } << "; goto dispatch;\n";
+		}
+		return;
+	case OP::RTI:
+	case OP::RES:
+	default:
+		// NOTE: left to the interpreter, which stops the program
+		os << "\tpc = " << Hex{ addr } << "; goto leave;\n";
+		return;
+	}
+	os << "\t++n;\n";
+}
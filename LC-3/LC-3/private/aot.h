@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+
+#include "cfg.h"
+#include "memory.h"
+
+/// <summary>
+/// Translates a loaded image to a C++ translation unit for lc3-aot.
+/// </summary>
+/// <remarks>
+/// Every basic block found by <see cref="ControlFlowGraph"/> becomes a
+/// labeled region of one function, direct branches are gotos and indirect
+/// jumps go through a switch over the block addresses. Registers live in
+/// locals, devices and traps are calls back into the VM (see aotabi.h).
+/// Control goes back to the interpreter at addresses that were not
+/// translated, before housekeeping ticks and when the program writes to
+/// its own code, so the VM sees the same execution as when interpreting.
+/// </remarks>
+class AotTranslator
+{
+public:
+	using ValueType = Memory::ValueType;
+
+	/// <summary>
+	/// Emit the translation of the image loaded in mem
+	/// </summary>
+	/// <param name="entry">program start, the image origin by default</param>
+	void Translate(const Memory& mem, ValueType entry, std::ostream& os);
+	void Translate(const Memory& mem, std::ostream& os) { Translate(mem, mem.Origin(), os); };
+
+	size_t BlockCount() const { return m_cfg.Blocks().size(); };
+
+private:
+	void EmitBlock(const ControlFlowGraph::BasicBlock& block, std::ostream& os) const;
+	void EmitInstruction(ValueType addr, ValueType instr, std::ostream& os) const;
+
+	/// <summary>
+	/// Continue at target: goto its block or leave to the interpreter
+	/// </summary>
+	void EmitGoto(ValueType target, std::ostream& os) const;
+
+	ControlFlowGraph m_cfg;
+};
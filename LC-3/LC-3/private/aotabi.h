@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+
+// NOTE: shared by the VM and the C++ emitted by lc3-aot, keep it free of
+// other project headers so that generated code compiles on its own
+
+#ifdef WIN32
+#define LC3_AOT_EXPORT extern "C" __declspec(dllexport)
+#else
+#define LC3_AOT_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+/// <summary>
+/// Bumped on every change of the structures below
+/// </summary>
+inline constexpr uint32_t kAotAbiVersion = 3;
+
+/// <summary>
+/// Machine state and VM runtime calls handed to translated code
+/// </summary>
+struct AotContext
+{
+	/// <summary>
+	/// R0-R7, PC, COND
+	/// </summary>
+	uint16_t* reg;
+	uint16_t* mem;
+	/// <summary>
+	/// Instructions retired, up to date whenever the runtime is called
+	/// </summary>
+	uint64_t* count;
+	void* vm;
+
+	/// <summary>
+	/// Device registers, addresses from kAotDeviceBase
+	/// </summary>
+	uint16_t(*read)(void* vm, uint16_t addr);
+	void (*write)(void* vm, uint16_t addr, uint16_t val);
+
+	/// <summary>
+	/// TRAP instruction, registers must be stored to reg before the call
+	/// and all of them loaded back after it, host functions may change any
+	/// </summary>
+	/// <returns>kAotInterpret to go on with the next instruction,
+	/// kAotHalted when the program stops, kAotCodeWritten when the trap
+	/// stored to translated code</returns>
+	int (*trap)(void* vm, uint16_t instr);
+};
+
+inline constexpr uint16_t kAotDeviceBase = 0xFE00;
+
+/// <summary>
+/// Why translated code handed control back
+/// </summary>
+enum AotStatus : int
+{
+	/// <summary>
+	/// The instruction at PC has to be interpreted: not translated,
+	/// a housekeeping tick or an unsupported opcode
+	/// </summary>
+	kAotInterpret = 0,
+	kAotHalted = 1,
+	/// <summary>
+	/// The program stored to its own code, translation is stale
+	/// </summary>
+	kAotCodeWritten = 2
+};
+
+/// <summary>
+/// Symbols exported by a translated program
+/// </summary>
+/// <remarks>
+/// uint32_t lc3_aot_abi: kAotAbiVersion
+/// uint16_t lc3_aot_origin, uint32_t lc3_aot_size, uint16_t lc3_aot_image[]:
+///     the image the code was translated from
+/// uint8_t lc3_aot_code[8192]: a bit per address, set on translated code
+/// uint8_t lc3_aot_entry[8192]: a bit per address, set on block starts,
+///     the only addresses lc3_aot_run starts from
+/// int lc3_aot_run(AotContext*): run from reg[PC], returns an AotStatus
+/// </remarks>
+using AotEntry = int (*)(AotContext*);
@@ -0,0 +1,340 @@
+#include "cfg.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "masks.h"
+
+namespace
+{
+	bool IsTerminator(uint16_t instr)
+	{
+		switch (masks::OpCode(instr))
+		{
+		case OP::BR:
+			return masks::NZP(instr) != 0;
+		case OP::JMP:
+		case OP::JSR:
+		case OP::RTI:
+		case OP::RES:
+			return true;
+		case OP::TRAP:
+			return masks::TrapVect8(instr) == static_cast<uint16_t>(TR::HALT);
+		default:
+			return false;
+		}
+	}
+
+	const char* Str(ControlFlowGraph::EdgeKind kind)
+	{
+		using Kind = ControlFlowGraph::EdgeKind;
+		switch (kind)
+		{
+		case Kind::Taken: return "taken";
+		case Kind::Call: return "call";
+		case Kind::Return: return "return";
+		case Kind::Indirect: return "indirect";
+		case Kind::Fallthrough:
+		default: return "fallthrough";
+		}
+	}
+
+	struct Hex
+	{
+		uint16_t value;
+	};
+
+	std::ostream& operator<<(std::ostream& os, Hex hex)
+	{
+		auto flags = os.flags();
+		os << 'x' << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << hex.value;
+		os.flags(flags);
+		return os;
+	}
+}
+
+void ControlFlowGraph::Build(const Memory& mem, ValueType entry)
+{
+	m_mem = &mem;
+	m_origin = mem.Origin();
+	m_size = mem.LoadedSize();
+
+	m_code.reset();
+	m_leader.reset();
+	m_entries.clear();
+	m_blocks.clear();
+	m_edges.clear();
+
+	Discover(entry);
+	Split();
+	Link();
+	FindLoops();
+}
+
+void ControlFlowGraph::Discover(ValueType entry)
+{
+	std::vector<ValueType> worklist{ entry };
+	if (InImage(entry))
+	{
+		m_leader[entry] = true;
+		m_entries.push_back(entry);
+	}
+
+	auto follow = [this, &worklist](ValueType target) {
+		if (InImage(target))
+		{
+			m_leader[target] = true;
+			worklist.push_back(target);
+		}
+	};
+
+	while (!worklist.empty())
+	{
+		ValueType addr = worklist.back();
+		worklist.pop_back();
+
+		for (bool more = true; more && InImage(addr) && !m_code[addr]; ++addr)
+		{
+			m_code[addr] = true;
+			auto instr = Instruction(addr);
+			ValueType next = addr + 1;
+
+			switch (masks::OpCode(instr))
+			{
+			case OP::BR:
+				if (masks::NZP(instr) != 0)
+				{
+					follow(next + masks::PCOffset9(instr));
+					m_leader[next] = true;
+					more = masks::NZP(instr) != 0b111;
+				}
+				break;
+			case OP::JSR:
+				if (masks::IsJsrOffset(instr))
+				{
+					ValueType target = next + masks::PCOffset11(instr);
+					follow(target);
+					if (InImage(target) && std::find(m_entries.begin(), m_entries.end(), target) == m_entries.end()) {
+						m_entries.push_back(target);
+					}
+				}
+				m_leader[next] = true;
+				break;
+			case OP::JMP:
+			case OP::RTI:
+			case OP::RES:
+				more = false;
+				break;
+			case OP::TRAP:
+				more = !IsTerminator(instr);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void ControlFlowGraph::Split()
+{
+	bool open = false;
+	for (size_t i = 0; i < m_size; ++i)
+	{
+		ValueType addr = m_origin + static_cast<ValueType>(i);
+		if (!m_code[addr])
+		{
+			open = false;
+			continue;
+		}
+
+		if (!open || m_leader[addr]) {
+			m_blocks.push_back({ addr, 0, false, false });
+		}
+		++m_blocks.back().size;
+		open = !IsTerminator(Instruction(addr));
+	}
+
+	for (auto entry : m_entries)
+	{
+		auto index = BlockAt(entry);
+		if (index != kExternal) {
+			m_blocks[index].entry = true;
+		}
+	}
+}
+
+size_t ControlFlowGraph::BlockAt(ValueType addr) const
+{
+	auto it = std::lower_bound(m_blocks.begin(), m_blocks.end(), addr,
+		[](const BasicBlock& block, ValueType a) { return block.start < a; });
+	return it != m_blocks.end() && it->start == addr ? std::distance(m_blocks.begin(), it) : kExternal;
+}
+
+void ControlFlowGraph::Link()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		const auto& block = m_blocks[i];
+		ValueType last = block.start + block.size - 1;
+		ValueType next = last + 1;
+		auto instr = Instruction(last);
+
+		auto add = [this, i](ValueType target, EdgeKind kind) {
+			m_edges.push_back({ i, InImage(target) ? BlockAt(target) : kExternal, kind, false });
+		};
+
+		if (!IsTerminator(instr))
+		{
+			if (InImage(next) && m_code[next]) {
+				add(next, EdgeKind::Fallthrough);
+			}
+			continue;
+		}
+
+		switch (masks::OpCode(instr))
+		{
+		case OP::BR:
+			add(next + masks::PCOffset9(instr), EdgeKind::Taken);
+			if (masks::NZP(instr) != 0b111) {
+				add(next, EdgeKind::Fallthrough);
+			}
+			break;
+		case OP::JMP:
+			m_edges.push_back({ i, kExternal, EdgeKind::Indirect, false });
+			break;
+		case OP::JSR:
+			if (masks::IsJsrOffset(instr)) {
+				add(next + masks::PCOffset11(instr), EdgeKind::Call);
+			}
+			else {
+				m_edges.push_back({ i, kExternal, EdgeKind::Indirect, false });
+			}
+			if (InImage(next) && m_code[next]) {
+				add(next, EdgeKind::Return);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void ControlFlowGraph::FindLoops()
+{
+	// NOTE: edges are emitted in block order, index them by source block
+	std::vector<size_t> first(m_blocks.size() + 1, 0);
+	for (const auto& edge : m_edges) {
+		++first[edge.from + 1];
+	}
+	for (size_t i = 1; i < first.size(); ++i) {
+		first[i] += first[i - 1];
+	}
+
+	enum : uint8_t { kWhite, kOnPath, kDone };
+	std::vector<uint8_t> color(m_blocks.size(), kWhite);
+	std::vector<std::pair<size_t, size_t>> path;
+
+	for (size_t root = 0; root < m_blocks.size(); ++root)
+	{
+		// NOTE: every subroutine is walked on its own, calls are not followed
+		if (!m_blocks[root].entry || color[root] != kWhite) {
+			continue;
+		}
+
+		color[root] = kOnPath;
+		path.emplace_back(root, first[root]);
+		while (!path.empty())
+		{
+			auto& [block, edge] = path.back();
+			if (edge == first[block + 1])
+			{
+				color[block] = kDone;
+				path.pop_back();
+				continue;
+			}
+
+			auto& e = m_edges[edge++];
+			if (e.to == kExternal || e.kind == EdgeKind::Call) {
+				continue;
+			}
+			if (color[e.to] == kOnPath)
+			{
+				e.back = true;
+				m_blocks[e.to].loopHeader = true;
+			}
+			else if (color[e.to] == kWhite)
+			{
+				color[e.to] = kOnPath;
+				path.emplace_back(e.to, first[e.to]);
+			}
+		}
+	}
+}
+
+size_t ControlFlowGraph::LoopCount() const
+{
+	return std::count_if(m_blocks.begin(), m_blocks.end(), [](const BasicBlock& b) { return b.loopHeader; });
+}
+
+void ControlFlowGraph::WriteDot(std::ostream& os) const
+{
+	os << "digraph cfg {\n";
+	os << "\tnode [shape=box fontname=\"monospace\"];\n";
+	os << "\text [shape=ellipse label=\"external\"];\n";
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		const auto& block = m_blocks[i];
+		os << "\tb" << i << " [label=\"" << Hex{ block.start } << ".." << Hex{ static_cast<ValueType>(block.start + block.size - 1) }
+			<< "\\n" << ::Str(masks::OpCode(Instruction(block.start + block.size - 1))) << '"';
+		if (block.entry) {
+			os << " style=bold";
+		}
+		if (block.loopHeader) {
+			os << " peripheries=2";
+		}
+		os << "];\n";
+	}
+	for (const auto& edge : m_edges)
+	{
+		os << "\tb" << edge.from << " -> ";
+		if (edge.to == kExternal) {
+			os << "ext";
+		}
+		else {
+			os << 'b' << edge.to;
+		}
+		os << " [label=\"" << Str(edge.kind) << '"';
+		if (edge.back) {
+			os << " color=red";
+		}
+		os << "];\n";
+	}
+	os << "}\n";
+}
+
+void ControlFlowGraph::WriteJson(std::ostream& os) const
+{
+	os << "{\"origin\":" << m_origin << ",\"size\":" << m_size << ",\"blocks\":[";
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		const auto& block = m_blocks[i];
+		os << (i ? "," : "") << "{\"start\":" << block.start << ",\"size\":" << block.size
+			<< ",\"terminator\":\"" << ::Str(masks::OpCode(Instruction(block.start + block.size - 1))) << '"'
+			<< ",\"entry\":" << (block.entry ? "true" : "false")
+			<< ",\"loop_header\":" << (block.loopHeader ? "true" : "false") << '}';
+	}
+	os << "],\"edges\":[";
+	for (size_t i = 0; i < m_edges.size(); ++i)
+	{
+		const auto& edge = m_edges[i];
+		os << (i ? "," : "") << "{\"from\":" << edge.from << ",\"to\":";
+		if (edge.to == kExternal) {
+			os << "null";
+		}
+		else {
+			os << edge.to;
+		}
+		os << ",\"kind\":\"" << Str(edge.kind) << "\",\"back\":" << (edge.back ? "true" : "false") << '}';
+	}
+	os << "],\"loops\":" << LoopCount() << "}\n";
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "identifiers.h"
+#include "memory.h"
+
+/// <summary>
+/// Static control flow graph of a loaded image.
+/// </summary>
+/// <remarks>
+/// Code is discovered by recursive descent from the entry point and from
+/// every JSR target, only words of the loaded image are decoded. Control
+/// transfers leaving the image (OS routines, computed jumps) become edges
+/// to <see cref="kExternal"/>.
+/// </remarks>
+class ControlFlowGraph
+{
+public:
+	using ValueType = Memory::ValueType;
+
+	enum class EdgeKind
+	{
+		Fallthrough,
+		Taken,     /* BR, JMP to a known address */
+		Call,      /* JSR to the subroutine */
+		Return,    /* from JSR/JSRR to the instruction after it */
+		Indirect   /* JMP/JSRR through a register, RET */
+	};
+
+	struct Edge
+	{
+		size_t from;
+		size_t to;
+		EdgeKind kind;
+		/// <summary>
+		/// Edge closes a loop: its target is on the DFS path to its source
+		/// </summary>
+		bool back;
+	};
+
+	struct BasicBlock
+	{
+		ValueType start;
+		/// <summary>
+		/// Number of instructions, the last one is the terminator
+		/// </summary>
+		ValueType size;
+		bool entry;
+		bool loopHeader;
+	};
+
+	inline static const size_t kExternal = static_cast<size_t>(-1);
+
+	/// <summary>
+	/// Discover blocks of the image loaded in mem
+	/// </summary>
+	/// <param name="entry">first instruction, the image origin by default</param>
+	void Build(const Memory& mem, ValueType entry);
+	void Build(const Memory& mem) { Build(mem, mem.Origin()); };
+
+	const std::vector<BasicBlock>& Blocks() const { return m_blocks; };
+	const std::vector<Edge>& Edges() const { return m_edges; };
+
+	/// <summary>
+	/// Index of the block starting at addr or kExternal
+	/// </summary>
+	size_t BlockAt(ValueType addr) const;
+
+	ValueType Instruction(ValueType addr) const { return m_mem->Fetch(addr); };
+	bool IsCode(ValueType addr) const { return m_code[addr]; };
+	size_t LoopCount() const;
+
+	void WriteDot(std::ostream& os) const;
+	void WriteJson(std::ostream& os) const;
+
+private:
+	bool InImage(ValueType addr) const
+	{
+		return static_cast<ValueType>(addr - m_origin) < m_size;
+	};
+	void Discover(ValueType entry);
+	void Split();
+	void Link();
+	void FindLoops();
+
+	const Memory* m_mem{ nullptr };
+	ValueType m_origin{ 0 };
+	size_t m_size{ 0 };
+
+	std::bitset<Memory::kMemorySize> m_code;
+	std::bitset<Memory::kMemorySize> m_leader;
+	std::vector<ValueType> m_entries;
+	std::vector<BasicBlock> m_blocks;
+	std::vector<Edge> m_edges;
+};
@@ -0,0 +1,117 @@
+#include "coverage.h"
+
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <sys/shm.h>
+#endif // WIN32
+
+namespace
+{
+	constexpr std::array<uint8_t, 256> MakeBuckets()
+	{
+		std::array<uint8_t, 256> buckets{};
+		for (size_t count = 0; count < buckets.size(); ++count)
+		{
+			buckets[count] = count == 0 ? 0 : count == 1 ? 1 : count == 2 ? 2 : count == 3 ? 4 :
+				count < 8 ? 8 : count < 16 ? 16 : count < 32 ? 32 : count < 128 ? 64 : 128;
+		}
+		return buckets;
+	}
+
+	constexpr auto kBuckets = MakeBuckets();
+
+	uint64_t LoadWord(const uint8_t* p)
+	{
+		uint64_t word;
+		std::memcpy(&word, p, sizeof(word));
+		return word;
+	}
+}
+
+CoverageMap::CoverageMap() :
+	m_local(kSize),
+	m_data(m_local.data())
+{
+}
+
+CoverageMap::~CoverageMap()
+{
+	if (!m_shared) {
+		return;
+	}
+#ifdef WIN32
+	UnmapViewOfFile(m_shared);
+#else
+	shmdt(m_shared);
+#endif // WIN32
+}
+
+bool CoverageMap::AttachShared()
+{
+	auto id = std::getenv(kShmEnv);
+	if (!id || m_shared) {
+		return true;
+	}
+
+#ifdef WIN32
+	auto mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, id);
+	void* shared = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, kSize) : nullptr;
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (!shared)
+#else
+	void* shared = shmat(std::atoi(id), nullptr, 0);
+	if (shared == reinterpret_cast<void*>(-1))
+#endif // WIN32
+	{
+		std::cerr << "Can't attach the coverage map " << kShmEnv << '=' << id << '\n';
+		return false;
+	}
+	m_shared = shared;
+	m_data = static_cast<uint8_t*>(shared);
+	return true;
+}
+
+void CoverageMap::Clear()
+{
+	std::memset(m_data, 0, kSize);
+	m_touched.fill(0);
+}
+
+bool CoverageMap::Harvest(std::vector<uint8_t>& virgin)
+{
+	bool found = false;
+	for (size_t word = 0; word < m_touched.size(); ++word)
+	{
+		for (auto bits = std::exchange(m_touched[word], 0); bits; bits &= bits - 1)
+		{
+			auto start = (word * 64 + std::countr_zero(bits)) * kBlock;
+			for (size_t i = start; i < start + kBlock; i += sizeof(uint64_t))
+			{
+				if (!LoadWord(m_data + i)) {
+					continue;
+				}
+				for (size_t j = i; j < i + sizeof(uint64_t); ++j)
+				{
+					auto bucket = kBuckets[m_data[j]];
+					if (bucket & virgin[j])
+					{
+						virgin[j] &= ~bucket;
+						found = true;
+					}
+				}
+			}
+			std::memset(m_data + start, 0, kBlock);
+		}
+	}
+	return found;
+}
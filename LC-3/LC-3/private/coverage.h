@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+
+/// <summary>
+/// Edge hit counts of policy::CoverageEdges, laid out like an AFL trace
+/// bitmap so external fuzzers can read it.
+/// </summary>
+/// <remarks>
+/// Under afl-fuzz the map is the shared memory segment named by the
+/// __AFL_SHM_ID environment variable, otherwise it is private. A bit per
+/// 64 byte block tells which blocks a run touched, so harvesting a run
+/// doesn't read the whole map.
+/// </remarks>
+class CoverageMap
+{
+public:
+	inline static const size_t kSize = size_t(1) << 16;
+	inline static const char* const kShmEnv = "__AFL_SHM_ID";
+
+	CoverageMap();
+	CoverageMap(const CoverageMap&) = delete;
+	CoverageMap& operator=(const CoverageMap&) = delete;
+	~CoverageMap();
+
+	/// <summary>
+	/// Use the segment of the fuzzer running us, if any
+	/// </summary>
+	/// <returns>false when the variable is set but the segment can't be attached</returns>
+	bool AttachShared();
+	bool Shared() const { return m_shared != nullptr; };
+
+	const uint8_t* Data() const { return m_data; };
+	void Clear();
+
+	void Hit(uint16_t location)
+	{
+		++m_data[location];
+		m_touched[location >> 12] |= uint64_t(1) << ((location >> kBlockBits) & 63);
+	};
+
+	/// <summary>
+	/// Sort hit counts into AFL buckets (1, 2, 3, 4-7, 8-15, 16-31, 32-127,
+	/// 128+), merge them into virgin, the bits never seen so far (all ones
+	/// at start), and clear the map for the next run
+	/// </summary>
+	/// <returns>true when some bucket was new</returns>
+	bool Harvest(std::vector<uint8_t>& virgin);
+
+private:
+	inline static const int kBlockBits = 6;
+	inline static const size_t kBlock = size_t(1) << kBlockBits;
+
+	std::vector<uint8_t> m_local;
+	std::array<uint64_t, kSize / kBlock / 64> m_touched{};
+	void* m_shared{ nullptr };
+	uint8_t* m_data;
+};
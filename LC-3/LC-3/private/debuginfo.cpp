@@ -0,0 +1,208 @@
+#include "debuginfo.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	const char kMagic[4] = { 'L', 'C', '3', 'G' };
+}
+
+Hash128 DebugInfo::ImageKey(const uint16_t* obj, size_t size)
+{
+	Hasher hasher;
+	hasher.Add(static_cast<uint64_t>(size));
+	hasher.Update(obj, size * sizeof(uint16_t));
+	return hasher.Digest();
+}
+
+Hash128 DebugInfo::ImageKey(const Memory& mem)
+{
+	std::vector<uint16_t> obj{ mem.Origin() };
+	for (size_t i = 0; i < mem.LoadedSize(); ++i)
+	{
+		obj.push_back(mem.Fetch(static_cast<uint16_t>(mem.Origin() + i)));
+	}
+	return ImageKey(obj.data(), obj.size());
+}
+
+bool DebugInfo::Open(const std::filesystem::path& path)
+{
+	if (!m_file.OpenRead(path)) {
+		return false;
+	}
+
+	auto header = GetHeader();
+	bool valid = m_file.Size() >= sizeof(Header) &&
+		std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion;
+	if (valid)
+	{
+		auto size = sizeof(Header) + uint64_t(header->lines) * sizeof(Line) +
+			uint64_t(header->symbols) * sizeof(Symbol) + uint64_t(header->files) * sizeof(uint32_t) + header->strings;
+		// NOTE: every string offset lands before the last NUL
+		valid = size == m_file.Size() && (!header->strings || Strings()[header->strings - 1] == '\0');
+	}
+	if (!valid)
+	{
+		std::cerr << "Not a debug info file of this version " << path << '\n';
+		m_file.Close();
+		return false;
+	}
+	return true;
+}
+
+bool DebugInfo::FindLine(uint16_t addr, std::string_view& file, uint32_t& line) const
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	auto header = GetHeader();
+	auto lines = Lines();
+	auto it = std::upper_bound(lines, lines + header->lines, addr,
+		[](uint16_t a, const Line& entry) { return a < entry.address; });
+	if (it == lines || (it - 1)->file >= header->files) {
+		return false;
+	}
+	--it;
+	file = Strings() + Files()[it->file];
+	line = it->line;
+	return true;
+}
+
+bool DebugInfo::FindSymbol(uint16_t addr, std::string_view& name, uint16_t& offset) const
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	auto header = GetHeader();
+	auto symbols = Symbols();
+	auto it = std::upper_bound(symbols, symbols + header->symbols, addr,
+		[](uint16_t a, const Symbol& entry) { return a < entry.address; });
+	if (it == symbols) {
+		return false;
+	}
+	// NOTE: of several labels on one address the first one defined wins
+	auto first = std::lower_bound(symbols, it, (it - 1)->address,
+		[](const Symbol& entry, uint16_t a) { return entry.address < a; });
+	name = Strings() + first->name;
+	offset = static_cast<uint16_t>(addr - first->address);
+	return true;
+}
+
+bool DebugInfo::FindAddress(std::string_view name, uint16_t& addr) const
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	auto symbols = Symbols();
+	for (uint32_t i = 0; i < GetHeader()->symbols; ++i)
+	{
+		if (name == Strings() + symbols[i].name)
+		{
+			addr = symbols[i].address;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string DebugInfo::Describe(uint16_t addr) const
+{
+	std::string text;
+	std::string_view file;
+	uint32_t line;
+	if (FindLine(addr, file, line)) {
+		text.append(file).append(":").append(std::to_string(line));
+	}
+
+	std::string_view name;
+	uint16_t offset;
+	if (FindSymbol(addr, name, offset))
+	{
+		if (!text.empty()) {
+			text += ' ';
+		}
+		text += name;
+		if (offset) {
+			text += '+' + std::to_string(offset);
+		}
+	}
+	return text;
+}
+
+uint32_t DebugInfo::Builder::AddString(std::string_view str)
+{
+	auto offset = static_cast<uint32_t>(m_strings.size());
+	m_strings.append(str);
+	m_strings += '\0';
+	return offset;
+}
+
+uint16_t DebugInfo::Builder::AddFile(std::string_view name)
+{
+	m_files.push_back(AddString(name));
+	return static_cast<uint16_t>(m_files.size() - 1);
+}
+
+void DebugInfo::Builder::AddLine(uint16_t address, uint16_t file, uint32_t line)
+{
+	m_lines.push_back({ address, { file, line } });
+}
+
+void DebugInfo::Builder::AddGap(uint16_t address)
+{
+	m_lines.push_back({ address, { kNoFile, 0 } });
+}
+
+void DebugInfo::Builder::AddSymbol(std::string_view name, uint16_t address)
+{
+	m_symbols.push_back({ address, AddString(name) });
+}
+
+bool DebugInfo::Builder::Write(const std::filesystem::path& path, const Hash128& image) const
+{
+	// NOTE: stable sorts keep the order of definition for equal addresses,
+	// the latest entry for an address is the one in effect
+	auto lines = m_lines;
+	std::stable_sort(lines.begin(), lines.end(), [](auto& a, auto& b) { return a.first < b.first; });
+	std::vector<Line> lineTable;
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		if (i + 1 < lines.size() && lines[i + 1].first == lines[i].first) {
+			continue;
+		}
+		lineTable.push_back({ lines[i].first, lines[i].second.first, lines[i].second.second });
+	}
+
+	auto symbols = m_symbols;
+	std::stable_sort(symbols.begin(), symbols.end(), [](auto& a, auto& b) { return a.first < b.first; });
+	std::vector<Symbol> symbolTable;
+	for (auto& [address, name] : symbols)
+	{
+		symbolTable.push_back({ address, 0, name });
+	}
+
+	Header header{};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.image = image;
+	header.lines = static_cast<uint32_t>(lineTable.size());
+	header.symbols = static_cast<uint32_t>(symbolTable.size());
+	header.files = static_cast<uint32_t>(m_files.size());
+	header.strings = static_cast<uint32_t>(m_strings.size());
+
+	std::ofstream os(path, std::ios::out | std::ios::binary);
+	os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	os.write(reinterpret_cast<const char*>(lineTable.data()), lineTable.size() * sizeof(Line));
+	os.write(reinterpret_cast<const char*>(symbolTable.data()), symbolTable.size() * sizeof(Symbol));
+	os.write(reinterpret_cast<const char*>(m_files.data()), m_files.size() * sizeof(uint32_t));
+	os.write(m_strings.data(), m_strings.size());
+	if (!os)
+	{
+		std::cerr << "Can't write debug info " << path << '\n';
+		return false;
+	}
+	return true;
+}
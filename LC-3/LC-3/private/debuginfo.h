@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hash.h"
+#include "mapfile.h"
+#include "memory.h"
+
+/// <summary>
+/// Source map written by lc3-asm next to the .obj file: address to
+/// file:line and label tables, used to annotate profiles, traces and
+/// debugger output.
+/// </summary>
+/// <remarks>
+/// File layout: a header, the line table and the symbol table both sorted
+/// by address, the file name table and a blob of NUL terminated strings.
+/// The file is mapped as is and searched in place, nothing is built when
+/// it is opened. The header holds a hash of the image it describes, a
+/// sidecar left over from another build of the program is refused.
+/// </remarks>
+class DebugInfo
+{
+public:
+	inline static const uint32_t kVersion = 1;
+
+	/// <summary>
+	/// Identity of an image laid out as an .obj file, origin first
+	/// </summary>
+	static Hash128 ImageKey(const uint16_t* obj, size_t size);
+	/// <summary>
+	/// Identity of the image loaded in mem
+	/// </summary>
+	static Hash128 ImageKey(const Memory& mem);
+
+	bool Open(const std::filesystem::path& path);
+	bool IsOpen() const { return m_file.Data() != nullptr; };
+	const Hash128& Image() const { return GetHeader()->image; };
+
+	/// <summary>
+	/// Source line of the statement the word at addr was assembled from
+	/// </summary>
+	bool FindLine(uint16_t addr, std::string_view& file, uint32_t& line) const;
+
+	/// <summary>
+	/// Closest label at or below addr
+	/// </summary>
+	bool FindSymbol(uint16_t addr, std::string_view& name, uint16_t& offset) const;
+
+	/// <summary>
+	/// Address of a label
+	/// </summary>
+	bool FindAddress(std::string_view name, uint16_t& addr) const;
+
+	/// <summary>
+	/// "file:line LABEL+offset" as far as known, empty when nothing is
+	/// </summary>
+	std::string Describe(uint16_t addr) const;
+
+	/// <summary>
+	/// Tables collected by the assembler, sorted when written
+	/// </summary>
+	class Builder
+	{
+	public:
+		uint16_t AddFile(std::string_view name);
+		/// <summary>
+		/// Words from address on come from line of file, up to the next
+		/// AddLine or AddGap
+		/// </summary>
+		void AddLine(uint16_t address, uint16_t file, uint32_t line);
+		/// <summary>
+		/// Words from address on come from no source line
+		/// </summary>
+		void AddGap(uint16_t address);
+		void AddSymbol(std::string_view name, uint16_t address);
+
+		bool Write(const std::filesystem::path& path, const Hash128& image) const;
+
+	private:
+		uint32_t AddString(std::string_view str);
+
+		std::vector<uint32_t> m_files;
+		std::vector<std::pair<uint16_t, std::pair<uint16_t, uint32_t>>> m_lines;
+		std::vector<std::pair<uint16_t, uint32_t>> m_symbols;
+		std::string m_strings;
+	};
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		Hash128 image;
+		uint32_t lines;
+		uint32_t symbols;
+		uint32_t files;
+		uint32_t strings;
+	};
+
+	struct Line
+	{
+		uint16_t address;
+		/// <summary>
+		/// Index in the file table, kNoFile where no source line applies
+		/// </summary>
+		uint16_t file;
+		uint32_t line;
+	};
+
+	struct Symbol
+	{
+		uint16_t address;
+		uint16_t reserved;
+		/// <summary>
+		/// Offset in the string blob
+		/// </summary>
+		uint32_t name;
+	};
+
+	inline static const uint16_t kNoFile = 0xFFFF;
+
+	const Header* GetHeader() const { return reinterpret_cast<const Header*>(m_file.Data()); };
+	const Line* Lines() const { return reinterpret_cast<const Line*>(GetHeader() + 1); };
+	const Symbol* Symbols() const { return reinterpret_cast<const Symbol*>(Lines() + GetHeader()->lines); };
+	const uint32_t* Files() const { return reinterpret_cast<const uint32_t*>(Symbols() + GetHeader()->symbols); };
+	const char* Strings() const { return reinterpret_cast<const char*>(Files() + GetHeader()->files); };
+
+	MappedFile m_file;
+};
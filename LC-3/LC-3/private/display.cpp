@@ -0,0 +1,337 @@
+#include "display.h"
+
+#include <algorithm>
+
+namespace
+{
+	const char kEsc = '\x1b';
+
+	enum Attribute : uint16_t
+	{
+		kForeground = 0x07,
+		kBold = 0x08,
+		kBackground = 0x70,
+		kColored = 0x80,
+		// NOTE: what a plain terminal shows, light gray on black
+		kDefaultColors = kColored | 0x07
+	};
+}
+
+Display::Display(Memory& mem, std::ostream* terminal, unsigned fps) :
+	m_mem(mem),
+	m_terminal(terminal),
+	m_console(this),
+	m_interval(std::chrono::steady_clock::duration(std::chrono::seconds(1)) / std::max(fps, 1u)),
+	m_shown(kColumns * kRows, 0)
+{
+	setp(m_pending, m_pending + sizeof(m_pending));
+	if (m_terminal)
+	{
+		// NOTE: hidden cursor on a cleared screen, which is what the zeroed
+		// grid stands for
+		m_frame = "\x1b[?25l\x1b[0m\x1b[2J";
+		m_terminal->write(m_frame.data(), m_frame.size());
+		m_terminal->flush();
+		m_bytes += m_frame.size();
+	}
+}
+
+Display::~Display()
+{
+	if (!m_terminal) {
+		return;
+	}
+	Refresh(true);
+	*m_terminal << "\x1b[0m\x1b[" << kRows + 1 << ";1H\x1b[?25h";
+	m_terminal->flush();
+}
+
+Display::int_type Display::overflow(int_type ch)
+{
+	Drain();
+	if (!traits_type::eq_int_type(ch, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+int Display::sync()
+{
+	Drain();
+	return 0;
+}
+
+void Display::Drain()
+{
+	if (pptr() == pbase()) {
+		return;
+	}
+
+	// NOTE: the cursor lives in guest memory, where the guest may have
+	// left anything
+	int row = std::min<int>(m_mem.Fetch(kCursorRow), kRows - 1);
+	int column = std::min<int>(m_mem.Fetch(kCursorColumn), kColumns - 1);
+	for (auto p = pbase(); p != pptr(); ++p) {
+		Put(*p, row, column);
+	}
+	m_mem.Write(kCursorRow, static_cast<ValueType>(row));
+	m_mem.Write(kCursorColumn, static_cast<ValueType>(column));
+	setp(m_pending, m_pending + sizeof(m_pending));
+}
+
+void Display::Put(char ch, int& row, int& column)
+{
+	switch (m_escape)
+	{
+	case Escape::Started:
+		m_escape = ch == '[' ? Escape::Csi : Escape::None;
+		m_params.assign(1, 0);
+		m_private = false;
+		break;
+	case Escape::Csi:
+		if (ch >= '0' && ch <= '9') {
+			m_params.back() = std::min(m_params.back() * 10 + (ch - '0'), 9999);
+		}
+		else if (ch == ';') {
+			m_params.push_back(0);
+		}
+		else if (ch >= 0x3C && ch <= 0x3F) {
+			m_private = true;
+		}
+		else if (ch >= 0x40 && ch <= 0x7E)
+		{
+			m_escape = Escape::None;
+			if (!m_private) {
+				Control(ch, row, column);
+			}
+		}
+		break;
+	case Escape::None:
+	default:
+		switch (ch)
+		{
+		case kEsc:
+			m_escape = Escape::Started;
+			break;
+		case '\n':
+			// NOTE: terminals in cooked mode return the carriage as well
+			column = 0;
+			NewLine(row);
+			break;
+		case '\r':
+			column = 0;
+			break;
+		case '\b':
+			column = std::max(column - 1, 0);
+			break;
+		case '\t':
+			column = std::min((column + 8) & ~7, kColumns - 1);
+			break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20) {
+				break;
+			}
+			SetCell(row, column, static_cast<ValueType>(m_mem.Fetch(kAttribute) << 8 | static_cast<unsigned char>(ch)));
+			if (++column == kColumns)
+			{
+				column = 0;
+				NewLine(row);
+			}
+			break;
+		}
+		break;
+	}
+}
+
+void Display::NewLine(int& row)
+{
+	if (++row < kRows) {
+		return;
+	}
+	row = kRows - 1;
+	for (int i = 0; i < kColumns * (kRows - 1); ++i)
+	{
+		auto addr = static_cast<ValueType>(kBase + i);
+		m_mem.Write(addr, m_mem.Fetch(static_cast<ValueType>(addr + kColumns)));
+	}
+	Clear(kColumns * (kRows - 1), kColumns * kRows);
+}
+
+void Display::Clear(int from, int to)
+{
+	m_mem.Fill(static_cast<ValueType>(kBase + from), std::max(to - from, 0), 0);
+}
+
+void Display::Control(char final, int& row, int& column)
+{
+	auto param = [this](size_t i, int fallback) {
+		return i < m_params.size() && m_params[i] ? m_params[i] : fallback;
+	};
+	auto cursor = row * kColumns + column;
+
+	switch (final)
+	{
+	case 'H':
+	case 'f':
+		row = std::min(param(0, 1), kRows) - 1;
+		column = std::min(param(1, 1), kColumns) - 1;
+		break;
+	case 'A':
+		row = std::max(row - param(0, 1), 0);
+		break;
+	case 'B':
+		row = std::min(row + param(0, 1), kRows - 1);
+		break;
+	case 'C':
+		column = std::min(column + param(0, 1), kColumns - 1);
+		break;
+	case 'D':
+		column = std::max(column - param(0, 1), 0);
+		break;
+	case 'J':
+		switch (m_params[0])
+		{
+		case 0:
+			Clear(cursor, kColumns * kRows);
+			break;
+		case 1:
+			Clear(0, cursor + 1);
+			break;
+		default:
+			Clear(0, kColumns * kRows);
+			break;
+		}
+		break;
+	case 'K':
+		switch (m_params[0])
+		{
+		case 0:
+			Clear(cursor, (row + 1) * kColumns);
+			break;
+		case 1:
+			Clear(row * kColumns, cursor + 1);
+			break;
+		default:
+			Clear(row * kColumns, (row + 1) * kColumns);
+			break;
+		}
+		break;
+	case 'm':
+		SelectGraphics();
+		break;
+	default:
+		break;
+	}
+}
+
+void Display::SelectGraphics()
+{
+	ValueType attr = m_mem.Fetch(kAttribute) & 0xFF;
+	for (auto p : m_params)
+	{
+		if (p == 0) {
+			attr = 0;
+		}
+		else if (p == 1) {
+			attr |= kBold;
+		}
+		else if (p == 22) {
+			attr &= ~kBold;
+		}
+		else if (p >= 30 && p <= 37) {
+			attr = (((attr & kColored) ? attr : (attr | kDefaultColors)) & ~kForeground) | (p - 30);
+		}
+		else if (p == 39) {
+			attr = (((attr & kColored) ? attr : (attr | kDefaultColors)) & ~kForeground) | 7;
+		}
+		else if (p >= 40 && p <= 47) {
+			attr = (((attr & kColored) ? attr : (attr | kDefaultColors)) & ~kBackground) | (p - 40) << 4;
+		}
+		else if (p == 49) {
+			attr = ((attr & kColored) ? attr : (attr | kDefaultColors)) & ~kBackground;
+		}
+	}
+	m_mem.Write(kAttribute, attr);
+}
+
+void Display::Refresh(bool force)
+{
+	Drain();
+	if (!m_terminal) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (!force && now < m_next) {
+		return;
+	}
+	m_next = now + m_interval;
+
+	// NOTE: a cursor move is only needed where the changed cells are not
+	// contiguous, and a color change where the attribute differs
+	m_frame.clear();
+	int atRow = -1, atColumn = -1;
+	int attr = -1;
+	for (int row = 0; row < kRows; ++row)
+	{
+		for (int column = 0; column < kColumns; ++column)
+		{
+			auto cell = Cell(row, column);
+			auto& shown = m_shown[row * kColumns + column];
+			if (cell == shown) {
+				continue;
+			}
+			shown = cell;
+
+			if (row != atRow || column != atColumn)
+			{
+				m_frame += "\x1b[" + std::to_string(row + 1) + ';' + std::to_string(column + 1) + 'H';
+				atRow = row;
+			}
+			if ((cell >> 8) != attr)
+			{
+				attr = cell >> 8;
+				m_frame += "\x1b[0";
+				if (attr & kBold) {
+					m_frame += ";1";
+				}
+				if (attr & kColored)
+				{
+					m_frame += ";3" + std::to_string(attr & kForeground);
+					m_frame += ";4" + std::to_string((attr & kBackground) >> 4);
+				}
+				m_frame += 'm';
+			}
+			auto ch = static_cast<char>(cell & 0xFF);
+			m_frame += ch >= 0x20 && ch < 0x7F ? ch : ' ';
+			atColumn = column + 1;
+		}
+	}
+	if (m_frame.empty()) {
+		return;
+	}
+
+	m_terminal->write(m_frame.data(), m_frame.size());
+	m_terminal->flush();
+	m_bytes += m_frame.size();
+	++m_frames;
+}
+
+std::string Display::Text() const
+{
+	std::string text;
+	for (int row = 0; row < kRows; ++row)
+	{
+		std::string line;
+		for (int column = 0; column < kColumns; ++column)
+		{
+			auto ch = static_cast<char>(Cell(row, column) & 0xFF);
+			line += ch >= 0x20 && ch < 0x7F ? ch : ' ';
+		}
+		line.erase(line.find_last_not_of(' ') + 1);
+		text += line;
+		text += '\n';
+	}
+	return text;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "memory.h"
+
+/// <summary>
+/// Text framebuffer device: a grid of character cells in guest memory,
+/// drawn to an ANSI terminal by sending only the cells changed since the
+/// last frame, at a capped frame rate.
+/// </summary>
+/// <remarks>
+/// A cell is a word: character in the low byte, attribute in the high
+/// byte. Attribute bits 0-2 are the foreground color, bit 3 bold, bits
+/// 4-6 the background color; colors only apply with bit 7 set, 0 is the
+/// terminal default. The words after the grid hold the console cursor
+/// and the current attribute.
+///
+/// Trap output goes through a console writing to the grid. It understands
+/// CR, LF, BS, TAB and the usual cursor, erase and color CSI sequences,
+/// so programs printing full screens with escape codes get the same
+/// treatment as those writing the cells directly.
+/// </remarks>
+class Display : private std::streambuf
+{
+public:
+	using ValueType = Memory::ValueType;
+
+	inline static const ValueType kBase = 0xF000;
+	inline static const int kColumns = 80;
+	inline static const int kRows = 25;
+	inline static const ValueType kCursorRow = kBase + kColumns * kRows;
+	inline static const ValueType kCursorColumn = kCursorRow + 1;
+	inline static const ValueType kAttribute = kCursorRow + 2;
+
+	/// <param name="terminal">nullptr for a headless display, never drawn</param>
+	Display(Memory& mem, std::ostream* terminal, unsigned fps);
+	Display(const Display&) = delete;
+	Display& operator=(const Display&) = delete;
+	/// <summary>
+	/// Draws the last frame and gives the terminal cursor back below it
+	/// </summary>
+	~Display();
+
+	/// <summary>
+	/// Console writing to the grid. Output is buffered until flushed,
+	/// which updates the grid but draws nothing.
+	/// </summary>
+	std::ostream& Console() { return m_console; };
+
+	/// <summary>
+	/// Draw changed cells, unless the last frame is too recent
+	/// </summary>
+	/// <param name="force">draw now, the guest is about to wait</param>
+	void Refresh(bool force = false);
+
+	/// <summary>
+	/// Screen content as text lines without trailing blanks
+	/// </summary>
+	std::string Text() const;
+
+	uint64_t Frames() const { return m_frames; };
+	uint64_t BytesWritten() const { return m_bytes; };
+
+private:
+	int_type overflow(int_type ch) override;
+	int sync() override;
+	/// <summary>
+	/// Move buffered console output to the grid
+	/// </summary>
+	void Drain();
+	void Put(char ch, int& row, int& column);
+
+	ValueType Cell(int row, int column) const { return m_mem.Fetch(static_cast<ValueType>(kBase + row * kColumns + column)); };
+	void SetCell(int row, int column, ValueType val) { m_mem.Write(static_cast<ValueType>(kBase + row * kColumns + column), val); };
+	void Clear(int from, int to);
+	void NewLine(int& row);
+	void Control(char final, int& row, int& column);
+	void SelectGraphics();
+
+	Memory& m_mem;
+	std::ostream* m_terminal;
+	std::ostream m_console;
+	char m_pending[256];
+	std::chrono::steady_clock::duration m_interval;
+	std::chrono::steady_clock::time_point m_next;
+	/// <summary>
+	/// Cells as last drawn
+	/// </summary>
+	std::vector<ValueType> m_shown;
+	std::string m_frame;
+	uint64_t m_frames{ 0 };
+	uint64_t m_bytes{ 0 };
+
+	enum class Escape { None, Started, Csi };
+	Escape m_escape{ Escape::None };
+	std::vector<int> m_params;
+	bool m_private{ false };
+};
@@ -0,0 +1,27 @@
+#include "filelist.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+bool CollectInputs(std::string_view arg, std::vector<std::filesystem::path>& inputs)
+{
+	if (arg.empty() || arg[0] != '@')
+	{
+		inputs.emplace_back(arg);
+		return true;
+	}
+
+	std::ifstream list(std::string(arg.substr(1)));
+	if (!list) {
+		std::cerr << "Can't open file list " << arg.substr(1) << std::endl;
+		return false;
+	}
+	for (std::string line; std::getline(list, line);)
+	{
+		if (!line.empty()) {
+			inputs.emplace_back(line);
+		}
+	}
+	return true;
+}
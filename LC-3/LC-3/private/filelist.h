@@ -0,0 +1,10 @@
+#pragma once
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Add a command line file argument to inputs, expanding an @list
+/// argument into the file names it holds, one per line
+/// </summary>
+bool CollectInputs(std::string_view arg, std::vector<std::filesystem::path>& inputs);
@@ -0,0 +1,529 @@
+#include "gdbstub.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define closesocket close
+#endif // WIN32
+
+namespace
+{
+	const char kHex[] = "0123456789abcdef";
+
+	// NOTE: register order of 'g' packets
+	const R kGdbRegisters[] = { R::R0, R::R1, R::R2, R::R3, R::R4, R::R5, R::R6, R::R7, R::PC, R::COND };
+
+	const char kTargetXml[] =
+		"<?xml version=\"1.0\"?>"
+		"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+		"<target version=\"1.0\"><feature name=\"org.lc3.core\">"
+		"<reg name=\"r0\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r1\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r2\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r3\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r4\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r5\" bitsize=\"16\" type=\"int16\"/>"
+		"<reg name=\"r6\" bitsize=\"16\" type=\"data_ptr\"/>"
+		"<reg name=\"r7\" bitsize=\"16\" type=\"code_ptr\"/>"
+		"<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+		"<reg name=\"cond\" bitsize=\"16\" type=\"int16\"/>"
+		"</feature></target>";
+
+	void AppendWord(std::string& out, uint16_t word)
+	{
+		for (int shift = 12; shift >= 0; shift -= 4)
+		{
+			out.push_back(kHex[(word >> shift) & 0xF]);
+		}
+	}
+
+	int HexDigit(char ch)
+	{
+		if (ch >= '0' && ch <= '9') return ch - '0';
+		if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+		if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+		return -1;
+	}
+
+	/// <summary>
+	/// Parse a hex number at pos, advance pos past it
+	/// </summary>
+	uint32_t ParseHex(std::string_view str, size_t& pos)
+	{
+		uint32_t value = 0;
+		for (int digit; pos < str.size() && (digit = HexDigit(str[pos])) >= 0; ++pos)
+		{
+			value = (value << 4) | static_cast<uint32_t>(digit);
+		}
+		return value;
+	}
+
+	/// <summary>
+	/// Console output of qRcmd replies, two hex digits per character
+	/// </summary>
+	std::string HexText(std::string_view text)
+	{
+		std::string out;
+		for (unsigned char ch : text)
+		{
+			out.push_back(kHex[ch >> 4]);
+			out.push_back(kHex[ch & 0xF]);
+		}
+		return out;
+	}
+
+	bool ParseWord(std::string_view str, size_t& pos, uint16_t& word)
+	{
+		if (pos + 4 > str.size()) {
+			return false;
+		}
+		auto end = pos + 4;
+		word = static_cast<uint16_t>(ParseHex(str.substr(0, end), pos));
+		return pos == end;
+	}
+}
+
+GdbStub::~GdbStub()
+{
+	if (m_conn != kNoSocket) {
+		closesocket(m_conn);
+	}
+	if (m_listen != kNoSocket) {
+		closesocket(m_listen);
+	}
+#ifdef WIN32
+	WSACleanup();
+#endif
+}
+
+bool GdbStub::Listen(uint16_t port)
+{
+#ifdef WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+		std::cerr << "Can't initialize Winsock\n";
+		return false;
+	}
+#endif
+
+	m_listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (m_listen == kNoSocket) {
+		std::cerr << "Can't create a socket for the debugger\n";
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	// NOTE: the debugger has full control of the guest, never expose it
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(m_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+		listen(m_listen, 1) != 0)
+	{
+		std::cerr << "Can't listen for the debugger on port " << port << '\n';
+		return false;
+	}
+
+	std::cout << "LC-3 VM: waiting for the debugger on port " << port << std::endl;
+	m_conn = accept(m_listen, nullptr, nullptr);
+	if (m_conn == kNoSocket) {
+		std::cerr << "Debugger connection failed\n";
+		return false;
+	}
+	return true;
+}
+
+bool GdbStub::Serve()
+{
+	std::string packet;
+	while (!m_detached && !m_killed && ReadPacket(packet))
+	{
+		auto reply = Handle(packet);
+		if (!m_killed) {
+			SendPacket(reply);
+		}
+		if (packet == "QStartNoAckMode") {
+			m_noAck = true;
+		}
+	}
+	return m_detached;
+}
+
+bool GdbStub::ReadPacket(std::string& packet)
+{
+	char ch;
+	do
+	{
+		if (recv(m_conn, &ch, 1, 0) != 1) {
+			return false;
+		}
+		// NOTE: acks and stray interrupts between packets are ignored
+	} while (ch != '$');
+
+	packet.clear();
+	while (true)
+	{
+		if (recv(m_conn, &ch, 1, 0) != 1) {
+			return false;
+		}
+		if (ch == '#') {
+			break;
+		}
+		packet.push_back(ch);
+	}
+
+	char checksum[2];
+	if (recv(m_conn, checksum, 1, 0) != 1 || recv(m_conn, checksum + 1, 1, 0) != 1) {
+		return false;
+	}
+
+	if (!m_noAck)
+	{
+		uint8_t sum = 0;
+		for (auto c : packet) {
+			sum += static_cast<uint8_t>(c);
+		}
+		bool ok = HexDigit(checksum[0]) == (sum >> 4) && HexDigit(checksum[1]) == (sum & 0xF);
+		send(m_conn, ok ? "+" : "-", 1, 0);
+		if (!ok) {
+			return ReadPacket(packet);
+		}
+	}
+	return true;
+}
+
+void GdbStub::SendPacket(std::string_view data)
+{
+	uint8_t sum = 0;
+	for (auto c : data) {
+		sum += static_cast<uint8_t>(c);
+	}
+
+	std::string frame;
+	frame.reserve(data.size() + 4);
+	frame.push_back('$');
+	frame.append(data);
+	frame.push_back('#');
+	frame.push_back(kHex[sum >> 4]);
+	frame.push_back(kHex[sum & 0xF]);
+
+	do
+	{
+		send(m_conn, frame.data(), static_cast<int>(frame.size()), 0);
+		char ack = '+';
+		if (!m_noAck && recv(m_conn, &ack, 1, 0) != 1) {
+			return;
+		}
+		if (ack == '+') {
+			return;
+		}
+	} while (true);
+}
+
+bool GdbStub::Interrupted()
+{
+	fd_set readfds;
+	FD_ZERO(&readfds);
+	FD_SET(m_conn, &readfds);
+	timeval timeout{ 0, 0 };
+	if (select(static_cast<int>(m_conn) + 1, &readfds, nullptr, nullptr, &timeout) <= 0) {
+		return false;
+	}
+
+	char ch;
+	return recv(m_conn, &ch, 1, MSG_PEEK) == 1 && ch == '\x03' && recv(m_conn, &ch, 1, 0) == 1;
+}
+
+std::string GdbStub::StopReply(VirtualMachine::StopReason reason)
+{
+	using Stop = VirtualMachine::StopReason;
+
+	std::string reply;
+	switch (reason)
+	{
+	case Stop::Halted:
+		return "W00";
+	case Stop::Interrupted:
+		return "S02";
+	case Stop::Breakpoint:
+		return "T05swbreak:;";
+	case Stop::Watchpoint:
+		// NOTE: the kind of the access made, gdb matches it with its own
+		// watchpoints at the address
+		reply = m_vm.WatchpointAccess() == Memory::kRead ? "T05rwatch:" : "T05watch:";
+		AppendWord(reply, m_vm.WatchpointAddress());
+		return reply + ";";
+	case Stop::HistoryStart:
+		return "T05replaylog:begin;";
+	case Stop::Stepped:
+	default:
+		return "S05";
+	}
+}
+
+std::string GdbStub::Handle(const std::string& packet)
+{
+	if (packet.empty()) {
+		return {};
+	}
+
+	auto interrupted = [this]() { return Interrupted(); };
+	std::string reply;
+	size_t pos = 1;
+
+	switch (packet[0])
+	{
+	case '?':
+		return "S05";
+	case 'g':
+		for (auto r : kGdbRegisters) {
+			AppendWord(reply, m_vm.GetRegister(r));
+		}
+		return reply;
+	case 'G':
+		for (auto r : kGdbRegisters)
+		{
+			uint16_t word;
+			if (!ParseWord(packet, pos, word)) {
+				return "E01";
+			}
+			m_vm.SetRegister(r, word);
+		}
+		return "OK";
+	case 'p':
+	{
+		auto n = ParseHex(packet, pos);
+		if (n >= std::size(kGdbRegisters)) {
+			return "E01";
+		}
+		AppendWord(reply, m_vm.GetRegister(kGdbRegisters[n]));
+		return reply;
+	}
+	case 'P':
+	{
+		auto n = ParseHex(packet, pos);
+		uint16_t word;
+		if (n >= std::size(kGdbRegisters) || packet[pos++] != '=' || !ParseWord(packet, pos, word)) {
+			return "E01";
+		}
+		m_vm.SetRegister(kGdbRegisters[n], word);
+		return "OK";
+	}
+	case 'm':
+	{
+		auto addr = ParseHex(packet, pos);
+		++pos;
+		auto len = ParseHex(packet, pos);
+		for (uint32_t i = 0; i < len && addr + i <= 0xFFFF; ++i) {
+			AppendWord(reply, m_vm.Peek(static_cast<uint16_t>(addr + i)));
+		}
+		return reply.empty() ? "E01" : reply;
+	}
+	case 'M':
+	{
+		auto addr = ParseHex(packet, pos);
+		++pos;
+		auto len = ParseHex(packet, pos);
+		++pos;
+		for (uint32_t i = 0; i < len; ++i)
+		{
+			uint16_t word;
+			if (!ParseWord(packet, pos, word)) {
+				return "E01";
+			}
+			m_vm.Poke(static_cast<uint16_t>(addr + i), word);
+		}
+		return "OK";
+	}
+	case 'c':
+		if (pos < packet.size()) {
+			m_vm.SetRegister(R::PC, static_cast<uint16_t>(ParseHex(packet, pos)));
+		}
+		return StopReply(m_vm.Continue(interrupted));
+	case 's':
+		if (pos < packet.size()) {
+			m_vm.SetRegister(R::PC, static_cast<uint16_t>(ParseHex(packet, pos)));
+		}
+		return StopReply(m_vm.StepInstruction());
+	case 'b':
+		if (packet == "bs") {
+			return StopReply(m_vm.ReverseStep());
+		}
+		if (packet == "bc") {
+			return StopReply(m_vm.ReverseContinue());
+		}
+		return {};
+	case 'v':
+		if (packet == "vCont?") {
+			return "vCont;c;C;s;S";
+		}
+		if (packet.rfind("vCont;", 0) == 0)
+		{
+			auto action = packet[6];
+			if (action == 'c' || action == 'C') {
+				return StopReply(m_vm.Continue(interrupted));
+			}
+			if (action == 's' || action == 'S') {
+				return StopReply(m_vm.StepInstruction());
+			}
+			return "E01";
+		}
+		if (packet.rfind("vKill", 0) == 0)
+		{
+			m_killed = true;
+			return "OK";
+		}
+		return {};
+	case 'Z':
+	case 'z':
+		return HandleBreakpoint(packet);
+	case 'q':
+	case 'Q':
+		return HandleQuery(packet);
+	case 'H':
+	case 'T':
+		return "OK";
+	case 'D':
+		m_vm.ClearBreakpoints();
+		m_detached = true;
+		return "OK";
+	case 'k':
+		m_killed = true;
+		return {};
+	default:
+		// NOTE: empty reply tells the debugger the packet is not supported
+		return {};
+	}
+}
+
+std::string GdbStub::HandleBreakpoint(const std::string& packet)
+{
+	//format: Z<type>,<addr>,<kind> where kind is the length in words for watchpoints
+	bool insert = packet[0] == 'Z';
+	auto type = packet.size() > 1 ? packet[1] : '?';
+	size_t pos = 3;
+	auto addr = static_cast<uint16_t>(ParseHex(packet, pos));
+	++pos;
+	auto len = static_cast<uint16_t>(ParseHex(packet, pos));
+
+	switch (type)
+	{
+	case '0':
+	case '1':
+		if (insert) {
+			return m_vm.InsertBreakpoint(addr) ? "OK" : "E01";
+		}
+		m_vm.RemoveBreakpoint(addr);
+		return "OK";
+	case '2':
+	case '3':
+	case '4':
+	{
+		auto access = type == '2' ? Memory::kWrite : type == '3' ? Memory::kRead : Memory::kReadWrite;
+		len = len ? len : 1;
+		auto ok = insert ? m_vm.InsertWatchpoint(addr, len, access) : m_vm.RemoveWatchpoint(addr, len, access);
+		return ok ? "OK" : "E01";
+	}
+	default:
+		return {};
+	}
+}
+
+std::string GdbStub::HandleQuery(const std::string& packet)
+{
+	if (packet.rfind("qSupported", 0) == 0) {
+		return "PacketSize=4000;QStartNoAckMode+;swbreak+;ReverseStep+;ReverseContinue+;qXfer:features:read+";
+	}
+	if (packet == "QStartNoAckMode") {
+		return "OK";
+	}
+	if (packet == "qAttached") {
+		return "1";
+	}
+	if (packet == "qC") {
+		return "QC1";
+	}
+	if (packet == "qfThreadInfo") {
+		return "m1";
+	}
+	if (packet == "qsThreadInfo") {
+		return "l";
+	}
+
+	const std::string_view xfer = "qXfer:features:read:target.xml:";
+	if (packet.rfind(xfer, 0) == 0)
+	{
+		size_t pos = xfer.size();
+		auto offset = ParseHex(packet, pos);
+		++pos;
+		auto len = ParseHex(packet, pos);
+
+		std::string_view xml = kTargetXml;
+		if (offset >= xml.size()) {
+			return "l";
+		}
+		auto chunk = xml.substr(offset, len);
+		return (offset + chunk.size() < xml.size() ? "m" : "l") + std::string(chunk);
+	}
+
+	const std::string_view rcmd = "qRcmd,";
+	if (packet.rfind(rcmd, 0) == 0)
+	{
+		std::string command;
+		for (size_t pos = rcmd.size(); pos + 1 < packet.size(); pos += 2)
+		{
+			command.push_back(static_cast<char>(HexDigit(packet[pos]) << 4 | HexDigit(packet[pos + 1])));
+		}
+		return HexText(HandleMonitor(command));
+	}
+	return {};
+}
+
+std::string GdbStub::HandleMonitor(std::string_view command)
+{
+	std::istringstream is{ std::string(command) };
+	std::string verb, arg;
+	is >> verb >> arg;
+
+	auto debug = m_vm.GetDebugInfo();
+	if (verb != "where" && verb != "line" && verb != "symbol") {
+		return "monitor where | line <hex address> | symbol <label>\n";
+	}
+	if (!debug) {
+		return "No debug info loaded\n";
+	}
+
+	uint16_t addr = m_vm.GetRegister(R::PC);
+	if (verb == "symbol")
+	{
+		if (!debug->FindAddress(arg, addr)) {
+			return "No label " + arg + '\n';
+		}
+		std::string out = arg + " = x";
+		AppendWord(out, addr);
+		return out + '\n';
+	}
+	if (verb == "line")
+	{
+		size_t pos = arg.rfind("0x", 0) == 0 ? 2 : !arg.empty() && (arg[0] == 'x' || arg[0] == 'X') ? 1 : 0;
+		addr = static_cast<uint16_t>(ParseHex(arg, pos));
+	}
+	std::string out = "x";
+	AppendWord(out, addr);
+	return out + ' ' + debug->Describe(addr) + '\n';
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "../LC-3.h"
+
+/// <summary>
+/// GDB remote serial protocol server for a <see cref="VirtualMachine"/>.
+/// </summary>
+/// <remarks>
+/// LC-3 is word addressed: addresses and lengths in memory packets count
+/// 16-bit words, and words and registers are sent big-endian, the byte
+/// order of .obj files. Registers are R0-R7, PC and COND in this order.
+/// </remarks>
+class GdbStub
+{
+public:
+	GdbStub(VirtualMachine& vm) : m_vm(vm) {};
+	~GdbStub();
+
+	/// <summary>
+	/// Wait for a debugger to connect on a local TCP port
+	/// </summary>
+	bool Listen(uint16_t port);
+
+	/// <summary>
+	/// Serve debugger requests until it detaches, kills the program or drops
+	/// the connection
+	/// </summary>
+	/// <returns>true if the debugger detached and the program should go on</returns>
+	bool Serve();
+
+private:
+#ifdef WIN32
+	// NOTE: SOCKET, kept out of the header so that <Windows.h> users don't
+	// clash with <winsock2.h>
+	using Socket = uintptr_t;
+#else
+	using Socket = int;
+#endif
+
+	bool ReadPacket(std::string& packet);
+	void SendPacket(std::string_view data);
+	std::string Handle(const std::string& packet);
+	std::string HandleQuery(const std::string& packet);
+	std::string HandleBreakpoint(const std::string& packet);
+	/// <summary>
+	/// "monitor" commands resolving addresses through the debug info
+	/// </summary>
+	std::string HandleMonitor(std::string_view command);
+	std::string StopReply(VirtualMachine::StopReason reason);
+
+	/// <summary>
+	/// Non-blocking check for the ^C interrupt request
+	/// </summary>
+	bool Interrupted();
+
+	VirtualMachine& m_vm;
+	Socket m_listen{ kNoSocket };
+	Socket m_conn{ kNoSocket };
+	bool m_noAck{ false };
+	bool m_detached{ false };
+	bool m_killed{ false };
+
+	inline static const Socket kNoSocket = static_cast<Socket>(-1);
+};
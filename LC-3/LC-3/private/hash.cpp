@@ -0,0 +1,128 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+	const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+	const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+	const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+	const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+	const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+	uint64_t Load64(const uint8_t* p)
+	{
+		uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		if constexpr (std::endian::native == std::endian::big) {
+			v = std::rotl(v, 32);
+			v = ((v & 0x0000FFFF0000FFFFull) << 16) | ((v >> 16) & 0x0000FFFF0000FFFFull);
+			v = ((v & 0x00FF00FF00FF00FFull) << 8) | ((v >> 8) & 0x00FF00FF00FF00FFull);
+		}
+		return v;
+	}
+
+	uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * kPrime2;
+		acc = std::rotl(acc, 31);
+		return acc * kPrime1;
+	}
+
+	uint64_t Merge(uint64_t acc, uint64_t val)
+	{
+		acc ^= Round(0, val);
+		return acc * kPrime1 + kPrime4;
+	}
+
+	uint64_t Avalanche(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= kPrime2;
+		h ^= h >> 29;
+		h *= kPrime3;
+		return h ^ (h >> 32);
+	}
+}
+
+Hasher::Hasher(uint64_t seed) :
+	m_acc{ seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1 },
+	m_seed(seed)
+{
+}
+
+void Hasher::Stripe(const uint8_t* data)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		m_acc[i] = Round(m_acc[i], Load64(data + 8 * i));
+	}
+}
+
+Hasher& Hasher::Update(const void* data, size_t size)
+{
+	auto p = static_cast<const uint8_t*>(data);
+	m_length += size;
+
+	if (m_buffered)
+	{
+		auto take = std::min(size, sizeof(m_buffer) - m_buffered);
+		std::memcpy(m_buffer + m_buffered, p, take);
+		m_buffered += take;
+		p += take;
+		size -= take;
+		if (m_buffered < sizeof(m_buffer)) {
+			return *this;
+		}
+		Stripe(m_buffer);
+		m_buffered = 0;
+	}
+
+	for (; size >= sizeof(m_buffer); p += sizeof(m_buffer), size -= sizeof(m_buffer))
+	{
+		Stripe(p);
+	}
+
+	std::memcpy(m_buffer, p, size);
+	m_buffered = size;
+	return *this;
+}
+
+Hash128 Hasher::Digest() const
+{
+	uint64_t lo;
+	if (m_length >= sizeof(m_buffer))
+	{
+		lo = std::rotl(m_acc[0], 1) + std::rotl(m_acc[1], 7) + std::rotl(m_acc[2], 12) + std::rotl(m_acc[3], 18);
+		for (auto acc : m_acc)
+		{
+			lo = Merge(lo, acc);
+		}
+	}
+	else {
+		lo = m_seed + kPrime5;
+	}
+	lo += m_length;
+
+	// NOTE: the second half folds the accumulators in another order, so it
+	// is not a function of the first
+	uint64_t hi = m_acc[3] ^ std::rotl(m_acc[1], 29) ^ (m_length * kPrime3);
+	hi = Merge(Merge(hi, m_acc[2]), m_acc[0]);
+
+	size_t i = 0;
+	for (; i + 8 <= m_buffered; i += 8)
+	{
+		auto k = Round(0, Load64(m_buffer + i));
+		lo = std::rotl(lo ^ k, 27) * kPrime1 + kPrime4;
+		hi = std::rotl(hi ^ k, 23) * kPrime2 + kPrime3;
+	}
+	for (; i < m_buffered; ++i)
+	{
+		lo = std::rotl(lo ^ (m_buffer[i] * kPrime5), 11) * kPrime1;
+		hi = std::rotl(hi ^ (m_buffer[i] * kPrime1), 13) * kPrime5;
+	}
+
+	return { Avalanche(lo), Avalanche(hi ^ lo) };
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/// <summary>
+/// 128-bit content hash, see <see cref="Hasher"/>
+/// </summary>
+struct Hash128
+{
+	uint64_t lo{ 0 };
+	uint64_t hi{ 0 };
+
+	bool operator==(const Hash128&) const = default;
+};
+
+/// <summary>
+/// Fast non-cryptographic streaming hash in the style of XXH64: four
+/// accumulators over 32-byte stripes, the two halves of the result are
+/// finalized from them independently. Good for content addressing, not
+/// against an adversary.
+/// </summary>
+class Hasher
+{
+public:
+	explicit Hasher(uint64_t seed = 0);
+
+	Hasher& Update(const void* data, size_t size);
+
+	template<typename T>
+	Hasher& Add(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return Update(&value, sizeof(value));
+	};
+
+	/// <summary>
+	/// Hash of everything added so far, more can be added afterwards
+	/// </summary>
+	Hash128 Digest() const;
+
+private:
+	void Stripe(const uint8_t* data);
+
+	uint64_t m_acc[4];
+	uint64_t m_seed;
+	uint64_t m_length{ 0 };
+	uint8_t m_buffer[32];
+	size_t m_buffered{ 0 };
+};
@@ -0,0 +1,112 @@
+#include "hosttraps.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+namespace
+{
+	using ValueType = HostTraps::ValueType;
+	using Registers = HostTraps::Registers;
+
+	ValueType& Reg(Registers& reg, R r)
+	{
+		return reg[static_cast<size_t>(r)];
+	}
+
+	bool Fail(Registers& reg, TR trap, std::string_view message)
+	{
+		std::cerr << "LC-3 VM: " << Str(trap) << ' ' << message << " at x" << std::hex << std::uppercase
+			<< std::setw(4) << std::setfill('0') << static_cast<ValueType>(Reg(reg, R::PC) - 1)
+			<< std::dec << std::nouppercase << std::setfill(' ') << '\n';
+		return false;
+	}
+
+	bool Mul(Registers& reg, Memory&)
+	{
+		Reg(reg, R::R0) = HostTraps::Multiply(Reg(reg, R::R0), Reg(reg, R::R1));
+		HostTraps::SetFlags(reg, Reg(reg, R::R0));
+		return true;
+	}
+
+	bool Div(Registers& reg, Memory&)
+	{
+		if (!HostTraps::Divide(Reg(reg, R::R0), Reg(reg, R::R1))) {
+			return Fail(reg, TR::DIV, "by zero");
+		}
+		HostTraps::SetFlags(reg, Reg(reg, R::R0));
+		return true;
+	}
+
+	bool MemCpy(Registers& reg, Memory& mem)
+	{
+		if (!mem.Copy(Reg(reg, R::R0), Reg(reg, R::R1), Reg(reg, R::R2))) {
+			return Fail(reg, TR::MEMCPY, "past RAM");
+		}
+		return true;
+	}
+
+	bool MemSet(Registers& reg, Memory& mem)
+	{
+		if (!mem.Set(Reg(reg, R::R0), Reg(reg, R::R2), Reg(reg, R::R1))) {
+			return Fail(reg, TR::MEMSET, "past RAM");
+		}
+		return true;
+	}
+
+	bool StrCmp(Registers& reg, Memory& mem)
+	{
+		int order;
+		if (!mem.Compare(Reg(reg, R::R0), Reg(reg, R::R1), order)) {
+			return Fail(reg, TR::STRCMP, "past RAM");
+		}
+		Reg(reg, R::R0) = static_cast<ValueType>(order);
+		HostTraps::SetFlags(reg, Reg(reg, R::R0));
+		return true;
+	}
+}
+
+HostTraps::HostTraps()
+{
+	m_table[static_cast<size_t>(TR::MUL)] = Mul;
+	m_table[static_cast<size_t>(TR::DIV)] = Div;
+	m_table[static_cast<size_t>(TR::MEMCPY)] = MemCpy;
+	m_table[static_cast<size_t>(TR::MEMSET)] = MemSet;
+	m_table[static_cast<size_t>(TR::STRCMP)] = StrCmp;
+}
+
+std::shared_ptr<const HostTraps> HostTraps::BuiltIn()
+{
+	static const auto builtIn = std::make_shared<const HostTraps>();
+	return builtIn;
+}
+
+bool HostTraps::Register(ValueType vector, Function fn)
+{
+	if (vector > 0xFF || (vector >= static_cast<ValueType>(TR::FIRST) && vector < static_cast<ValueType>(TR::FIRST_HOST)))
+	{
+		std::cerr << "LC-3 VM: TRAP x" << std::hex << std::uppercase << vector << std::dec << std::nouppercase
+			<< " can't run a host function\n";
+		return false;
+	}
+	m_table[vector] = std::move(fn);
+	return true;
+}
+
+bool HostTraps::Divide(ValueType& r0, ValueType& r1)
+{
+	auto dividend = static_cast<int16_t>(r0);
+	auto divisor = static_cast<int16_t>(r1);
+	if (!divisor) {
+		return false;
+	}
+	// NOTE: INT16_MIN / -1 overflows, in 32 bits it wraps back to INT16_MIN
+	r0 = static_cast<ValueType>(int32_t(dividend) / divisor);
+	r1 = static_cast<ValueType>(int32_t(dividend) % divisor);
+	return true;
+}
+
+void HostTraps::SetFlags(Registers& reg, ValueType value)
+{
+	Reg(reg, R::COND) = static_cast<ValueType>(value == 0 ? FL::ZRO : (value >> 15 ? FL::NEG : FL::POS));
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "identifiers.h"
+#include "memory.h"
+
+/// <summary>
+/// Host functions behind TRAP vectors the LC-3 OS leaves unused, so that
+/// guests call multiply, divide or block moves instead of looping over
+/// shifts and adds or LDR/STR pairs.
+/// </summary>
+/// <remarks>
+/// The built-in helpers from TR::FIRST_HOST on are registered at
+/// construction. Helpers stop the program with a message on bad arguments:
+/// a zero divisor, a range reaching the device page.
+/// </remarks>
+class HostTraps
+{
+public:
+	using ValueType = Memory::ValueType;
+	using Registers = std::array<ValueType, static_cast<size_t>(R::NREG)>;
+	/// <summary>
+	/// Called with PC past the TRAP instruction, sets the flags itself
+	/// when it should
+	/// </summary>
+	/// <returns>false when the program stops</returns>
+	using Function = std::function<bool(Registers& reg, Memory& mem)>;
+
+	HostTraps();
+
+	/// <summary>
+	/// The table of the built-in helpers, shared by machines until one
+	/// registers a function of its own
+	/// </summary>
+	static std::shared_ptr<const HostTraps> BuiltIn();
+
+	/// <summary>
+	/// Run fn for TRAP vector, replacing the function there if any. The
+	/// vectors of the LC-3 OS routines are refused.
+	/// </summary>
+	/// <remarks>
+	/// Translated code only sees stores of fn done through Memory::Fill,
+	/// Copy and Set.
+	/// </remarks>
+	bool Register(ValueType vector, Function fn);
+	void Unregister(ValueType vector) { m_table[vector & 0xFF] = nullptr; };
+
+	bool Has(ValueType vector) const { return static_cast<bool>(m_table[vector & 0xFF]); };
+	bool Call(ValueType vector, Registers& reg, Memory& mem) const { return m_table[vector & 0xFF](reg, mem); };
+
+	/// <summary>
+	/// Arithmetic of the built-in MUL and DIV, shared with the machines
+	/// that have no Memory. Divide leaves the quotient in r0 and the
+	/// remainder in r1, truncating toward zero: x8000 / -1 is x8000 with
+	/// no remainder. It fails on a zero divisor.
+	/// </summary>
+	static ValueType Multiply(ValueType a, ValueType b) { return static_cast<ValueType>(uint32_t(a) * b); };
+	static bool Divide(ValueType& r0, ValueType& r1);
+
+	static void SetFlags(Registers& reg, ValueType value);
+
+private:
+	std::array<Function, 256> m_table;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#include "identifiers.h"
+#include "memory.h"
+
+/// <summary>
+/// Recognizes a guest spinning on a fixed point: a KBSR poll that found no
+/// key or a branch to itself, reached again with the same registers and
+/// no store or trap since the last time.
+/// </summary>
+/// <remarks>
+/// Every iteration of such a loop leaves the machine exactly as it found
+/// it, so any number of them can be skipped by advancing the instruction
+/// count by a multiple of the period.
+/// </remarks>
+class IdleLoop
+{
+public:
+	using ValueType = Memory::ValueType;
+	using Registers = std::array<ValueType, static_cast<size_t>(R::NREG)>;
+
+	/// <summary>
+	/// Iterations seen before the loop is taken for idle
+	/// </summary>
+	inline static const uint32_t kSpins = 16;
+
+	/// <summary>
+	/// The guest is at a spin point
+	/// </summary>
+	/// <param name="pc">address of the polling or branching instruction</param>
+	/// <param name="tick">its instruction number</param>
+	/// <returns>true once the same iteration has repeated kSpins times</returns>
+	bool Spin(ValueType pc, uint64_t tick, const Registers& regs)
+	{
+		bool same = !m_touched && pc == m_pc && regs == m_regs && tick - m_tick == m_period;
+		m_touched = false;
+		if (!same)
+		{
+			m_period = tick - m_tick;
+			m_spins = 0;
+			m_pc = pc;
+			m_regs = regs;
+		}
+		m_tick = tick;
+		return same && ++m_spins >= kSpins;
+	};
+
+	/// <summary>
+	/// Instructions per iteration of the detected loop
+	/// </summary>
+	uint64_t Period() const { return m_period; };
+
+	/// <summary>
+	/// The instruction count was advanced by whole iterations
+	/// </summary>
+	void Skip(uint64_t n) { m_tick += n; };
+
+	/// <summary>
+	/// A store or a trap happened, the loop has side effects
+	/// </summary>
+	void Touch() { m_touched = true; };
+
+private:
+	ValueType m_pc{ 0 };
+	uint64_t m_tick{ 0 };
+	uint64_t m_period{ 0 };
+	uint32_t m_spins{ 0 };
+	bool m_touched{ true };
+	Registers m_regs{};
+};
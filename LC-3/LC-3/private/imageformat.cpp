@@ -0,0 +1,324 @@
+#include "imageformat.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	const size_t kMemorySize = size_t(1) << 16;
+
+	// NOTE: digits are checked and converted eight at a time, as the bytes
+	// of a 64-bit word with the first character in the lowest byte
+	const uint64_t kOnes = 0x0101010101010101;
+	const uint64_t kHigh = kOnes * 0x80;
+	const uint64_t kZeros = kOnes * '0';
+
+	/// <summary>
+	/// Up to 8 characters, right aligned on '0' characters so that fewer
+	/// digits keep their value
+	/// </summary>
+	uint64_t Chars(const char* p, size_t count)
+	{
+		uint64_t v = 0;
+		if (count == 8 && std::endian::native == std::endian::little)
+		{
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			v |= uint64_t(static_cast<uint8_t>(p[i])) << (8 * i);
+		}
+		return count < 8 ? (v << (8 * (8 - count))) | (kZeros >> (8 * count)) : v;
+	}
+
+	/// <summary>
+	/// High bit of each byte set where lo &lt;= byte &lt;= hi, for bytes
+	/// below 0x80
+	/// </summary>
+	uint64_t InRange(uint64_t v, uint8_t lo, uint8_t hi)
+	{
+		return ((v | kHigh) - kOnes * lo) & ~(v + kOnes * (0x7F - hi)) & kHigh;
+	}
+
+	/// <summary>
+	/// Eight hex digits to the two words they spell
+	/// </summary>
+	bool Hex8(uint64_t v, uint16_t& first, uint16_t& second)
+	{
+		if (v & kHigh) {
+			return false;
+		}
+		if ((InRange(v, '0', '9') | InRange(v | (kOnes * 0x20), 'a', 'f')) != kHigh) {
+			return false;
+		}
+		// NOTE: letters have bit 6 set and are worth their low nibble + 9
+		auto nibbles = (v & (kOnes * 0x0F)) + ((v >> 6) & kOnes) * 9;
+		auto bytes = ((nibbles << 4) | (nibbles >> 8)) & 0x00FF00FF00FF00FF;
+		auto words = ((bytes << 8) | (bytes >> 16)) & 0x0000FFFF0000FFFF;
+		first = static_cast<uint16_t>(words);
+		second = static_cast<uint16_t>(words >> 32);
+		return true;
+	}
+
+	bool Hex(const char* p, size_t count, uint16_t& word)
+	{
+		uint16_t high;
+		return Hex8(Chars(p, count), high, word);
+	}
+
+	/// <summary>
+	/// Eight binary digits to the byte they spell, the first one is the
+	/// most significant bit
+	/// </summary>
+	bool Bin8(uint64_t v, uint8_t& byte)
+	{
+		if ((v & ~kOnes) != kZeros) {
+			return false;
+		}
+		byte = static_cast<uint8_t>(((v & kOnes) * 0x8040201008040201) >> 56);
+		return true;
+	}
+
+	bool Bin16(std::string_view line, uint16_t& word)
+	{
+		uint8_t high, low;
+		if (line.size() != 16 || !Bin8(Chars(line.data(), 8), high) || !Bin8(Chars(line.data() + 8, 8), low)) {
+			return false;
+		}
+		word = static_cast<uint16_t>(high << 8 | low);
+		return true;
+	}
+
+	bool Hex4(std::string_view line, uint16_t& word)
+	{
+		return line.size() == 4 && Hex(line.data(), 4, word);
+	}
+
+	/// <summary>
+	/// Lines of a text image, blank ones skipped
+	/// </summary>
+	class Lines
+	{
+	public:
+		explicit Lines(std::string_view text) : m_text(text) {};
+
+		bool Next(std::string_view& line)
+		{
+			while (m_pos < m_text.size())
+			{
+				auto end = m_text.find('\n', m_pos);
+				end = end == std::string_view::npos ? m_text.size() : end;
+				line = m_text.substr(m_pos, end - m_pos);
+				m_pos = end + 1;
+				++m_number;
+				if (!line.empty() && line.back() == '\r') {
+					line.remove_suffix(1);
+				}
+				if (!line.empty()) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		/// <summary>
+		/// The next count characters, nullptr when fewer are left
+		/// </summary>
+		const char* Ahead(size_t count) const
+		{
+			return m_pos + count <= m_text.size() ? m_text.data() + m_pos : nullptr;
+		};
+		void Skip(size_t count, size_t lines)
+		{
+			m_pos += count;
+			m_number += lines;
+		};
+
+		bool Error(const char* message) const
+		{
+			std::cerr << "Image line " << m_number << ": " << message << '\n';
+			return false;
+		};
+
+	private:
+		std::string_view m_text;
+		size_t m_pos{ 0 };
+		size_t m_number{ 0 };
+	};
+
+	bool ParseObj(std::string_view image, uint16_t* memory, std::vector<ImageSegment>& segments)
+	{
+		if (image.size() < 2)
+		{
+			std::cerr << "The image has no origin\n";
+			return false;
+		}
+		auto bytes = reinterpret_cast<const uint8_t*>(image.data());
+		auto origin = static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+		// NOTE: LC-3 program size is limited
+		auto size = std::min((image.size() - 2) / 2, kMemorySize - origin);
+		for (size_t i = 0; i < size; ++i)
+		{
+			memory[origin + i] = static_cast<uint16_t>(bytes[2 + 2 * i] << 8 | bytes[3 + 2 * i]);
+		}
+		segments.push_back({ origin, size });
+		return true;
+	}
+
+	bool ParseWords(std::string_view image, bool binary, uint16_t* memory, std::vector<ImageSegment>& segments)
+	{
+		Lines lines(image);
+		std::string_view line;
+		uint16_t origin;
+		if (!lines.Next(line)) {
+			return lines.Error("the image has no origin");
+		}
+		if (!(binary ? Bin16(line, origin) : Hex4(line, origin))) {
+			return lines.Error(binary ? "not 16 binary digits" : "not 4 hex digits");
+		}
+
+		size_t size = 0;
+		bool valid = true;
+		// NOTE: lines of exactly the digits and '\n' don't need their end
+		// searched, two hex words or one binary word are taken at once
+		while (origin + size + 2 <= kMemorySize)
+		{
+			auto p = lines.Ahead(binary ? 17 : 10);
+			uint16_t first, second;
+			uint8_t high, low;
+			if (!p) {
+				break;
+			}
+			if (binary && p[16] == '\n' && Bin8(Chars(p, 8), high) && Bin8(Chars(p + 8, 8), low))
+			{
+				memory[origin + size++] = static_cast<uint16_t>(high << 8 | low);
+				lines.Skip(17, 1);
+			}
+			else if (!binary && p[4] == '\n' && p[9] == '\n' &&
+				Hex8((Chars(p, 8) & 0xFFFFFFFF) | ((Chars(p + 2, 8) >> 24) << 32), first, second))
+			{
+				memory[origin + size++] = first;
+				memory[origin + size++] = second;
+				lines.Skip(10, 2);
+			}
+			else {
+				break;
+			}
+		}
+		while (valid && lines.Next(line))
+		{
+			uint16_t word;
+			if (!(binary ? Bin16(line, word) : Hex4(line, word))) {
+				valid = lines.Error(binary ? "not 16 binary digits" : "not 4 hex digits");
+			}
+			else if (origin + size >= kMemorySize) {
+				valid = lines.Error("past the end of memory");
+			}
+			else {
+				memory[origin + size++] = word;
+			}
+		}
+		// NOTE: listed even when malformed, the words before are in memory
+		segments.push_back({ origin, size });
+		return valid;
+	}
+
+	bool ParseIntelHex(std::string_view image, uint16_t* memory, std::vector<ImageSegment>& segments)
+	{
+		Lines lines(image);
+		std::string_view line;
+		uint16_t data[128];
+		while (lines.Next(line))
+		{
+			uint16_t head[2];
+			if (line.size() < 11 || line[0] != ':' || !Hex8(Chars(line.data() + 1, 8), head[0], head[1])) {
+				return lines.Error("not a record");
+			}
+			size_t count = head[0] >> 8;
+			auto addr = static_cast<uint16_t>(head[0] << 8 | head[1] >> 8);
+			auto type = head[1] & 0xFF;
+			if (line.size() != 11 + 2 * count) {
+				return lines.Error("record length doesn't match its byte count");
+			}
+
+			unsigned sum = (head[0] >> 8) + (head[0] & 0xFF) + (head[1] >> 8) + (head[1] & 0xFF);
+			auto digits = line.data() + 9;
+			size_t words = count / 2;
+			size_t i = 0;
+			for (; i + 2 <= words; i += 2)
+			{
+				if (!Hex8(Chars(digits + 4 * i, 8), data[i], data[i + 1])) {
+					return lines.Error("not hex data");
+				}
+			}
+			if (i < words && !Hex(digits + 4 * i, 4, data[i])) {
+				return lines.Error("not hex data");
+			}
+			for (i = 0; i < words; ++i)
+			{
+				sum += (data[i] >> 8) + (data[i] & 0xFF);
+			}
+			uint16_t checksum;
+			if (!Hex(digits + 2 * count, 2, checksum) || ((sum + checksum) & 0xFF)) {
+				return lines.Error("bad checksum");
+			}
+
+			if (type == 1) {
+				return true;
+			}
+			if (type != 0 || count % 2) {
+				return lines.Error("only data records of whole words and the end record are supported");
+			}
+			if (addr + words > kMemorySize) {
+				return lines.Error("past the end of memory");
+			}
+			std::copy(data, data + words, memory + addr);
+			if (words) {
+				segments.push_back({ addr, words });
+			}
+		}
+		return lines.Error("no end record");
+	}
+}
+
+ImageFormat DetectFormat(std::string_view image)
+{
+	// NOTE: lc3-asm images start with a binary origin, text images with
+	// digits and a line end. A binary image reading as text would need its
+	// origin and first words all made of digit characters.
+	auto line = image.substr(0, std::min(image.find('\n'), image.size()));
+	if (!line.empty() && line.back() == '\r') {
+		line.remove_suffix(1);
+	}
+
+	uint16_t word, high;
+	if (line.size() >= 11 && line[0] == ':' && Hex8(Chars(line.data() + 1, 8), high, word)) {
+		return ImageFormat::IntelHex;
+	}
+	if (Hex4(line, word)) {
+		return ImageFormat::Hex;
+	}
+	if (Bin16(line, word)) {
+		return ImageFormat::Bin;
+	}
+	return ImageFormat::Obj;
+}
+
+bool ParseImage(std::string_view image, ImageFormat format, uint16_t* memory, std::vector<ImageSegment>& segments)
+{
+	switch (format)
+	{
+	case ImageFormat::Hex:
+		return ParseWords(image, false, memory, segments);
+	case ImageFormat::Bin:
+		return ParseWords(image, true, memory, segments);
+	case ImageFormat::IntelHex:
+		return ParseIntelHex(image, memory, segments);
+	case ImageFormat::Obj:
+	default:
+		return ParseObj(image, memory, segments);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Layouts of program images the loader accepts, told apart by their
+/// content.
+/// </summary>
+/// <remarks>
+/// Obj: big-endian words, the origin first, as lc3-asm writes them.
+/// Hex: text, the origin then one word per line as 4 hex digits.
+/// Bin: text, the origin then one word per line as 16 binary digits.
+/// IntelHex: records ":LLAAAATT data CC" as in Intel HEX, but AAAA is a
+/// word address and the data are big-endian words. Type 00 records hold
+/// data, type 01 ends the image, CC makes the record bytes sum to zero.
+/// Every data record is a segment of its own.
+/// </remarks>
+enum class ImageFormat
+{
+	Obj,
+	Hex,
+	Bin,
+	IntelHex
+};
+
+struct ImageSegment
+{
+	uint16_t origin;
+	size_t size;
+};
+
+/// <summary>
+/// Format of image, from its first line
+/// </summary>
+ImageFormat DetectFormat(std::string_view image);
+
+/// <summary>
+/// Parse image straight into memory, 64 Ki words, and list the segments
+/// written in the order they were found
+/// </summary>
+/// <returns>false on malformed text or segments past the end of memory,
+/// some words may have been written already</returns>
+bool ParseImage(std::string_view image, ImageFormat format, uint16_t* memory, std::vector<ImageSegment>& segments);
@@ -0,0 +1,170 @@
+#include "journal.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	const char kMagic[4] = { 'L', 'C', '3', 'J' };
+	// NOTE: version 2 counts ticks in retired instructions
+	const char kVersion = 2;
+
+	void WriteVarint(std::ostream& os, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			os.put(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		os.put(static_cast<char>(value));
+	}
+
+	bool ReadVarint(const std::vector<char>& buf, size_t& pos, uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; pos < buf.size() && shift < 64; shift += 7)
+		{
+			auto byte = static_cast<uint8_t>(buf[pos++]);
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+void InputJournal::Close()
+{
+	m_mode = Mode::Off;
+	m_events.clear();
+	m_cursor = 0;
+	m_lastTick = 0;
+	m_path.clear();
+	if (m_os.is_open()) {
+		m_os.close();
+	}
+}
+
+bool InputJournal::Open(const std::filesystem::path& path, Mode mode)
+{
+	m_mode = Mode::Off;
+	m_events.clear();
+	m_cursor = 0;
+	m_lastTick = 0;
+	m_path.clear();
+
+	if (mode == Mode::Record && !path.empty())
+	{
+		m_path = path;
+		if (!Create()) {
+			return false;
+		}
+	}
+	else if (mode == Mode::Replay)
+	{
+		std::ifstream is(path, std::ios::in | std::ios::binary);
+		if (!is) {
+			std::cerr << "Can't open input journal " << path << '\n';
+			return false;
+		}
+
+		std::vector<char> buf{ std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+		if (buf.size() < sizeof(kMagic) + 1 ||
+			!std::equal(std::begin(kMagic), std::end(kMagic), buf.begin()) ||
+			buf[sizeof(kMagic)] != kVersion)
+		{
+			std::cerr << "Bad input journal " << path << '\n';
+			return false;
+		}
+
+		size_t pos = sizeof(kMagic) + 1;
+		uint64_t tick = 0;
+		while (pos < buf.size())
+		{
+			uint64_t head;
+			if (!ReadVarint(buf, pos, head) || pos >= buf.size()) {
+				std::cerr << "Input journal " << path << " is truncated\n";
+				break;
+			}
+			tick += head >> 1;
+			m_events.push_back({ tick, static_cast<Kind>(head & 1), buf[pos++] });
+		}
+	}
+
+	m_mode = mode;
+	return true;
+}
+
+void InputJournal::Append(const Event& event)
+{
+	if (m_mode != Mode::Record) {
+		return;
+	}
+
+	if (m_cursor < m_events.size()) {
+		Truncate();
+	}
+
+	m_events.push_back(event);
+	m_cursor = m_events.size();
+
+	if (!m_os.is_open()) {
+		return;
+	}
+
+	Write(event);
+	// NOTE: events are rare (key presses), flushing keeps the log usable
+	// when the session is killed
+	m_os.flush();
+}
+
+bool InputJournal::Create()
+{
+	if (m_os.is_open()) {
+		m_os.close();
+	}
+	m_os.open(m_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!m_os) {
+		std::cerr << "Can't create input journal " << m_path << '\n';
+		return false;
+	}
+	m_os.write(kMagic, sizeof(kMagic));
+	m_os.put(kVersion);
+	m_os.flush();
+	return true;
+}
+
+void InputJournal::Write(const Event& event)
+{
+	WriteVarint(m_os, ((event.tick - m_lastTick) << 1) | static_cast<uint64_t>(event.kind));
+	m_os.put(event.ch);
+	m_lastTick = event.tick;
+}
+
+void InputJournal::Truncate()
+{
+	// NOTE: the session diverged from the events recorded past the rewind
+	// point, they are dropped from memory and from the file
+	m_events.resize(m_cursor);
+	if (m_path.empty() || !Create()) {
+		return;
+	}
+	m_lastTick = 0;
+	for (const auto& event : m_events) {
+		Write(event);
+	}
+}
+
+const InputJournal::Event* InputJournal::Peek() const
+{
+	return m_cursor < m_events.size() ? &m_events[m_cursor] : nullptr;
+}
+
+void InputJournal::Rewind(uint64_t tick)
+{
+	auto it = std::lower_bound(m_events.begin(), m_events.end(), tick,
+		[](const Event& event, uint64_t t) { return event.tick < t; });
+	m_cursor = std::distance(m_events.begin(), it);
+}
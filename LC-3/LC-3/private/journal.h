@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+
+/// <summary>
+/// Log of nondeterministic input events, used to record a guest session
+/// and to replay it later without a terminal.
+/// </summary>
+/// <remarks>
+/// File layout: "LC3J", format version byte, then one record per event:
+/// varint((tick delta << 1) | kind) followed by the character byte.
+/// Tick is the number of instructions retired when the event happened.
+/// </remarks>
+class InputJournal
+{
+public:
+	enum class Mode { Off, Record, Replay };
+
+	enum class Kind : uint8_t
+	{
+		KeyReady, /* KBSR poll found a pressed key */
+		Char      /* GETC/IN trap consumed a character */
+	};
+
+	struct Event
+	{
+		uint64_t tick;
+		Kind kind;
+		char ch;
+	};
+
+	/// <summary>
+	/// Start recording or replaying. Recording with an empty path keeps
+	/// events in memory only.
+	/// </summary>
+	bool Open(const std::filesystem::path& path, Mode mode);
+	Mode GetMode() const { return m_mode; };
+
+	/// <summary>
+	/// Stop recording or replaying and drop the events
+	/// </summary>
+	void Close();
+
+	void Append(const Event& event);
+
+	/// <summary>
+	/// Next event to be replayed or nullptr when the journal is exhausted
+	/// </summary>
+	const Event* Peek() const;
+	void Pop() { ++m_cursor; };
+
+	/// <summary>
+	/// Move the replay cursor back to the first event at or after tick.
+	/// In record mode the events past the cursor are replayed before
+	/// recording resumes, the first new event drops those left over.
+	/// </summary>
+	void Rewind(uint64_t tick);
+
+private:
+	bool Create();
+	void Write(const Event& event);
+	void Truncate();
+
+	Mode m_mode{ Mode::Off };
+	std::filesystem::path m_path;
+	std::ofstream m_os;
+	std::vector<Event> m_events;
+	size_t m_cursor{ 0 };
+	uint64_t m_lastTick{ 0 };
+};
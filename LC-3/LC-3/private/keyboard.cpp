@@ -0,0 +1,221 @@
+#include "keyboard.h"
+
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#ifdef WIN32
+#include <Windows.h>
+#include <conio.h>  // _kbhit
+#else
+#include <sys/select.h>
+#include <unistd.h>
+#endif // WIN32
+
+namespace
+{
+	bool CheckKey()
+	{
+#ifdef WIN32
+		HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+		return WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit();
+#else
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(STDIN_FILENO, &readfds);
+		timeval timeout{ 0, 0 };
+		return select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &timeout) > 0;
+#endif // WIN32
+	}
+
+	void WaitForKey(std::chrono::milliseconds timeout)
+	{
+#ifdef WIN32
+		HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+		WaitForSingleObject(hStdin, static_cast<DWORD>(timeout.count()));
+#else
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(STDIN_FILENO, &readfds);
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
+		timeval tv{ static_cast<time_t>(us / 1000000), static_cast<suseconds_t>(us % 1000000) };
+		select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &tv);
+#endif // WIN32
+	}
+}
+
+bool Keyboard::Record(const std::filesystem::path& path)
+{
+	return m_journal.Open(path, InputJournal::Mode::Record);
+}
+
+bool Keyboard::Replay(const std::filesystem::path& path)
+{
+	return m_journal.Open(path, InputJournal::Mode::Replay);
+}
+
+void Keyboard::Feed(std::string input)
+{
+	m_input = std::move(input);
+	m_inputPos = 0;
+	m_fed = true;
+	m_starved = false;
+}
+
+void Keyboard::Reset()
+{
+	m_journal.Close();
+	m_starved = false;
+	m_fed = false;
+	m_input.clear();
+	m_inputPos = 0;
+	m_blocked = {};
+}
+
+bool Keyboard::Take(char& ch)
+{
+	if (m_inputPos == m_input.size())
+	{
+		m_starved = true;
+		return false;
+	}
+	ch = m_input[m_inputPos++];
+	return true;
+}
+
+void Keyboard::KeepHistory()
+{
+	if (m_journal.GetMode() == InputJournal::Mode::Off) {
+		m_journal.Open({}, InputJournal::Mode::Record);
+	}
+}
+
+void Keyboard::Rewind(uint64_t tick)
+{
+	m_journal.Rewind(tick);
+	m_starved = false;
+}
+
+const InputJournal::Event* Keyboard::Expect(InputJournal::Kind kind)
+{
+	auto event = m_journal.Peek();
+	if (event && event->kind != kind)
+	{
+		std::cerr << "Replay diverged at instruction " << Now() << '\n';
+		return nullptr;
+	}
+	return event;
+}
+
+bool Keyboard::Poll(char& ch)
+{
+	if (auto event = m_journal.Peek())
+	{
+		// NOTE: a recorded key arrives exactly at the instruction it was seen,
+		// polls in between are answered "not ready" without touching the host
+		if (event->kind != InputJournal::Kind::KeyReady || event->tick > Now()) {
+			return false;
+		}
+		ch = event->ch;
+		m_journal.Pop();
+		return true;
+	}
+
+	if (IsReplaying())
+	{
+		m_starved = true;
+		return false;
+	}
+
+	if (m_fed)
+	{
+		if (!Take(ch)) {
+			return false;
+		}
+	}
+	else if (!CheckKey()) {
+		return false;
+	}
+	else {
+		std::cin.read(&ch, sizeof(ch));
+	}
+	m_journal.Append({ Now(), InputJournal::Kind::KeyReady, ch });
+	return true;
+}
+
+bool Keyboard::NextKeyTick(uint64_t& tick) const
+{
+	if (auto event = m_journal.Peek())
+	{
+		// NOTE: polls never take a key meant for GETC/IN
+		tick = event->kind == InputJournal::Kind::KeyReady ? event->tick : kNever;
+		return true;
+	}
+	if (IsReplaying())
+	{
+		tick = kNever;
+		return true;
+	}
+	if (m_fed)
+	{
+		tick = m_inputPos < m_input.size() ? 0 : kNever;
+		return true;
+	}
+	return false;
+}
+
+void Keyboard::WaitKey(std::chrono::milliseconds timeout)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (m_fed || IsReplaying()) {
+		std::this_thread::sleep_for(timeout);
+	}
+	else {
+		WaitForKey(timeout);
+	}
+	m_blocked += std::chrono::steady_clock::now() - start;
+}
+
+char Keyboard::GetChar(bool discardLine)
+{
+	char c{ 0 };
+
+	if (auto event = Expect(InputJournal::Kind::Char))
+	{
+		c = event->ch;
+		m_journal.Pop();
+		return c;
+	}
+
+	if (IsReplaying())
+	{
+		m_starved = true;
+		return c;
+	}
+
+	if (m_fed)
+	{
+		// NOTE: fed input has no pending terminal line to discard
+		if (!Take(c)) {
+			return c;
+		}
+	}
+	else
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (discardLine) {
+			std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		}
+		bool read = static_cast<bool>(std::cin.get(c));
+		m_blocked += std::chrono::steady_clock::now() - start;
+		if (!read)
+		{
+			// NOTE: the end of input stops the program as fed input running
+			// out does, nothing is journaled
+			m_starved = true;
+			return 0;
+		}
+	}
+	m_journal.Append({ Now(), InputJournal::Kind::Char, c });
+	return c;
+}
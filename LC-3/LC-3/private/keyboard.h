@@ -0,0 +1,102 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "journal.h"
+
+/// <summary>
+/// Keyboard device: the only source of nondeterministic guest input.
+/// Every key delivered to the guest passes through here, so sessions
+/// can be recorded to and replayed from an <see cref="InputJournal"/>.
+/// </summary>
+class Keyboard
+{
+public:
+	/// <summary>
+	/// Instruction counter used to tag journal events
+	/// </summary>
+	void SetClock(const uint64_t* clock) { m_clock = clock; };
+
+	bool Record(const std::filesystem::path& path);
+	bool Replay(const std::filesystem::path& path);
+	bool IsReplaying() const { return m_journal.GetMode() == InputJournal::Mode::Replay; };
+
+	/// <summary>
+	/// Take keys from a fixed string instead of the terminal, every poll
+	/// finds the next key ready. Batch runs use it to get reproducible
+	/// sessions without a journal.
+	/// </summary>
+	void Feed(std::string input);
+
+	/// <summary>
+	/// Forget input, journal, history and blocked time, the clock is kept
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Replay has consumed the whole journal or the fed input and the guest
+	/// asked for more
+	/// </summary>
+	bool Starved() const { return m_starved; };
+
+	/// <summary>
+	/// Keep delivered keys in memory even when not recording to a file,
+	/// so that a rewound session gets the same input again
+	/// </summary>
+	void KeepHistory();
+
+	/// <summary>
+	/// Deliver the keys recorded from tick onwards again
+	/// </summary>
+	void Rewind(uint64_t tick);
+
+	/// <summary>
+	/// Non-blocking check used by KBSR reads
+	/// </summary>
+	/// <param name="ch">pressed key when available</param>
+	/// <returns>true if a key is pressed</returns>
+	bool Poll(char& ch);
+
+	/// <summary>
+	/// Blocking read used by GETC/IN traps
+	/// </summary>
+	/// <param name="discardLine">drop pending input up to the end of line first</param>
+	char GetChar(bool discardLine = false);
+
+	/// <summary>
+	/// Instruction count at which a KBSR poll finds the next key, known in
+	/// advance for fed and replayed input
+	/// </summary>
+	/// <param name="tick">kNever when no key will come</param>
+	/// <returns>false when the next key is up to the user</returns>
+	bool NextKeyTick(uint64_t& tick) const;
+
+	/// <summary>
+	/// Block until a key is pressed or timeout has passed, the key is left
+	/// for the next poll
+	/// </summary>
+	void WaitKey(std::chrono::milliseconds timeout);
+
+	/// <summary>
+	/// Time spent waiting for the terminal or for WaitKey since the last
+	/// Reset
+	/// </summary>
+	std::chrono::nanoseconds Blocked() const { return m_blocked; };
+
+	inline static const uint64_t kNever = ~uint64_t(0);
+
+private:
+	uint64_t Now() const { return m_clock ? *m_clock : 0; };
+	const InputJournal::Event* Expect(InputJournal::Kind kind);
+	bool Take(char& ch);
+
+	const uint64_t* m_clock{ nullptr };
+	bool m_starved{ false };
+	bool m_fed{ false };
+	std::string m_input;
+	size_t m_inputPos{ 0 };
+	InputJournal m_journal;
+	std::chrono::nanoseconds m_blocked{ 0 };
+};
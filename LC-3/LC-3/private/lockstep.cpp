@@ -0,0 +1,719 @@
+#include "lockstep.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "hosttraps.h"
+#include "masks.h"
+
+namespace
+{
+	using ValueType = LockstepMachine::ValueType;
+
+	// NOTE: LC-3 memory mapped registers
+	const ValueType KBSR = 0xFE00; // keyboard status
+	const ValueType KBDR = 0xFE02; // keyboard data
+
+	/// <summary>
+	/// Lanes per vector register, lane arrays are padded to a multiple of it
+	/// </summary>
+	const size_t kVectorLanes = 16;
+
+	ValueType Flags(ValueType v)
+	{
+		return static_cast<ValueType>(v == 0 ? FL::ZRO : (v >> 15 ? FL::NEG : FL::POS));
+	}
+
+	// NOTE: kernels apply to the lanes whose mask is 0xFFFF and leave the
+	// others untouched. The portable loops are branch free so that compilers
+	// vectorize them for whatever the target has (AVX-512 included), the
+	// AVX2 paths don't depend on it.
+#if defined(__AVX2__)
+	__m256i Load(const ValueType* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	void Store(ValueType* p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+	/// <summary>
+	/// mask ? a : b
+	/// </summary>
+	__m256i Select(__m256i mask, __m256i a, __m256i b) { return _mm256_blendv_epi8(b, a, mask); }
+
+	__m256i Flags(__m256i v)
+	{
+		auto neg = _mm256_srai_epi16(v, 15);
+		auto zero = _mm256_cmpeq_epi16(v, _mm256_setzero_si256());
+		auto pos = _mm256_andnot_si256(_mm256_or_si256(neg, zero), _mm256_set1_epi16(static_cast<short>(FL::POS)));
+		return _mm256_or_si256(pos, _mm256_or_si256(
+			_mm256_and_si256(neg, _mm256_set1_epi16(static_cast<short>(FL::NEG))),
+			_mm256_and_si256(zero, _mm256_set1_epi16(static_cast<short>(FL::ZRO)))));
+	}
+#endif
+
+	enum class Alu { Add, And, Not };
+
+	/// <summary>
+	/// dst = a op (b or imm), COND updated
+	/// </summary>
+	void AluLanes(Alu op, ValueType* dst, const ValueType* a, const ValueType* b, ValueType imm,
+		ValueType* cond, const ValueType* mask, size_t n)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		auto vimm = _mm256_set1_epi16(static_cast<short>(imm));
+		for (; i + kVectorLanes <= n; i += kVectorLanes)
+		{
+			auto va = Load(a + i);
+			auto vb = b ? Load(b + i) : vimm;
+			auto r = op == Alu::Add ? _mm256_add_epi16(va, vb) :
+				op == Alu::And ? _mm256_and_si256(va, vb) :
+				_mm256_xor_si256(va, _mm256_set1_epi16(-1));
+			auto m = Load(mask + i);
+			Store(dst + i, Select(m, r, Load(dst + i)));
+			Store(cond + i, Select(m, Flags(r), Load(cond + i)));
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			ValueType vb = b ? b[i] : imm;
+			ValueType r = op == Alu::Add ? a[i] + vb : op == Alu::And ? a[i] & vb : ~a[i];
+			ValueType m = mask[i];
+			dst[i] = (r & m) | (dst[i] & ~m);
+			cond[i] = (Flags(r) & m) | (cond[i] & ~m);
+		}
+	}
+
+	/// <summary>
+	/// BR: pc += offset where COND matches nzp
+	/// </summary>
+	void BranchLanes(ValueType nzp, ValueType offset, ValueType* pc, const ValueType* cond,
+		const ValueType* mask, size_t n)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		auto vnzp = _mm256_set1_epi16(static_cast<short>(nzp));
+		auto voff = _mm256_set1_epi16(static_cast<short>(offset));
+		auto zero = _mm256_setzero_si256();
+		for (; i + kVectorLanes <= n; i += kVectorLanes)
+		{
+			auto match = _mm256_cmpeq_epi16(_mm256_and_si256(Load(cond + i), vnzp), zero);
+			auto taken = _mm256_andnot_si256(match, Load(mask + i));
+			Store(pc + i, _mm256_add_epi16(Load(pc + i), _mm256_and_si256(taken, voff)));
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			ValueType taken = (cond[i] & nzp) ? mask[i] : 0;
+			pc[i] += offset & taken;
+		}
+	}
+
+	/// <summary>
+	/// JMP/JSR/JSRR: pc = target or pc + offset, link = old pc if given
+	/// </summary>
+	void JumpLanes(const ValueType* target, ValueType offset, ValueType* pc, ValueType* link,
+		const ValueType* mask, size_t n)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		auto voff = _mm256_set1_epi16(static_cast<short>(offset));
+		for (; i + kVectorLanes <= n; i += kVectorLanes)
+		{
+			auto m = Load(mask + i);
+			auto from = Load(pc + i);
+			auto to = target ? Load(target + i) : _mm256_add_epi16(from, voff);
+			Store(pc + i, Select(m, to, from));
+			if (link) {
+				Store(link + i, Select(m, from, Load(link + i)));
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			ValueType m = mask[i];
+			ValueType from = pc[i];
+			ValueType to = target ? target[i] : from + offset;
+			pc[i] = (to & m) | (from & ~m);
+			if (link) {
+				link[i] = (from & m) | (link[i] & ~m);
+			}
+		}
+	}
+}
+
+LockstepMachine::LockstepMachine(const Memory& image, size_t lanes, ValueType pc) :
+	m_lanes(lanes),
+	m_entry(pc),
+	m_stride((lanes + kVectorLanes - 1) / kVectorLanes * kVectorLanes),
+	m_reg(8 * m_stride),
+	m_pc(m_stride, pc),
+	m_cond(m_stride),
+	m_mask(m_stride),
+	m_halted(m_stride),
+	m_countLow(m_stride),
+	m_countHigh(m_stride),
+	m_wait(m_stride),
+	m_leader(lanes),
+	m_image(std::make_unique<ValueType[]>(Memory::kMemorySize)),
+	m_pages(lanes * Memory::kPageCount),
+	m_private(lanes * Memory::kPageCount),
+	m_patched(Memory::kMemorySize),
+	m_input(lanes),
+	m_inputPos(lanes),
+	m_output(lanes),
+	m_starved(lanes),
+	m_metrics(lanes)
+{
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		auto data = image.Page(page);
+		std::copy(data, data + Memory::kPageSize, m_image.get() + page * Memory::kPageSize);
+	}
+	for (size_t lane = 0; lane < lanes; ++lane)
+	{
+		for (size_t page = 0; page < Memory::kPageCount; ++page)
+		{
+			m_pages[lane * Memory::kPageCount + page] = m_image.get() + page * Memory::kPageSize;
+		}
+	}
+	// NOTE: padding lanes never run
+	std::fill(m_halted.begin() + lanes, m_halted.end(), 0xFFFF);
+}
+
+LockstepMachine::ValueType LockstepMachine::Register(size_t lane, R r) const
+{
+	switch (r)
+	{
+	case R::PC:
+		return m_pc[lane];
+	case R::COND:
+		return m_cond[lane];
+	default:
+		return m_reg[static_cast<size_t>(r) * m_stride + lane];
+	}
+}
+
+void LockstepMachine::Restart(size_t lane, std::string input)
+{
+	for (ValueType r = 0; r < 8; ++r)
+	{
+		Reg(lane, r) = 0;
+	}
+	m_pc[lane] = m_entry;
+	m_cond[lane] = 0;
+	m_halted[lane] = 0;
+	m_countLow[lane] = 0;
+	m_countHigh[lane] = 0;
+
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		auto index = lane * Memory::kPageCount + page;
+		if (m_private[index])
+		{
+			for (size_t addr = page * Memory::kPageSize; addr < (page + 1) * Memory::kPageSize; ++addr)
+			{
+				m_patched[addr] -= Fetch(lane, static_cast<ValueType>(addr)) != m_image[addr];
+			}
+			m_private[index].reset();
+			m_pages[index] = m_image.get() + page * Memory::kPageSize;
+		}
+	}
+
+	if (m_starved[lane]) {
+		--m_starvedLanes;
+	}
+	m_starved[lane] = 0;
+	m_input[lane] = std::move(input);
+	m_inputPos[lane] = 0;
+	m_output[lane].clear();
+	m_metrics[lane] = VmMetrics();
+}
+
+VmMetrics LockstepMachine::Metrics(size_t lane) const
+{
+	auto metrics = m_metrics[lane];
+	metrics.instructions = InstructionCount(lane);
+	metrics.tier = EngineTier::Lockstep;
+	return metrics;
+}
+
+void LockstepMachine::Run(const std::function<void(size_t)>& stopped)
+{
+	while (Step())
+	{
+		if (m_stopped.empty() || !stopped) {
+			continue;
+		}
+		// NOTE: the callback may restart lanes, which shouldn't be reported
+		// again
+		auto lanes = std::move(m_stopped);
+		m_stopped.clear();
+		for (auto lane : lanes)
+		{
+			stopped(lane);
+		}
+	}
+	if (stopped)
+	{
+		for (auto lane : m_stopped)
+		{
+			stopped(lane);
+		}
+	}
+	m_stopped.clear();
+}
+
+void LockstepMachine::Stop(size_t lane)
+{
+	m_halted[lane] = 0xFFFF;
+	m_stopped.push_back(lane);
+}
+
+template<typename F>
+void LockstepMachine::ForGroup(F f)
+{
+	// NOTE: walk the set bits of the mask instead of testing every lane,
+	// groups are often a small part of the lanes
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + kVectorLanes <= m_stride; i += kVectorLanes)
+	{
+		auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(Load(m_mask.data() + i))) & 0x55555555u;
+		for (; bits; bits &= bits - 1)
+		{
+			f(i + std::countr_zero(bits) / 2);
+		}
+	}
+#endif
+	for (; i < m_stride; ++i)
+	{
+		if (m_mask[i]) {
+			f(i);
+		}
+	}
+}
+
+size_t LockstepMachine::Schedule(ValueType& pc)
+{
+	// NOTE: one pass finds the lowest PC and ages the lanes left out of the
+	// previous step. Stopped lanes read as PC 0xFFFF, a running lane at
+	// 0xFFFF is told apart by the mask below.
+	size_t i = 0;
+	ValueType low = 0xFFFF;
+	ValueType oldest = 0;
+#if defined(__AVX2__)
+	auto vlow = _mm256_set1_epi16(-1);
+	auto vold = _mm256_setzero_si256();
+	for (; i + kVectorLanes <= m_stride; i += kVectorLanes)
+	{
+		auto halted = Load(m_halted.data() + i);
+		vlow = _mm256_min_epu16(vlow, _mm256_or_si256(Load(m_pc.data() + i), halted));
+		auto wait = _mm256_adds_epu16(Load(m_wait.data() + i), _mm256_set1_epi16(1));
+		wait = _mm256_andnot_si256(_mm256_or_si256(Load(m_mask.data() + i), halted), wait);
+		Store(m_wait.data() + i, wait);
+		vold = _mm256_max_epu16(vold, wait);
+	}
+	auto half = _mm_min_epu16(_mm256_castsi256_si128(vlow), _mm256_extracti128_si256(vlow, 1));
+	low = static_cast<ValueType>(_mm_extract_epi16(_mm_minpos_epu16(half), 0));
+	half = _mm_max_epu16(_mm256_castsi256_si128(vold), _mm256_extracti128_si256(vold, 1));
+	// NOTE: max as the complement of the min of complements
+	oldest = static_cast<ValueType>(~_mm_extract_epi16(_mm_minpos_epu16(_mm_xor_si128(half, _mm_set1_epi16(-1))), 0));
+#endif
+	for (; i < m_stride; ++i)
+	{
+		low = std::min<ValueType>(low, m_pc[i] | m_halted[i]);
+		ValueType wait = m_wait[i] + (m_wait[i] != 0xFFFF);
+		m_wait[i] = wait & ~(m_mask[i] | m_halted[i]);
+		oldest = std::max(oldest, m_wait[i]);
+	}
+
+	// NOTE: the lowest PC makes lanes that split on a branch meet again, but
+	// a lane that left a loop waits for every lane still in it. Once a lane
+	// waited too long it leads for a while, possibly into the loop group.
+	if (m_leader < m_lanes && (m_halted[m_leader] || !m_burst)) {
+		m_leader = m_lanes;
+	}
+	if (m_leader == m_lanes && oldest >= kPatience)
+	{
+		m_leader = std::find(m_wait.begin(), m_wait.end(), oldest) - m_wait.begin();
+		m_burst = kBurst;
+	}
+	if (m_leader < m_lanes)
+	{
+		low = m_pc[m_leader];
+		--m_burst;
+	}
+
+	size_t group = 0;
+	i = 0;
+#if defined(__AVX2__)
+	auto vpc = _mm256_set1_epi16(static_cast<short>(low));
+	for (; i + kVectorLanes <= m_stride; i += kVectorLanes)
+	{
+		auto m = _mm256_andnot_si256(Load(m_halted.data() + i), _mm256_cmpeq_epi16(Load(m_pc.data() + i), vpc));
+		Store(m_mask.data() + i, m);
+		group += std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(m))) / 2;
+	}
+#endif
+	for (; i < m_stride; ++i)
+	{
+		m_mask[i] = (m_pc[i] == low) ? static_cast<ValueType>(~m_halted[i]) : 0;
+		group += m_mask[i] & 1;
+	}
+
+	pc = low;
+	return group;
+}
+
+size_t LockstepMachine::Filter(ValueType pc, ValueType& instr)
+{
+	size_t group = 0;
+	bool shared = m_patched[pc] == 0;
+	bool first = true;
+
+	ForGroup([&](size_t lane) {
+		// NOTE: the VM stops a starved program on its housekeeping tick
+		if (m_starved[lane] && !m_countLow[lane])
+		{
+			Stop(lane);
+			m_mask[lane] = 0;
+			return;
+		}
+
+		// NOTE: self-modifying lanes may hold other code here, they run
+		// on a later step as their own group
+		if (!shared)
+		{
+			auto code = Fetch(lane, pc);
+			if (first) {
+				instr = code;
+			}
+			else if (code != instr)
+			{
+				m_mask[lane] = 0;
+				return;
+			}
+		}
+		first = false;
+		++group;
+	});
+	return group;
+}
+
+bool LockstepMachine::Step()
+{
+	ValueType pc;
+	auto group = Schedule(pc);
+	if (!group) {
+		return false;
+	}
+
+	ValueType instr = m_image[pc];
+	if (m_starvedLanes || m_patched[pc])
+	{
+		group = Filter(pc, instr);
+		if (!group) {
+			return true;
+		}
+	}
+
+	++m_steps;
+	m_retired += group;
+
+	const auto* mask = m_mask.data();
+	ValueType wrapped = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	auto vwrapped = _mm256_setzero_si256();
+	for (; i + kVectorLanes <= m_stride; i += kVectorLanes)
+	{
+		auto one = _mm256_srli_epi16(Load(mask + i), 15);
+		Store(m_pc.data() + i, _mm256_add_epi16(Load(m_pc.data() + i), one));
+		auto count = _mm256_add_epi16(Load(m_countLow.data() + i), one);
+		Store(m_countLow.data() + i, count);
+		vwrapped = _mm256_or_si256(vwrapped, _mm256_and_si256(one, _mm256_cmpeq_epi16(count, _mm256_setzero_si256())));
+	}
+	wrapped = !_mm256_testz_si256(vwrapped, vwrapped);
+#endif
+	for (; i < m_stride; ++i)
+	{
+		ValueType one = mask[i] & 1;
+		m_pc[i] += one;
+		m_countLow[i] += one;
+		wrapped |= one & (m_countLow[i] == 0);
+	}
+	if (wrapped)
+	{
+		ForGroup([this](size_t lane) {
+			m_countHigh[lane] += !m_countLow[lane];
+		});
+	}
+
+	auto reg = [this](ValueType r) { return m_reg.data() + r * m_stride; };
+
+	switch (masks::OpCode(instr))
+	{
+	case OP::ADD:
+	case OP::AND:
+	{
+		auto op = masks::OpCode(instr) == OP::ADD ? Alu::Add : Alu::And;
+		auto src2 = masks::IsImmediate(instr) ? nullptr : reg(masks::SR2(instr));
+		AluLanes(op, reg(masks::DR(instr)), reg(masks::SR1(instr)), src2, masks::Imm5(instr),
+			m_cond.data(), mask, m_stride);
+	}
+	break;
+	case OP::NOT:
+		AluLanes(Alu::Not, reg(masks::DR(instr)), reg(masks::SR1(instr)), nullptr, 0,
+			m_cond.data(), mask, m_stride);
+		break;
+	case OP::LEA:
+		AluLanes(Alu::Add, reg(masks::DR(instr)), m_pc.data(), nullptr, masks::PCOffset9(instr),
+			m_cond.data(), mask, m_stride);
+		break;
+	case OP::BR:
+		BranchLanes(masks::NZP(instr), masks::PCOffset9(instr), m_pc.data(), m_cond.data(), mask, m_stride);
+		break;
+	case OP::JMP:
+		JumpLanes(reg(masks::BaseR(instr)), 0, m_pc.data(), nullptr, mask, m_stride);
+		break;
+	case OP::JSR:
+		JumpLanes(masks::IsJsrOffset(instr) ? nullptr : reg(masks::BaseR(instr)), masks::PCOffset11(instr),
+			m_pc.data(), reg(static_cast<ValueType>(R::R7)), mask, m_stride);
+		break;
+	default:
+		ForGroup([this, instr](size_t lane) {
+			ExecuteLane(lane, instr);
+		});
+		break;
+	}
+	return true;
+}
+
+void LockstepMachine::ExecuteLane(size_t lane, ValueType instr)
+{
+	auto pc = m_pc[lane];
+
+	switch (masks::OpCode(instr))
+	{
+	case OP::LD:
+		Reg(lane, masks::DR(instr)) = Read(lane, pc + masks::PCOffset9(instr));
+		SetFlags(lane, Reg(lane, masks::DR(instr)));
+		break;
+	case OP::LDI:
+		Reg(lane, masks::DR(instr)) = Read(lane, Read(lane, pc + masks::PCOffset9(instr)));
+		SetFlags(lane, Reg(lane, masks::DR(instr)));
+		break;
+	case OP::LDR:
+		Reg(lane, masks::DR(instr)) = Read(lane, Reg(lane, masks::BaseR(instr)) + masks::Offset6(instr));
+		SetFlags(lane, Reg(lane, masks::DR(instr)));
+		break;
+	case OP::ST:
+		Write(lane, pc + masks::PCOffset9(instr), Reg(lane, masks::SR(instr)));
+		break;
+	case OP::STI:
+		Write(lane, Read(lane, pc + masks::PCOffset9(instr)), Reg(lane, masks::SR(instr)));
+		break;
+	case OP::STR:
+		Write(lane, Reg(lane, masks::BaseR(instr)) + masks::Offset6(instr), Reg(lane, masks::SR(instr)));
+		break;
+	case OP::TRAP:
+		Trap(lane, masks::TrapVect8(instr));
+		break;
+	case OP::RTI:
+	case OP::RES:
+	default:
+		Stop(lane);
+		break;
+	}
+}
+
+void LockstepMachine::Trap(size_t lane, ValueType vector)
+{
+	auto& out = m_output[lane];
+	auto& r0 = Reg(lane, static_cast<ValueType>(R::R0));
+	++m_metrics[lane].traps[vector];
+
+	switch (static_cast<TR>(vector))
+	{
+	case TR::IN:
+	case TR::GETC:
+	{
+		if (static_cast<TR>(vector) == TR::IN) {
+			out += "Enter a character: ";
+		}
+		char c{ 0 };
+		if (m_inputPos[lane] < m_input[lane].size()) {
+			c = m_input[lane][m_inputPos[lane]++];
+		}
+		else if (!m_starved[lane])
+		{
+			m_starved[lane] = 1;
+			++m_starvedLanes;
+		}
+		if (static_cast<TR>(vector) == TR::IN) {
+			out += c;
+		}
+		r0 = static_cast<ValueType>(c);
+		SetFlags(lane, r0);
+	}
+	break;
+	case TR::OUT:
+		out += static_cast<char>(r0);
+		break;
+	case TR::PUTS:
+		for (ValueType addr = r0; auto ch = Fetch(lane, addr); ++addr)
+		{
+			out += static_cast<char>(ch);
+		}
+		break;
+	case TR::PUTSP:
+		for (ValueType addr = r0; auto ch = Fetch(lane, addr); ++addr)
+		{
+			out += static_cast<char>(ch & 0xFF);
+			if (ch >> 8) {
+				out += static_cast<char>(ch >> 8);
+			}
+		}
+		break;
+	case TR::HALT:
+		out += "HALT\n";
+		Stop(lane);
+		break;
+	case TR::MUL:
+		r0 = HostTraps::Multiply(r0, Reg(lane, static_cast<ValueType>(R::R1)));
+		SetFlags(lane, r0);
+		break;
+	case TR::DIV:
+		if (!HostTraps::Divide(r0, Reg(lane, static_cast<ValueType>(R::R1))))
+		{
+			Stop(lane);
+			break;
+		}
+		SetFlags(lane, r0);
+		break;
+	case TR::MEMCPY:
+	case TR::MEMSET:
+	case TR::STRCMP:
+		if (!Bulk(lane, static_cast<TR>(vector))) {
+			Stop(lane);
+		}
+		break;
+	default:
+		Stop(lane);
+		break;
+	}
+}
+
+bool LockstepMachine::Bulk(size_t lane, TR trap)
+{
+	auto& r0 = Reg(lane, static_cast<ValueType>(R::R0));
+	auto r1 = Reg(lane, static_cast<ValueType>(R::R1));
+	size_t count = Reg(lane, static_cast<ValueType>(R::R2));
+
+	// NOTE: word by word through the lane's pages, as Memory::Copy, Set and
+	// Compare would do it
+	switch (trap)
+	{
+	case TR::MEMCPY:
+		if (!Memory::InRam(r0, count) || !Memory::InRam(r1, count)) {
+			return false;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto at = r0 <= r1 ? i : count - 1 - i;
+			SetWord(lane, static_cast<ValueType>(r0 + at), Fetch(lane, static_cast<ValueType>(r1 + at)));
+		}
+		return true;
+	case TR::MEMSET:
+		if (!Memory::InRam(r0, count)) {
+			return false;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			SetWord(lane, static_cast<ValueType>(r0 + i), r1);
+		}
+		return true;
+	case TR::STRCMP:
+		for (ValueType a = r0, b = r1; a < Memory::kDeviceBase && b < Memory::kDeviceBase; ++a, ++b)
+		{
+			auto x = Fetch(lane, a);
+			auto y = Fetch(lane, b);
+			if (x != y || !x)
+			{
+				r0 = static_cast<ValueType>((x > y) - (x < y));
+				SetFlags(lane, r0);
+				return true;
+			}
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+void LockstepMachine::SetFlags(size_t lane, ValueType value)
+{
+	m_cond[lane] = Flags(value);
+}
+
+LockstepMachine::ValueType LockstepMachine::Read(size_t lane, ValueType addr)
+{
+	if (addr >= Memory::kDeviceBase) {
+		++m_metrics[lane].deviceReads;
+	}
+	if (addr == KBSR)
+	{
+		char ch;
+		if (Poll(lane, ch))
+		{
+			SetWord(lane, KBSR, 1 << 15);
+			SetWord(lane, KBDR, static_cast<uint8_t>(ch));
+		}
+		else {
+			SetWord(lane, KBSR, 0);
+		}
+	}
+	return Fetch(lane, addr);
+}
+
+void LockstepMachine::Write(size_t lane, ValueType addr, ValueType val)
+{
+	if (addr >= Memory::kDeviceBase) {
+		++m_metrics[lane].deviceWrites;
+	}
+	SetWord(lane, addr, val);
+}
+
+void LockstepMachine::SetWord(size_t lane, ValueType addr, ValueType val)
+{
+	auto page = addr >> Memory::kPageBits;
+	auto& data = m_pages[lane * Memory::kPageCount + page];
+	auto shared = m_image.get() + page * Memory::kPageSize;
+	if (data == shared)
+	{
+		auto& copy = m_private[lane * Memory::kPageCount + page];
+		copy = std::make_unique<ValueType[]>(Memory::kPageSize);
+		std::copy(shared, shared + Memory::kPageSize, copy.get());
+		data = copy.get();
+	}
+	auto& word = data[addr & (Memory::kPageSize - 1)];
+	m_patched[addr] += (val != m_image[addr]) - (word != m_image[addr]);
+	word = val;
+}
+
+bool LockstepMachine::Poll(size_t lane, char& ch)
+{
+	if (m_inputPos[lane] < m_input[lane].size())
+	{
+		ch = m_input[lane][m_inputPos[lane]++];
+		return true;
+	}
+	if (!m_starved[lane])
+	{
+		m_starved[lane] = 1;
+		++m_starvedLanes;
+	}
+	return false;
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "identifiers.h"
+#include "memory.h"
+#include "metrics.h"
+
+/// <summary>
+/// Runs one program on many independent inputs, each guest instance is a
+/// lane of struct-of-arrays registers.
+/// </summary>
+/// <remarks>
+/// Every step picks the lowest PC among the running lanes and executes its
+/// instruction for all lanes at that PC under a lane mask. Lanes that took
+/// different branches wait until the others catch up with them, so loops
+/// and if/else arms reconverge. Register instructions and branches run as
+/// vector kernels (AVX2 when compiled for it), memory accesses and traps
+/// go lane by lane. Memory is the loaded image shared by all lanes, a lane
+/// gets its own copy of a page on the first store to it.
+///
+/// Lanes behave exactly as a <see cref="VirtualMachine"/> fed with the same
+/// input: same output, registers and instruction count.
+/// </remarks>
+class LockstepMachine
+{
+public:
+	using ValueType = Memory::ValueType;
+
+	LockstepMachine(const Memory& image, size_t lanes, ValueType pc = 0x3000);
+
+	size_t Lanes() const { return m_lanes; };
+
+	/// <summary>
+	/// Keyboard input of a lane, the lane stops once it wants more
+	/// </summary>
+	void SetInput(size_t lane, std::string input) { m_input[lane] = std::move(input); };
+	const std::string& Output(size_t lane) const { return m_output[lane]; };
+
+	ValueType Register(size_t lane, R r) const;
+	/// <summary>
+	/// Memory of a lane as its program sees it
+	/// </summary>
+	ValueType Peek(size_t lane, ValueType addr) const { return Fetch(lane, addr); };
+	uint64_t InstructionCount(size_t lane) const
+	{
+		return (m_countHigh[lane] << 16) | m_countLow[lane];
+	};
+	bool Halted(size_t lane) const { return m_halted[lane] != 0; };
+
+	/// <summary>
+	/// Counters of the run in a lane, since construction or its last
+	/// Restart
+	/// </summary>
+	VmMetrics Metrics(size_t lane) const;
+
+	/// <summary>
+	/// Start the program over in a stopped lane with new input
+	/// </summary>
+	void Restart(size_t lane, std::string input);
+
+	/// <summary>
+	/// Execute the instruction at the lowest PC for all lanes sitting on it
+	/// </summary>
+	/// <returns>false when every lane has stopped</returns>
+	bool Step();
+
+	/// <summary>
+	/// Run until every lane has stopped. A lane that stops is handed to
+	/// stopped(lane) which may <see cref="Restart"/> it, so long batches keep
+	/// all lanes busy instead of waiting for the slowest run of each chunk.
+	/// </summary>
+	void Run(const std::function<void(size_t)>& stopped = {});
+
+	/// <summary>
+	/// Steps taken and lane instructions retired by them, their ratio is the
+	/// average number of lanes sharing an instruction
+	/// </summary>
+	uint64_t Steps() const { return m_steps; };
+	uint64_t Retired() const { return m_retired; };
+
+private:
+	ValueType& Reg(size_t lane, ValueType r) { return m_reg[r * m_stride + lane]; };
+
+	/// <summary>
+	/// Mask the lanes sitting on the lowest PC
+	/// </summary>
+	/// <returns>number of lanes in the group</returns>
+	size_t Schedule(ValueType& pc);
+
+	/// <summary>
+	/// Drop lanes of the group which can't run now: stopped for lack of
+	/// input or holding other code at pc than the first lane of the group
+	/// </summary>
+	/// <param name="instr">instruction of the remaining lanes</param>
+	/// <returns>number of remaining lanes</returns>
+	size_t Filter(ValueType pc, ValueType& instr);
+
+	/// <summary>
+	/// Call f(lane) for the lanes of the current group
+	/// </summary>
+	template<typename F>
+	void ForGroup(F f);
+
+	void Stop(size_t lane);
+	void ExecuteLane(size_t lane, ValueType instr);
+	void Trap(size_t lane, ValueType vector);
+	/// <summary>
+	/// Built-in MEMCPY, MEMSET and STRCMP helpers, false on a range that
+	/// reaches the device page
+	/// </summary>
+	bool Bulk(size_t lane, TR trap);
+	void SetFlags(size_t lane, ValueType value);
+
+	ValueType Fetch(size_t lane, ValueType addr) const
+	{
+		return m_pages[lane * Memory::kPageCount + (addr >> Memory::kPageBits)][addr & (Memory::kPageSize - 1)];
+	};
+	ValueType Read(size_t lane, ValueType addr);
+	void Write(size_t lane, ValueType addr, ValueType val);
+	/// <summary>
+	/// Store without counting a device access, for device side effects
+	/// </summary>
+	void SetWord(size_t lane, ValueType addr, ValueType val);
+	bool Poll(size_t lane, char& ch);
+
+	size_t m_lanes;
+	ValueType m_entry;
+	/// <summary>
+	/// Lane count rounded up to the vector width
+	/// </summary>
+	size_t m_stride;
+
+	/// <summary>
+	/// R0-R7 as [register][lane], PC and COND as [lane]
+	/// </summary>
+	std::vector<ValueType> m_reg;
+	std::vector<ValueType> m_pc;
+	std::vector<ValueType> m_cond;
+	/// <summary>
+	/// 0xFFFF for lanes in the current group, resp. for stopped lanes
+	/// </summary>
+	std::vector<ValueType> m_mask;
+	std::vector<ValueType> m_halted;
+	/// <summary>
+	/// Instruction counters split so that the per-step increment stays in
+	/// 16-bit vector lanes, the high part is bumped on wrap around. The low
+	/// part wraps on the VM housekeeping period, starved lanes stop there.
+	/// </summary>
+	std::vector<ValueType> m_countLow;
+	std::vector<uint64_t> m_countHigh;
+	std::vector<size_t> m_stopped;
+
+	/// <summary>
+	/// Steps since each lane last ran, and the lane leading the schedule
+	/// out of turn (m_lanes when none) for m_burst more steps
+	/// </summary>
+	std::vector<ValueType> m_wait;
+	size_t m_leader;
+	size_t m_burst{ 0 };
+	inline static const ValueType kPatience = 256;
+	inline static const size_t kBurst = 64;
+
+	std::unique_ptr<ValueType[]> m_image;
+	/// <summary>
+	/// Page tables as [lane][page] pointing to the image or to the private
+	/// copy of the page at the same index
+	/// </summary>
+	std::vector<ValueType*> m_pages;
+	std::vector<std::unique_ptr<ValueType[]>> m_private;
+	/// <summary>
+	/// Number of lanes holding another value than the image at each address,
+	/// the instruction of a group is checked lane by lane only there
+	/// </summary>
+	std::vector<uint32_t> m_patched;
+
+	std::vector<std::string> m_input;
+	std::vector<size_t> m_inputPos;
+	std::vector<std::string> m_output;
+	std::vector<uint8_t> m_starved;
+	size_t m_starvedLanes{ 0 };
+	/// <summary>
+	/// Traps and device accesses as [lane], only lanes taking the scalar
+	/// path touch them
+	/// </summary>
+	std::vector<VmMetrics> m_metrics;
+
+	uint64_t m_steps{ 0 };
+	uint64_t m_retired{ 0 };
+};
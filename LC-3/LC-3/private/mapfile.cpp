@@ -0,0 +1,185 @@
+#include "mapfile.h"
+
+#include <iostream>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // WIN32
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::filesystem::path& path, size_t minSize)
+{
+	Close();
+	m_readOnly = false;
+
+#ifdef WIN32
+	m_file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+#else
+	m_fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (m_fd < 0)
+#endif // WIN32
+	{
+		std::cerr << "Can't open " << path << '\n';
+		return false;
+	}
+
+	// NOTE: two processes creating the file race on its size, the lock
+	// makes one of them see the other's
+	Guard guard(*this, true);
+	auto size = FileSize();
+	if (size < minSize) {
+		return Resize(minSize);
+	}
+	return Map(size);
+}
+
+bool MappedFile::OpenRead(const std::filesystem::path& path)
+{
+	Close();
+	m_readOnly = true;
+
+#ifdef WIN32
+	m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+#else
+	m_fd = open(path.c_str(), O_RDONLY);
+	if (m_fd < 0)
+#endif // WIN32
+	{
+		std::cerr << "Can't open " << path << '\n';
+		return false;
+	}
+	return Map(FileSize());
+}
+
+void MappedFile::Close()
+{
+	Unmap();
+#ifdef WIN32
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+#endif // WIN32
+}
+
+size_t MappedFile::FileSize() const
+{
+#ifdef WIN32
+	LARGE_INTEGER size;
+	return GetFileSizeEx(m_file, &size) ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+	struct stat st;
+	return fstat(m_fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+#endif // WIN32
+}
+
+bool MappedFile::Resize(size_t size)
+{
+	Unmap();
+#ifdef WIN32
+	LARGE_INTEGER end;
+	end.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+#else
+	if (ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+#endif // WIN32
+	{
+		std::cerr << "Can't grow mapped file to " << size << " bytes\n";
+		return false;
+	}
+	return Map(size);
+}
+
+bool MappedFile::Refresh()
+{
+	auto size = FileSize();
+	if (size == m_size) {
+		return true;
+	}
+	Unmap();
+	return Map(size);
+}
+
+bool MappedFile::Map(size_t size)
+{
+	if (!size) {
+		return false;
+	}
+#ifdef WIN32
+	m_mapping = CreateFileMappingW(m_file, nullptr, m_readOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, nullptr);
+	if (m_mapping) {
+		m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, m_readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, size));
+	}
+#else
+	auto p = mmap(nullptr, size, m_readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	m_data = p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+#endif // WIN32
+	if (!m_data)
+	{
+		std::cerr << "Can't map " << size << " bytes of file\n";
+		return false;
+	}
+	m_size = size;
+	return true;
+}
+
+void MappedFile::Unmap()
+{
+#ifdef WIN32
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+#else
+	if (m_data) {
+		munmap(m_data, m_size);
+	}
+#endif // WIN32
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void MappedFile::Lock(bool exclusive)
+{
+#ifdef WIN32
+	OVERLAPPED overlapped{};
+	LockFileEx(m_file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+	flock(m_fd, exclusive ? LOCK_EX : LOCK_SH);
+#endif // WIN32
+}
+
+void MappedFile::Unlock()
+{
+#ifdef WIN32
+	OVERLAPPED overlapped{};
+	UnlockFileEx(m_file, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+	flock(m_fd, LOCK_UN);
+#endif // WIN32
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/// <summary>
+/// A file mapped read-write into memory and shared with other processes
+/// mapping it, with a whole-file advisory lock to coordinate them.
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	/// <summary>
+	/// Open or create the file, growing it to at least minSize zero bytes
+	/// </summary>
+	bool Open(const std::filesystem::path& path, size_t minSize);
+	/// <summary>
+	/// Map an existing file for reading only, Data() must not be written
+	/// </summary>
+	bool OpenRead(const std::filesystem::path& path);
+	void Close();
+
+	uint8_t* Data() const { return m_data; };
+	size_t Size() const { return m_size; };
+
+	/// <summary>
+	/// Grow the file, the mapping may move
+	/// </summary>
+	bool Resize(size_t size);
+
+	/// <summary>
+	/// Map again when another process has grown the file
+	/// </summary>
+	bool Refresh();
+
+	void Lock(bool exclusive);
+	void Unlock();
+
+	/// <summary>
+	/// Lock held for a scope
+	/// </summary>
+	class Guard
+	{
+	public:
+		Guard(MappedFile& file, bool exclusive) : m_file(file) { m_file.Lock(exclusive); };
+		~Guard() { m_file.Unlock(); };
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+
+	private:
+		MappedFile& m_file;
+	};
+
+private:
+	bool Map(size_t size);
+	void Unmap();
+	size_t FileSize() const;
+
+#ifdef WIN32
+	void* m_file{ reinterpret_cast<void*>(-1) };
+	void* m_mapping{ nullptr };
+#else
+	int m_fd{ -1 };
+#endif // WIN32
+	uint8_t* m_data{ nullptr };
+	size_t m_size{ 0 };
+	bool m_readOnly{ false };
+};
@@ -1,2 +1,37 @@
 #pragma once
+#include <cstdint>
 
+#include "identifiers.h"
+
+/// <summary>
+/// Instruction field decoders, see the bit layouts next to the handlers
+/// in LC-3.cpp
+/// </summary>
+namespace masks
+{
+	constexpr uint16_t SignExtend(uint16_t x, int bit_count)
+	{
+		return ((x >> (bit_count - 1)) & 1) ? static_cast<uint16_t>(x | (0xFFFF << bit_count)) : x;
+	}
+
+	constexpr OP OpCode(uint16_t instr) { return static_cast<OP>(instr >> 12); }
+	constexpr uint16_t DR(uint16_t instr) { return (instr >> 9) & 0b111; }
+	constexpr uint16_t SR(uint16_t instr) { return (instr >> 9) & 0b111; }
+	constexpr uint16_t SR1(uint16_t instr) { return (instr >> 6) & 0b111; }
+	constexpr uint16_t BaseR(uint16_t instr) { return (instr >> 6) & 0b111; }
+	constexpr uint16_t SR2(uint16_t instr) { return instr & 0b111; }
+	constexpr bool IsImmediate(uint16_t instr) { return instr & (1 << 5); }
+	constexpr uint16_t NZP(uint16_t instr) { return (instr >> 9) & 0b111; }
+	constexpr bool IsJsrOffset(uint16_t instr) { return instr & (1 << 11); }
+	constexpr uint16_t TrapVect8(uint16_t instr) { return instr & 0xFF; }
+
+	constexpr uint16_t Imm5(uint16_t instr) { return SignExtend(instr & 0x1F, 5); }
+	constexpr uint16_t Offset6(uint16_t instr) { return SignExtend(instr & 0x3F, 6); }
+	constexpr uint16_t PCOffset9(uint16_t instr) { return SignExtend(instr & 0x1FF, 9); }
+	constexpr uint16_t PCOffset11(uint16_t instr) { return SignExtend(instr & 0x7FF, 11); }
+
+	/// <summary>
+	/// JMP R7
+	/// </summary>
+	constexpr bool IsReturn(uint16_t instr) { return OpCode(instr) == OP::JMP && BaseR(instr) == 7; }
+}
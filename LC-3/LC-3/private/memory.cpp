@@ -1,89 +1,283 @@
 #include "memory.h"
 
 #include <iostream>
-#include <bit>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
 
-#ifdef WIN32
-#include <Windows.h>
-#include <conio.h>  // _kbhit
+#include "imageformat.h"
 
+// NOTE: LC-3 memory mapped registers
+const Memory::ValueType KBSR = Memory::kKeyboardStatus; // keyboard status
+const Memory::ValueType KBDR = 0xFE02; // keyboard data
 
-#endif // WIN32
+bool Memory::ReadObj(std::ifstream& obj_is)
+{
+	// NOTE: the file is read at once, parsing it is faster than reading it
+	std::string image;
+	auto start = obj_is.tellg();
+	if (obj_is.seekg(0, std::ios::end))
+	{
+		image.resize(static_cast<size_t>(obj_is.tellg() - start));
+		obj_is.seekg(start);
+		obj_is.read(image.data(), image.size());
+	}
+	if (!obj_is)
+	{
+		std::cerr << "Can't read the image\n";
+		return false;
+	}
+	return LoadImage(image);
+}
+
+bool Memory::LoadImage(std::string_view image)
+{
+	std::vector<ImageSegment> segments;
+	bool loaded = ParseImage(image, DetectFormat(image), m_memory, segments);
 
+	size_t begin = kMemorySize;
+	size_t end = 0;
+	for (auto& segment : segments)
+	{
+		MarkLoaded(segment.origin, segment.size);
+		begin = std::min<size_t>(begin, segment.origin);
+		// NOTE: parenthesized against the max macro of WIN32 builds
+		end = (std::max)(end, segment.origin + segment.size);
+	}
+	m_origin = static_cast<ValueType>(begin < end ? begin : 0);
+	m_loadedSize = begin < end ? end - begin : 0;
+	return loaded;
+}
 
-template<typename T>
-T swapBits(T x)
+bool Memory::Load(const ValueType* obj, size_t size)
 {
-	return (x << (sizeof(T) * 8 / 2)) | (x >> (sizeof(T) * 8 / 2));
+	if (!size) {
+		return false;
+	}
+
+	ValueType origin = obj[0];
+	size = std::min(size - 1, kMemorySize - origin);
+	std::copy(obj + 1, obj + 1 + size, m_memory + origin);
+	m_origin = origin;
+	m_loadedSize = size;
+	MarkLoaded(origin, size);
+	return true;
 }
 
-// NOTE: LC-3 memory mapped registers
-const Memory::ValueType KBSR = 0xFE00; // keyboard status
-const Memory::ValueType KBDR = 0xFE02; // keyboard data
+void Memory::MarkLoaded(size_t origin, size_t size)
+{
+	for (size_t addr = origin; addr < origin + size; addr += kPageSize)
+	{
+		m_loadedPages.set(addr >> kPageBits);
+	}
+	if (size) {
+		m_loadedPages.set((origin + size - 1) >> kPageBits);
+	}
+	MarkInitialized(origin, size);
+}
 
-bool Memory::ReadObj(std::ifstream& obj_is)
+void Memory::MarkInitialized(size_t origin, size_t size)
 {
-	ValueType origin;
+	if (!m_shadow) {
+		return;
+	}
+	for (size_t addr = origin; addr < origin + size; ++addr) {
+		m_shadow[addr] |= kInitialized;
+	}
+}
 
-	obj_is.read(reinterpret_cast<char*>(&origin), sizeof(origin));
+void Memory::Shadow()
+{
+	if (!m_shadow) {
+		m_shadow = std::make_unique<uint8_t[]>(kMemorySize);
+	}
+}
 
-	// NOTE: when VM's host is a little endian machine
-	if constexpr (std::endian::native != std::endian::big)
+void Memory::Sanitize(bool on)
+{
+	m_sanitize = on;
+	if (!on) {
+		return;
+	}
+	Shadow();
+	// NOTE: what was written before is only known by the page, the loaded
+	// image by the word
+	for (size_t page = 0; page < kPageCount; ++page)
 	{
-		origin = swapBits(origin);
+		if (m_pageEpoch[page]) {
+			MarkInitialized(page * kPageSize, kPageSize);
+		}
 	}
+	MarkInitialized(m_origin, m_loadedSize);
+	MarkInitialized(kDeviceBase, kMemorySize - kDeviceBase);
+}
 
-#ifdef WIN32
-#undef max
-#endif // WIN32
-	// NOTE: LC-3 program size is limited
-	auto maxRead = std::numeric_limits<ValueType>::max() - origin;
-#ifdef WIN32
-#define max(a,b)            (((a) > (b)) ? (a) : (b))
-#endif
+void Memory::Reset()
+{
+	for (size_t page = 0; page < kPageCount; ++page)
+	{
+		if (m_pageEpoch[page] || m_loadedPages[page])
+		{
+			std::fill_n(m_memory + page * kPageSize, kPageSize, ValueType(0));
+			m_pageEpoch[page] = 0;
+		}
+	}
+	m_loadedPages.reset();
+	m_epoch = 1;
+	m_origin = 0;
+	m_loadedSize = 0;
+	if (m_sanitize)
+	{
+		std::fill_n(m_shadow.get(), kMemorySize, uint8_t(0));
+		MarkInitialized(kDeviceBase, kMemorySize - kDeviceBase);
+	}
+	else {
+		m_shadow.reset();
+	}
+	m_reports.clear();
+	m_watchHit = 0;
+	m_watchAccess = kWrite;
+	m_watchTriggered = false;
+	m_bulkBegin = kMemorySize;
+	m_bulkEnd = 0;
+	m_deviceReads = 0;
+	m_deviceWrites = 0;
+	m_keyboard.Reset();
+}
 
-	ValueType* p = m_memory + origin;
+Memory::ValueType Memory::Read(ValueType addr)
+{
+	if (addr >= kDeviceBase)
+	{
+		++m_deviceReads;
+		if (addr == KBSR)
+		{
+			char ch;
+			if (m_keyboard.Poll(ch))
+			{
+				Store(KBSR, 1 << 15);
+				Store(KBDR, static_cast<uint8_t>(ch));
+			}
+			else {
+				Store(KBSR, 0);
+			}
+		}
+	}
+	if (m_shadow) {
+		Track(addr, kRead);
+	}
+	return m_memory[addr];
+}
 
-	obj_is.read(reinterpret_cast<char*>(p), maxRead * sizeof(ValueType));
-	auto read = obj_is.gcount();
+void Memory::Write(ValueType addr, ValueType val)
+{
+	if (m_shadow) {
+		Track(addr, kWrite);
+	}
+	if (addr >= kDeviceBase) {
+		++m_deviceWrites;
+	}
+	Store(addr, val);
+}
 
-	if constexpr (std::endian::native != std::endian::big)
+void Memory::Fill(ValueType addr, size_t count, ValueType val)
+{
+	count = std::min(count, kMemorySize - addr);
+	if (!count) {
+		return;
+	}
+	if (m_shadow)
 	{
-		while (read--)
-		{
-			*p = swapBits(*p);
-			++p;
+		for (size_t i = 0; i < count; ++i) {
+			Track(static_cast<ValueType>(addr + i), kWrite);
 		}
 	}
+	std::fill_n(m_memory + addr, count, val);
+	Stamp(addr, count);
+}
 
+bool Memory::Copy(ValueType dst, ValueType src, size_t count)
+{
+	if (!InRam(dst, count) || !InRam(src, count)) {
+		return false;
+	}
+	if (!count) {
+		return true;
+	}
+	if (m_shadow)
+	{
+		for (size_t i = 0; i < count; ++i) {
+			Track(static_cast<ValueType>(src + i), kRead);
+		}
+		for (size_t i = 0; i < count; ++i) {
+			Track(static_cast<ValueType>(dst + i), kWrite);
+		}
+	}
+	std::memmove(m_memory + dst, m_memory + src, count * sizeof(ValueType));
+	Stamp(dst, count);
 	return true;
 }
 
-
-Memory::ValueType CheckKey()
+bool Memory::Set(ValueType addr, size_t count, ValueType val)
 {
-	HANDLE hStdin = INVALID_HANDLE_VALUE;
-	return WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit();
+	if (!InRam(addr, count)) {
+		return false;
+	}
+	Fill(addr, count, val);
+	return true;
 }
 
-Memory::ValueType Memory::Read(ValueType addr)
+bool Memory::Compare(ValueType a, ValueType b, int& order)
 {
-	if (addr == KBSR)
+	for (; a < kDeviceBase && b < kDeviceBase; ++a, ++b)
 	{
-		if (CheckKey())
+		if (m_shadow)
 		{
-			m_memory[KBSR] = (1 << 15);
-			//m_memory[KBDR] = getchar();
-			std::cin.read(reinterpret_cast<char*>(&m_memory[KBDR]), sizeof(char));
+			Track(a, kRead);
+			Track(b, kRead);
 		}
-		else {
-			m_memory[KBSR] = 0;
+		auto x = m_memory[a];
+		auto y = m_memory[b];
+		if (x != y || !x)
+		{
+			order = (x > y) - (x < y);
+			return true;
 		}
 	}
-	return m_memory[addr];
+	return false;
 }
 
-void Memory::Write(ValueType addr, ValueType val)
+void Memory::MarkRamStored()
+{
+	for (size_t page = 0; page < (kDeviceBase >> kPageBits); ++page)
+	{
+		m_loadedPages.set(page);
+	}
+}
+
+void Memory::Stamp(size_t addr, size_t count)
+{
+	for (size_t page = addr >> kPageBits; page <= (addr + count - 1) >> kPageBits; ++page) {
+		m_pageEpoch[page] = m_epoch;
+	}
+	m_bulkBegin = std::min(m_bulkBegin, addr);
+	// NOTE: parenthesized against the max macro of WIN32 builds
+	m_bulkEnd = (std::max)(m_bulkEnd, addr + count);
+}
+
+void Memory::Watch(ValueType addr, Access access, bool on)
+{
+	Shadow();
+	auto bits = static_cast<uint8_t>(access << kWatchShift);
+	m_shadow[addr] = static_cast<uint8_t>(on ? (m_shadow[addr] | bits) : (m_shadow[addr] & ~bits));
+}
+
+void Memory::RestorePage(size_t page, const ValueType* data, uint32_t epoch)
 {
-	m_memory[addr] = val;
+	std::copy(data, data + kPageSize, m_memory + page * kPageSize);
+	m_pageEpoch[page] = epoch;
+	// NOTE: the shadow isn't restored, words restored only count as
+	// initialized
+	MarkInitialized(page * kPageSize, kPageSize);
 }
@@ -1,5 +1,14 @@
 #pragma once
+#include <bitset>
+#include <cstdint>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "keyboard.h"
 
 #ifdef WIN32
 #undef max
@@ -11,14 +20,301 @@ public:
 
 	using ValueType = uint16_t;
 
+	inline static const size_t kMemorySize = size_t(1) << 16;
+	inline static const int kPageBits = 8;
+	/// <summary>
+	/// Page size in words, the unit of dirty tracking
+	/// </summary>
+	inline static const size_t kPageSize = size_t(1) << kPageBits;
+	inline static const size_t kPageCount = kMemorySize / kPageSize;
+	/// <summary>
+	/// Memory mapped device registers start here
+	/// </summary>
+	inline static const ValueType kDeviceBase = 0xFE00;
+	inline static const ValueType kKeyboardStatus = 0xFE00;
+
+	enum Access : uint8_t
+	{
+		kRead = 1,
+		kWrite = 1 << 1,
+		kReadWrite = kRead | kWrite
+	};
+
+	/// <summary>
+	/// Guest bugs the sanitizer reports
+	/// </summary>
+	enum class Violation : uint8_t
+	{
+		UninitializedRead,
+		CodeWrite,
+		DataExecution
+	};
+
+	struct SanitizerReport
+	{
+		ValueType addr;
+		Violation kind;
+	};
+
+	/// <summary>
+	/// Load an image file in any of the formats of <see cref="ImageFormat"/>,
+	/// its segments go straight to memory
+	/// </summary>
 	bool ReadObj(std::ifstream& obj_is);
+	bool LoadImage(std::string_view image);
+
+	/// <summary>
+	/// Load an image already in memory, laid out as an .obj file: origin
+	/// first, then the words to place there
+	/// </summary>
+	bool Load(const ValueType* obj, size_t size);
+
+	/// <summary>
+	/// Back to all zeros with no input, watchpoints or image. Only pages
+	/// loaded, patched or written since construction are cleared.
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Origin and size in words of the last loaded image, from its lowest
+	/// to its highest segment when it has several
+	/// </summary>
+	ValueType Origin() const { return m_origin; };
+	size_t LoadedSize() const { return m_loadedSize; };
 	inline ValueType* Get(ValueType val) { return m_memory + val; };
 
 	ValueType Read(ValueType addr);
 	void Write(ValueType addr, ValueType val);
+	/// <summary>
+	/// Write val to count words from addr on, as many Write calls would
+	/// </summary>
+	void Fill(ValueType addr, size_t count, ValueType val);
+
+	/// <summary>
+	/// The count words from addr on are RAM, below the device page
+	/// </summary>
+	static bool InRam(ValueType addr, size_t count) { return addr + count <= kDeviceBase; };
+
+	/// <summary>
+	/// Bulk operations of the helper traps, as the loads and stores of a
+	/// guest loop would be but refused with false when a range reaches the
+	/// device page. Copy handles overlapping ranges as memmove does.
+	/// </summary>
+	bool Copy(ValueType dst, ValueType src, size_t count);
+	bool Set(ValueType addr, size_t count, ValueType val);
+	/// <summary>
+	/// Order of the zero-terminated word strings at a and b as strcmp
+	/// gives it, comparing words as unsigned
+	/// </summary>
+	bool Compare(ValueType a, ValueType b, int& order);
+
+	/// <summary>
+	/// Report and clear the span stored to by Fill, Copy and Set
+	/// </summary>
+	bool TakeBulkStore(ValueType& addr, size_t& count)
+	{
+		addr = static_cast<ValueType>(m_bulkBegin);
+		count = m_bulkEnd > m_bulkBegin ? m_bulkEnd - m_bulkBegin : 0;
+		m_bulkBegin = kMemorySize;
+		m_bulkEnd = 0;
+		return count;
+	};
+
+	/// <summary>
+	/// Instruction fetch: no device side effects and no watchpoints
+	/// </summary>
+	ValueType Fetch(ValueType addr) const { return m_memory[addr]; };
+
+	/// <summary>
+	/// Instruction fetch checked by the sanitizer, marks the word as code
+	/// </summary>
+	ValueType Execute(ValueType addr)
+	{
+		if (m_sanitize)
+		{
+			auto& shadow = m_shadow[addr];
+			if ((shadow & kWritten) || !(shadow & kInitialized)) {
+				Report(addr, Violation::DataExecution);
+			}
+			shadow |= kExecuted;
+		}
+		return m_memory[addr];
+	};
+
+	/// <summary>
+	/// Debugger write, bypasses dirty tracking so patched breakpoints never
+	/// end up in snapshots
+	/// </summary>
+	void Patch(ValueType addr, ValueType val)
+	{
+		m_memory[addr] = val;
+		m_loadedPages.set(addr >> kPageBits);
+		if (m_shadow) {
+			m_shadow[addr] |= kInitialized;
+		}
+	};
+
+	/// <summary>
+	/// Debugger store, dirty tracked so that history and pooled resets see
+	/// it, but with no device side effects, watchpoints or sanitizer checks
+	/// </summary>
+	void Poke(ValueType addr, ValueType val)
+	{
+		Store(addr, val);
+		if (m_shadow) {
+			m_shadow[addr] |= kInitialized;
+		}
+	};
+
+	/// <summary>
+	/// Watch loads and stores of addr through Read, Write and Fill. Any
+	/// number of watchpoints cost one shadow lookup per access.
+	/// </summary>
+	void Watch(ValueType addr, Access access, bool on);
+
+	/// <summary>
+	/// Report and clear the last watched access
+	/// </summary>
+	bool TakeWatchHit(ValueType& addr)
+	{
+		addr = m_watchHit;
+		return std::exchange(m_watchTriggered, false);
+	};
+	/// <summary>
+	/// Access that hit the last watched address, kRead or kWrite
+	/// </summary>
+	Access WatchHitAccess() const { return m_watchAccess; };
+
+	/// <summary>
+	/// Sanitizer mode: a shadow byte per word records whether it was loaded
+	/// or written and whether it was run. Loads of words never initialized,
+	/// stores to words already run and running words the program stored
+	/// are reported, once per word and kind. Words loaded so far and the
+	/// pages written so far count as initialized.
+	/// </summary>
+	/// <remarks>
+	/// Only accesses through Read, Write, Fill and Execute are checked.
+	/// Reset keeps the mode and forgets the shadow.
+	/// </remarks>
+	void Sanitize(bool on);
+	bool Sanitizing() const { return m_sanitize; };
+
+	/// <summary>
+	/// Violations found since the last ClearReports
+	/// </summary>
+	const std::vector<SanitizerReport>& Reports() const { return m_reports; };
+	void ClearReports() { m_reports.clear(); };
+
+	Keyboard& Input() { return m_keyboard; };
+	const Keyboard& Input() const { return m_keyboard; };
+
+	/// <summary>
+	/// Loads and stores that reached the device page through Read and Write
+	/// since the last Reset
+	/// </summary>
+	uint64_t DeviceReads() const { return m_deviceReads; };
+	uint64_t DeviceWrites() const { return m_deviceWrites; };
+
+	/// <summary>
+	/// Every write stamps its page with the current epoch, so pages dirtied
+	/// since some moment are those stamped with the epoch started at it
+	/// </summary>
+	uint32_t Epoch() const { return m_epoch; };
+	uint32_t NextEpoch() { return ++m_epoch; };
+	void SetEpoch(uint32_t epoch) { m_epoch = epoch; };
+	uint32_t PageEpoch(size_t page) const { return m_pageEpoch[page]; };
+
+	const ValueType* Page(size_t page) const { return m_memory + page * kPageSize; };
+
+	/// <summary>
+	/// Code storing through Get() bypasses dirty tracking, after it ran
+	/// Reset has to clear all RAM
+	/// </summary>
+	void MarkRamStored();
+	void RestorePage(size_t page, const ValueType* data, uint32_t epoch);
 
 private:
-	ValueType m_memory[std::numeric_limits<ValueType>::max()] = {};
+	void MarkLoaded(size_t origin, size_t size);
+
+	void Store(ValueType addr, ValueType val)
+	{
+		m_memory[addr] = val;
+		m_pageEpoch[addr >> kPageBits] = m_epoch;
+	};
+
+	// NOTE: shadow byte bits, watch bits are the Access bits shifted
+	inline static const uint8_t kInitialized = 1;
+	inline static const uint8_t kWritten = 1 << 1;
+	inline static const uint8_t kExecuted = 1 << 2;
+	inline static const int kWatchShift = 3;
+	/// <summary>
+	/// Reported bit of the first Violation, the others follow
+	/// </summary>
+	inline static const int kReportedShift = 5;
+
+	void Shadow();
+	/// <summary>
+	/// Dirty tracking of a bulk store
+	/// </summary>
+	void Stamp(size_t addr, size_t count);
+	void MarkInitialized(size_t origin, size_t size);
+
+	void Track(ValueType addr, Access access)
+	{
+		auto& shadow = m_shadow[addr];
+		if (shadow & (access << kWatchShift))
+		{
+			m_watchHit = addr;
+			m_watchAccess = access;
+			m_watchTriggered = true;
+		}
+		if (access == kRead)
+		{
+			if (m_sanitize && !(shadow & kInitialized)) {
+				Report(addr, Violation::UninitializedRead);
+			}
+			return;
+		}
+		if (m_sanitize && (shadow & kExecuted)) {
+			Report(addr, Violation::CodeWrite);
+		}
+		shadow |= kInitialized | kWritten;
+	};
+
+	void Report(ValueType addr, Violation kind)
+	{
+		auto reported = static_cast<uint8_t>(1 << (kReportedShift + static_cast<int>(kind)));
+		if (!(m_shadow[addr] & reported))
+		{
+			m_shadow[addr] |= reported;
+			m_reports.push_back({ addr, kind });
+		}
+	};
+
+	Keyboard m_keyboard;
+	ValueType m_origin{ 0 };
+	size_t m_loadedSize{ 0 };
+	/// <summary>
+	/// One byte per word, allocated by the first watchpoint or the
+	/// sanitizer, accesses pay for nothing else while it is missing
+	/// </summary>
+	std::unique_ptr<uint8_t[]> m_shadow;
+	bool m_sanitize{ false };
+	std::vector<SanitizerReport> m_reports;
+	ValueType m_watchHit{ 0 };
+	Access m_watchAccess{ kWrite };
+	bool m_watchTriggered{ false };
+	size_t m_bulkBegin{ kMemorySize };
+	size_t m_bulkEnd{ 0 };
+	uint64_t m_deviceReads{ 0 };
+	uint64_t m_deviceWrites{ 0 };
+	uint32_t m_epoch{ 1 };
+	uint32_t m_pageEpoch[kPageCount] = {};
+	/// <summary>
+	/// Pages filled by loaders and debuggers, which bypass dirty tracking
+	/// </summary>
+	std::bitset<kPageCount> m_loadedPages;
+	ValueType m_memory[kMemorySize] = {};
 };
 
 #ifdef WIN32
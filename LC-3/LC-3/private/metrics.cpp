@@ -0,0 +1,136 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "identifiers.h"
+
+namespace
+{
+	const char kMagic[4] = { 'L', 'C', '3', 'S' };
+
+	void Accumulate(uint64_t& total, uint64_t value)
+	{
+		if (value) {
+			std::atomic_ref<uint64_t>(total).fetch_add(value, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t Get(const uint64_t& total)
+	{
+		return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(total)).load(std::memory_order_relaxed);
+	}
+
+	void Describe(std::ostream& os, std::string_view name, std::string_view help)
+	{
+		os << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " counter\n";
+	}
+}
+
+std::string_view Str(EngineTier tier)
+{
+	switch (tier)
+	{
+	case EngineTier::Interpreter: return "interpreter";
+	case EngineTier::Native: return "native";
+	case EngineTier::Lockstep: return "lockstep";
+	default: return "unknown";
+	}
+}
+
+bool RuntimeMetrics::Share(const std::filesystem::path& path)
+{
+	if (!m_file.Open(path, sizeof(Totals))) {
+		return false;
+	}
+
+	MappedFile::Guard guard(m_file, true);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+	auto totals = reinterpret_cast<Totals*>(m_file.Data());
+	if (std::memcmp(totals->magic, kMagic, sizeof(kMagic)) != 0 || totals->version != kVersion)
+	{
+		// NOTE: processes already counting keep their mapping, they are
+		// not told the layout changed under them
+		std::memset(totals, 0, sizeof(Totals));
+		std::memcpy(totals->magic, kMagic, sizeof(kMagic));
+		totals->version = kVersion;
+	}
+	m_totals = totals;
+	return true;
+}
+
+void RuntimeMetrics::Add(const VmMetrics& run)
+{
+	Accumulate(m_totals->runs[static_cast<size_t>(run.tier)], 1);
+	Accumulate(m_totals->instructions, run.instructions);
+	Accumulate(m_totals->deviceReads, run.deviceReads);
+	Accumulate(m_totals->deviceWrites, run.deviceWrites);
+	Accumulate(m_totals->inputBlockedNs, run.inputBlockedNs);
+	for (size_t vector = 0; vector < run.traps.size(); ++vector)
+	{
+		Accumulate(m_totals->traps[vector], run.traps[vector]);
+	}
+}
+
+bool RuntimeMetrics::WritePrometheus(const std::filesystem::path& path) const
+{
+	auto temp = path;
+	temp += ".tmp";
+	{
+		std::ofstream os(temp, std::ios::out | std::ios::binary);
+
+		Describe(os, "lc3_runs_total", "Programs run to the end, by engine tier.");
+		for (size_t tier = 0; tier < m_totals->runs.size(); ++tier)
+		{
+			os << "lc3_runs_total{tier=\"" << Str(static_cast<EngineTier>(tier)) << "\"} "
+				<< Get(m_totals->runs[tier]) << '\n';
+		}
+
+		Describe(os, "lc3_instructions_total", "Instructions retired.");
+		os << "lc3_instructions_total " << Get(m_totals->instructions) << '\n';
+
+		Describe(os, "lc3_traps_total", "TRAP instructions executed, by vector.");
+		for (size_t vector = 0; vector < m_totals->traps.size(); ++vector)
+		{
+			auto count = Get(m_totals->traps[vector]);
+			if (!count) {
+				continue;
+			}
+			os << "lc3_traps_total{vector=\"0x" << std::hex << std::setw(2) << std::setfill('0') << vector
+				<< std::dec << '"';
+			if (vector >= static_cast<size_t>(TR::FIRST) && vector <= static_cast<size_t>(TR::LAST)) {
+				os << ",name=\"" << Str(static_cast<TR>(vector)) << '"';
+			}
+			os << "} " << count << '\n';
+		}
+
+		Describe(os, "lc3_device_reads_total", "Loads from the device page.");
+		os << "lc3_device_reads_total " << Get(m_totals->deviceReads) << '\n';
+		Describe(os, "lc3_device_writes_total", "Stores to the device page.");
+		os << "lc3_device_writes_total " << Get(m_totals->deviceWrites) << '\n';
+
+		Describe(os, "lc3_input_blocked_seconds_total", "Time spent waiting for keyboard input.");
+		os << "lc3_input_blocked_seconds_total " << Get(m_totals->inputBlockedNs) / 1e9 << '\n';
+
+		if (!os)
+		{
+			std::cerr << "Can't write " << temp << '\n';
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	if (ec)
+	{
+		std::cerr << "Can't write " << path << '\n';
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "mapfile.h"
+
+/// <summary>
+/// Engine that ran a program, from the slowest to the fastest
+/// </summary>
+enum class EngineTier : uint8_t
+{
+	Interpreter,
+	/// <summary>
+	/// Translated by lc3-aot, at least part of the run
+	/// </summary>
+	Native,
+	Lockstep,
+
+	Count
+};
+
+std::string_view Str(EngineTier tier);
+
+/// <summary>
+/// Counters of one machine or lockstep lane, written only by the thread
+/// running it. Each takes cache lines of its own so that machines run side
+/// by side never share one.
+/// </summary>
+/// <remarks>
+/// Nothing here is updated per instruction: the instruction count is the
+/// one the machine keeps anyway, traps and device accesses are counted on
+/// their slow paths and input time around blocking reads.
+/// </remarks>
+struct alignas(64) VmMetrics
+{
+	uint64_t instructions{ 0 };
+	uint64_t deviceReads{ 0 };
+	uint64_t deviceWrites{ 0 };
+	/// <summary>
+	/// Time spent waiting for the terminal in GETC, IN and idle polls
+	/// </summary>
+	uint64_t inputBlockedNs{ 0 };
+	EngineTier tier{ EngineTier::Interpreter };
+	/// <summary>
+	/// TRAP instructions executed, by vector
+	/// </summary>
+	std::array<uint64_t, 256> traps{};
+};
+
+/// <summary>
+/// Totals of many runs, added to without locks from any number of threads,
+/// and of processes when the totals live in a shared segment.
+/// </summary>
+/// <remarks>
+/// A segment is a file mapped by every process using it, one under
+/// /dev/shm on Linux stays in memory. Monitoring tools read the counters
+/// from it while runs go on, or from the Prometheus text format dump.
+/// </remarks>
+class RuntimeMetrics
+{
+public:
+	/// <summary>
+	/// Bump on any change of the segment layout
+	/// </summary>
+	inline static const uint32_t kVersion = 1;
+
+	RuntimeMetrics() : m_totals(&m_local) {};
+	RuntimeMetrics(const RuntimeMetrics&) = delete;
+	RuntimeMetrics& operator=(const RuntimeMetrics&) = delete;
+
+	/// <summary>
+	/// Keep the totals in a segment shared with other processes, created
+	/// when missing. Counts of a segment with another layout are dropped.
+	/// </summary>
+	bool Share(const std::filesystem::path& path);
+
+	/// <summary>
+	/// Count a finished run
+	/// </summary>
+	void Add(const VmMetrics& run);
+
+	/// <summary>
+	/// Dump the totals as Prometheus text, replacing the file at once so
+	/// scrapers never see half of it
+	/// </summary>
+	bool WritePrometheus(const std::filesystem::path& path) const;
+
+private:
+	/// <summary>
+	/// Segment layout, counters are only accessed through atomic_ref
+	/// </summary>
+	struct Totals
+	{
+		char magic[4];
+		uint32_t version;
+		std::array<uint64_t, static_cast<size_t>(EngineTier::Count)> runs;
+		uint64_t instructions;
+		uint64_t deviceReads;
+		uint64_t deviceWrites;
+		uint64_t inputBlockedNs;
+		std::array<uint64_t, 256> traps;
+	};
+
+	Totals* m_totals;
+	Totals m_local{};
+	MappedFile m_file;
+};
@@ -0,0 +1,96 @@
+#include "native.h"
+
+#include <iostream>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif // WIN32
+
+NativeCode::~NativeCode()
+{
+	if (!m_library) {
+		return;
+	}
+#ifdef WIN32
+	FreeLibrary(static_cast<HMODULE>(m_library));
+#else
+	dlclose(m_library);
+#endif // WIN32
+}
+
+void* NativeCode::Symbol(const char* name) const
+{
+#ifdef WIN32
+	return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(m_library), name));
+#else
+	return dlsym(m_library, name);
+#endif // WIN32
+}
+
+bool NativeCode::Load(const std::filesystem::path& library)
+{
+#ifdef WIN32
+	m_library = LoadLibraryW(library.c_str());
+#else
+	// NOTE: a bare file name would be searched in the system paths only
+	m_library = dlopen(std::filesystem::absolute(library).c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif // WIN32
+	if (!m_library)
+	{
+		std::cerr << "Can't load translated program " << library << '\n';
+		return false;
+	}
+
+	auto abi = static_cast<const uint32_t*>(Symbol("lc3_aot_abi"));
+	auto origin = static_cast<const uint16_t*>(Symbol("lc3_aot_origin"));
+	auto size = static_cast<const uint32_t*>(Symbol("lc3_aot_size"));
+	auto image = static_cast<const uint16_t*>(Symbol("lc3_aot_image"));
+	auto code = static_cast<const uint8_t*>(Symbol("lc3_aot_code"));
+	auto entry = static_cast<const uint8_t*>(Symbol("lc3_aot_entry"));
+	auto run = reinterpret_cast<AotEntry>(Symbol("lc3_aot_run"));
+	if (!abi || !origin || !size || !image || !run)
+	{
+		std::cerr << library << " is not a translated LC-3 program\n";
+		return false;
+	}
+	if (*abi != kAotAbiVersion || !code || !entry)
+	{
+		std::cerr << library << " was translated for another VM version, run lc3-aot again\n";
+		return false;
+	}
+
+	m_origin = *origin;
+	m_size = *size;
+	m_image = image;
+	m_code = code;
+	m_entry = entry;
+	m_run = run;
+	return true;
+}
+
+bool NativeCode::Matches(const Memory& mem) const
+{
+	if (!m_run || m_size > Memory::kMemorySize - m_origin) {
+		return false;
+	}
+	for (uint32_t i = 0; i < m_size; ++i)
+	{
+		if (mem.Fetch(static_cast<uint16_t>(m_origin + i)) != m_image[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool NativeCode::Covers(uint16_t addr, size_t count) const
+{
+	for (size_t i = addr; i < addr + count && i < Memory::kMemorySize; ++i)
+	{
+		if ((m_code[i >> 3] >> (i & 7)) & 1) {
+			return true;
+		}
+	}
+	return false;
+}
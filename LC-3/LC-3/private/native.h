@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+#include "aotabi.h"
+#include "memory.h"
+
+/// <summary>
+/// A program translated by lc3-aot and loaded from its shared library.
+/// </summary>
+class NativeCode
+{
+public:
+	NativeCode() = default;
+	NativeCode(const NativeCode&) = delete;
+	NativeCode& operator=(const NativeCode&) = delete;
+	~NativeCode();
+
+	bool Load(const std::filesystem::path& library);
+
+	/// <summary>
+	/// The library was translated from the image loaded in mem
+	/// </summary>
+	bool Matches(const Memory& mem) const;
+
+	/// <summary>
+	/// Some of the count words from addr on were translated
+	/// </summary>
+	bool Covers(uint16_t addr, size_t count) const;
+
+	/// <summary>
+	/// A translated block starts at addr, Run goes on from there
+	/// </summary>
+	bool IsEntry(uint16_t addr) const { return (m_entry[addr >> 3] >> (addr & 7)) & 1; };
+
+	int Run(AotContext& ctx) const { return m_run(&ctx); };
+
+private:
+	void* Symbol(const char* name) const;
+
+	void* m_library{ nullptr };
+	AotEntry m_run{ nullptr };
+	uint16_t m_origin{ 0 };
+	uint32_t m_size{ 0 };
+	const uint16_t* m_image{ nullptr };
+	const uint8_t* m_code{ nullptr };
+	const uint8_t* m_entry{ nullptr };
+};
@@ -0,0 +1,193 @@
+#include "pagestore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	const char kMagic[4] = { 'L', 'C', '3', 'P' };
+	const char kSnapshotMagic[4] = { 'L', 'C', '3', 'M' };
+}
+
+bool PageStore::Open(const std::filesystem::path& path)
+{
+	if (!m_file.Open(path, kHeapStart)) {
+		return false;
+	}
+
+	MappedFile::Guard guard(m_file, true);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+	auto header = GetHeader();
+	if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+		header->version == kVersion && header->slots == kSlots)
+	{
+		return true;
+	}
+
+	// NOTE: a new file, or one written by another version. Its pages are
+	// gone, a fresh id makes snapshots referring to them fail to load. A
+	// new file is zero already and its table stays sparse.
+	auto data = m_file.Data();
+	if (std::any_of(data, data + sizeof(Header), [](uint8_t byte) { return byte != 0; })) {
+		std::fill_n(data, kHeapStart, uint8_t(0));
+	}
+	std::memcpy(header->magic, kMagic, sizeof(kMagic));
+	header->version = kVersion;
+	header->id = Hasher(std::random_device{}())
+		.Add(std::chrono::steady_clock::now().time_since_epoch().count()).Digest().lo;
+	header->slots = kSlots;
+	header->pages = 0;
+	return true;
+}
+
+uint64_t PageStore::PageCount()
+{
+	MappedFile::Guard guard(m_file, false);
+	return m_file.Refresh() ? GetHeader()->pages : 0;
+}
+
+bool PageStore::Intern(const ValueType* data, uint32_t& page)
+{
+	auto key = Hasher().Update(data, kPageBytes).Digest();
+	auto slots = Slots();
+	Slot* slot = nullptr;
+	for (uint64_t i = 0; i < kSlots; ++i)
+	{
+		slot = &slots[(key.lo + i) & (kSlots - 1)];
+		if (!slot->used || slot->key == key) {
+			break;
+		}
+	}
+	if (slot->used)
+	{
+		page = slot->page;
+		return true;
+	}
+
+	// NOTE: probes stay short while the table is at most 3/4 full
+	auto header = GetHeader();
+	if (header->pages >= kSlots / 4 * 3)
+	{
+		std::cerr << "Page store is full\n";
+		return false;
+	}
+
+	auto end = kHeapStart + (header->pages + 1) * kPageBytes;
+	if (end > m_file.Size())
+	{
+		auto slotIndex = slot - slots;
+		auto heap = m_file.Size() - kHeapStart;
+		if (!m_file.Resize(kHeapStart + std::max<size_t>({ end - kHeapStart, heap * 2, kMinHeap }))) {
+			return false;
+		}
+		header = GetHeader();
+		slot = Slots() + slotIndex;
+	}
+
+	page = static_cast<uint32_t>(header->pages);
+	std::memcpy(m_file.Data() + kHeapStart + page * kPageBytes, data, kPageBytes);
+	slot->key = key;
+	slot->page = page;
+	slot->used = 1;
+	++header->pages;
+	return true;
+}
+
+bool PageStore::Save(const Memory& mem, Snapshot& snapshot)
+{
+	MappedFile::Guard guard(m_file, true);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+
+	auto header = GetHeader();
+	if (m_recentStore != header->id)
+	{
+		m_recent.fill(kNoPage);
+		m_recentStore = header->id;
+	}
+
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		// NOTE: a page usually holds what it did in the last snapshot saved
+		// here, comparing is cheaper than hashing and probing
+		auto data = mem.Page(page);
+		auto recent = m_recent[page];
+		if (recent != kNoPage && std::equal(data, data + Memory::kPageSize, PageData(recent)))
+		{
+			snapshot.pages[page] = recent;
+			continue;
+		}
+		if (!Intern(data, snapshot.pages[page])) {
+			return false;
+		}
+		m_recent[page] = snapshot.pages[page];
+	}
+	snapshot.store = GetHeader()->id;
+	return true;
+}
+
+bool PageStore::Load(const Snapshot& snapshot, Memory& mem)
+{
+	MappedFile::Guard guard(m_file, false);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+
+	auto header = GetHeader();
+	bool valid = snapshot.store == header->id && std::all_of(snapshot.pages.begin(), snapshot.pages.end(),
+		[header](uint32_t page) { return page < header->pages; });
+	if (!valid)
+	{
+		std::cerr << "The snapshot refers to pages of another page store\n";
+		return false;
+	}
+
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		mem.RestorePage(page, PageData(snapshot.pages[page]), mem.Epoch());
+	}
+	return true;
+}
+
+bool PageStore::Snapshot::Write(const std::filesystem::path& path) const
+{
+	std::ofstream os(path, std::ios::out | std::ios::binary);
+	os.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+	os.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+	os.write(reinterpret_cast<const char*>(&store), sizeof(store));
+	os.write(reinterpret_cast<const char*>(&instructions), sizeof(instructions));
+	os.write(reinterpret_cast<const char*>(registers.data()), sizeof(registers));
+	os.write(reinterpret_cast<const char*>(pages.data()), sizeof(pages));
+	if (!os)
+	{
+		std::cerr << "Can't write snapshot " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+bool PageStore::Snapshot::Read(const std::filesystem::path& path)
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	char magic[sizeof(kSnapshotMagic)];
+	uint32_t version = 0;
+	is.read(magic, sizeof(magic));
+	is.read(reinterpret_cast<char*>(&version), sizeof(version));
+	is.read(reinterpret_cast<char*>(&store), sizeof(store));
+	is.read(reinterpret_cast<char*>(&instructions), sizeof(instructions));
+	is.read(reinterpret_cast<char*>(registers.data()), sizeof(registers));
+	is.read(reinterpret_cast<char*>(pages.data()), sizeof(pages));
+	if (!is || std::memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0 || version != kVersion)
+	{
+		std::cerr << "Not a snapshot of this version " << path << '\n';
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+
+#include "hash.h"
+#include "identifiers.h"
+#include "mapfile.h"
+#include "memory.h"
+
+/// <summary>
+/// Content addressed store of memory pages shared by many snapshots, each
+/// distinct page is kept once.
+/// </summary>
+/// <remarks>
+/// File layout: a header, an open addressing table from page hashes to
+/// page numbers and the pages themselves, appended in the order they were
+/// first seen. Pages never move, so a snapshot refers to them by number
+/// and loads by copying them straight from the mapping. The file can be
+/// shared by concurrent processes like <see cref="ResultCache"/>, writers
+/// take the file lock exclusively.
+/// </remarks>
+class PageStore
+{
+public:
+	using ValueType = Memory::ValueType;
+	using Pages = std::array<uint32_t, Memory::kPageCount>;
+
+	inline static const uint32_t kVersion = 1;
+	inline static const uint64_t kSlots = uint64_t(1) << 20;
+	inline static const size_t kPageBytes = Memory::kPageSize * sizeof(ValueType);
+
+	/// <summary>
+	/// Machine state as a manifest of page numbers in one store, about
+	/// 1 KiB on disk instead of the 128 KiB of the memory
+	/// </summary>
+	struct Snapshot
+	{
+		/// <summary>
+		/// Identity of the store the pages are in, a store rebuilt by
+		/// another version doesn't accept it
+		/// </summary>
+		uint64_t store{ 0 };
+		uint64_t instructions{ 0 };
+		std::array<ValueType, static_cast<size_t>(R::NREG)> registers{};
+		Pages pages{};
+
+		bool Write(const std::filesystem::path& path) const;
+		bool Read(const std::filesystem::path& path);
+	};
+
+	bool Open(const std::filesystem::path& path);
+
+	/// <summary>
+	/// Add the pages of mem the store doesn't have yet, set snapshot.pages
+	/// and snapshot.store
+	/// </summary>
+	bool Save(const Memory& mem, Snapshot& snapshot);
+
+	/// <summary>
+	/// Copy the pages of the snapshot into mem, they are marked dirty so
+	/// Memory::Reset clears them
+	/// </summary>
+	bool Load(const Snapshot& snapshot, Memory& mem);
+
+	/// <summary>
+	/// Distinct pages stored
+	/// </summary>
+	uint64_t PageCount();
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t id;
+		uint64_t slots;
+		uint64_t pages;
+	};
+
+	struct Slot
+	{
+		Hash128 key;
+		uint32_t page;
+		uint32_t used;
+	};
+
+	inline static const size_t kHeapStart = sizeof(Header) + kSlots * sizeof(Slot);
+	inline static const size_t kMinHeap = 256 * kPageBytes;
+	inline static const uint32_t kNoPage = ~uint32_t(0);
+
+	Header* GetHeader() const { return reinterpret_cast<Header*>(m_file.Data()); };
+	Slot* Slots() const { return reinterpret_cast<Slot*>(m_file.Data() + sizeof(Header)); };
+	const ValueType* PageData(uint32_t page) const
+	{
+		return reinterpret_cast<const ValueType*>(m_file.Data() + kHeapStart + page * kPageBytes);
+	};
+
+	/// <summary>
+	/// Number of the page with this content, stored first if new
+	/// </summary>
+	/// <returns>false when the table is full or the file can't grow</returns>
+	bool Intern(const ValueType* data, uint32_t& page);
+
+	MappedFile m_file;
+	/// <summary>
+	/// Page numbers of the last snapshot saved by this object
+	/// </summary>
+	Pages m_recent{};
+	uint64_t m_recentStore{ 0 };
+};
@@ -0,0 +1,73 @@
+#include "policies.h"
+#include "debuginfo.h"
+
+#include <algorithm>
+#include <map>
+#include <iomanip>
+#include <numeric>
+
+void policy::ProfileCounts::Report(std::ostream& os, const DebugInfo* debug, size_t top) const
+{
+	auto total = std::accumulate(opcodes.begin(), opcodes.end(), uint64_t(0));
+	os << "Profile: " << total << " instructions\n";
+	if (!total) {
+		return;
+	}
+
+	auto flags = os.flags();
+	os << std::fixed << std::setprecision(1);
+	for (size_t op = 0; op < opcodes.size(); ++op)
+	{
+		if (opcodes[op]) {
+			os << '\t' << std::setw(5) << std::left << Str(static_cast<OP>(op)) << std::right
+				<< std::setw(14) << opcodes[op] << std::setw(7) << 100.0 * opcodes[op] / total << "%\n";
+		}
+	}
+
+	std::vector<ValueType> addrs;
+	for (size_t addr = 0; addr < hits.size(); ++addr)
+	{
+		if (hits[addr]) {
+			addrs.push_back(static_cast<ValueType>(addr));
+		}
+	}
+	top = std::min(top, addrs.size());
+	std::partial_sort(addrs.begin(), addrs.begin() + top, addrs.end(),
+		[this](ValueType a, ValueType b) { return hits[a] > hits[b]; });
+
+	os << "Hot addresses:\n";
+	for (size_t i = 0; i < top; ++i)
+	{
+		os << "\tx" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << addrs[i]
+			<< std::dec << std::setfill(' ') << std::setw(14) << hits[addrs[i]]
+			<< std::setw(7) << 100.0 * hits[addrs[i]] / total << '%';
+		if (debug) {
+			os << "  " << debug->Describe(addrs[i]);
+		}
+		os << '\n';
+	}
+
+	if (debug)
+	{
+		// NOTE: words before the first label are left out
+		std::map<std::string_view, uint64_t> labels;
+		for (auto addr : addrs)
+		{
+			std::string_view name;
+			uint16_t offset;
+			if (debug->FindSymbol(addr, name, offset)) {
+				labels[name] += hits[addr];
+			}
+		}
+		std::vector<std::pair<std::string_view, uint64_t>> rollup(labels.begin(), labels.end());
+		std::stable_sort(rollup.begin(), rollup.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+		os << "Hot labels:\n";
+		for (size_t i = 0; i < std::min(top, rollup.size()); ++i)
+		{
+			os << '\t' << std::setw(16) << std::left << rollup[i].first << std::right
+				<< std::setw(14) << rollup[i].second << std::setw(7) << 100.0 * rollup[i].second / total << "%\n";
+		}
+	}
+	os.flags(flags);
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "coverage.h"
+#include "identifiers.h"
+#include "memory.h"
+
+class DebugInfo;
+
+/// <summary>
+/// Compile-time configuration of <see cref="BasicVirtualMachine"/>.
+/// </summary>
+/// <remarks>
+/// Each aspect of the interpreter that costs something on every instruction
+/// is a policy type, a machine is instantiated with one of each. Disabled
+/// features are removed by the compiler instead of being tested at run time.
+/// </remarks>
+namespace policy
+{
+	using ValueType = Memory::ValueType;
+
+	/// <summary>
+	/// Tracing: print the opcode of every executed instruction
+	/// </summary>
+	struct TraceOff
+	{
+		static constexpr bool kAvailable = false;
+	};
+
+	/// <summary>
+	/// Tracing switched on and off by the constructor argument
+	/// </summary>
+	struct TraceSwitch
+	{
+		static constexpr bool kAvailable = true;
+	};
+
+	/// <summary>
+	/// Profiling: nothing is counted
+	/// </summary>
+	struct ProfileOff
+	{
+		static constexpr bool kEnabled = false;
+
+		void Count(ValueType, OP) {};
+	};
+
+	/// <summary>
+	/// Profiling: executed instructions per opcode and per address
+	/// </summary>
+	struct ProfileCounts
+	{
+		static constexpr bool kEnabled = true;
+
+		void Count(ValueType pc, OP op)
+		{
+			++opcodes[static_cast<size_t>(op)];
+			++hits[pc];
+		};
+
+		/// <summary>
+		/// Print the opcode mix and the top hot addresses, with their source
+		/// lines and a per label rollup when debug info is given
+		/// </summary>
+		void Report(std::ostream& os, const DebugInfo* debug = nullptr, size_t top = 10) const;
+
+		std::array<uint64_t, static_cast<size_t>(OP::NOP)> opcodes{};
+		std::vector<uint64_t> hits = std::vector<uint64_t>(Memory::kMemorySize);
+	};
+
+	/// <summary>
+	/// Memory mapped I/O: every load goes through device and watchpoint checks
+	/// </summary>
+	struct MmioChecked
+	{
+		static ValueType Read(Memory& mem, ValueType addr) { return mem.Read(addr); };
+	};
+
+	/// <summary>
+	/// Memory mapped I/O: only the device page is dispatched, loads from RAM
+	/// don't report watchpoints
+	/// </summary>
+	struct MmioDevices
+	{
+		static ValueType Read(Memory& mem, ValueType addr)
+		{
+			return addr >= Memory::kDeviceBase ? mem.Read(addr) : mem.Fetch(addr);
+		};
+	};
+
+	/// <summary>
+	/// Condition codes computed with compares and branches
+	/// </summary>
+	struct FlagsBranch
+	{
+		static ValueType Of(ValueType value)
+		{
+			if (value == 0) {
+				return static_cast<ValueType>(FL::ZRO);
+			}
+			return static_cast<ValueType>(value >> 15 ? FL::NEG : FL::POS);
+		};
+	};
+
+	/// <summary>
+	/// Condition codes computed arithmetically: POS + 1 when zero, POS + 3
+	/// when negative
+	/// </summary>
+	struct FlagsBranchless
+	{
+		static ValueType Of(ValueType value)
+		{
+			return static_cast<ValueType>(1 + (value == 0) + 3 * (value >> 15));
+		};
+	};
+
+	/// <summary>
+	/// Decoded opcodes and register indices are range checked
+	/// </summary>
+	struct DecodeChecked
+	{
+		static constexpr bool kChecked = true;
+	};
+
+	/// <summary>
+	/// Decoding trusts the bit fields, which can't be out of range
+	/// </summary>
+	struct DecodeUnchecked
+	{
+		static constexpr bool kChecked = false;
+	};
+
+	/// <summary>
+	/// Coverage: control transfers are not recorded
+	/// </summary>
+	struct CoverageOff
+	{
+		static constexpr bool kEnabled = false;
+
+		void Edge(ValueType) {};
+		void Restart() {};
+	};
+
+	/// <summary>
+	/// Coverage: AFL-style edge hit counts. Every BR, JMP and JSR bumps the
+	/// map byte indexed by its destination mixed with the previous one.
+	/// </summary>
+	struct CoverageEdges
+	{
+		static constexpr bool kEnabled = true;
+
+		void Edge(ValueType to)
+		{
+			// NOTE: multiplying by an odd constant is a bijection, distinct
+			// addresses never share a location
+			auto location = static_cast<ValueType>(to * 0x9E37u);
+			map->Hit(location ^ previous);
+			previous = location >> 1;
+		};
+
+		/// <summary>
+		/// A new run starts from no previous location
+		/// </summary>
+		void Restart() { previous = 0; };
+
+		CoverageMap* map{ nullptr };
+		ValueType previous{ 0 };
+	};
+
+	/// <summary>
+	/// Sanitizer: memory is not shadowed
+	/// </summary>
+	struct SanitizeOff
+	{
+		static constexpr bool kEnabled = false;
+	};
+
+	/// <summary>
+	/// Sanitizer: fetches, loads and stores are checked against the shadow
+	/// memory, see Memory::Sanitize
+	/// </summary>
+	struct SanitizeShadow
+	{
+		static constexpr bool kEnabled = true;
+	};
+
+	template<typename TraceT, typename ProfileT, typename MmioT, typename FlagsT, typename DecodeT,
+		typename CoverageT = CoverageOff, typename SanitizeT = SanitizeOff>
+	struct Machine
+	{
+		using Trace = TraceT;
+		using Profile = ProfileT;
+		using Mmio = MmioT;
+		using Flags = FlagsT;
+		using Decode = DecodeT;
+		using Coverage = CoverageT;
+		using Sanitize = SanitizeT;
+	};
+
+	/// <summary>
+	/// Everything checked, the reference for the other configurations and
+	/// the one debuggers attach to
+	/// </summary>
+	using Debug = Machine<TraceSwitch, ProfileOff, MmioChecked, FlagsBranch, DecodeChecked>;
+
+	/// <summary>
+	/// Production: nothing but the program is paid for
+	/// </summary>
+	using Release = Machine<TraceOff, ProfileOff, MmioDevices, FlagsBranchless, DecodeUnchecked>;
+
+	using Profile = Machine<TraceOff, ProfileCounts, MmioDevices, FlagsBranchless, DecodeUnchecked>;
+
+	/// <summary>
+	/// Release with edge coverage, for coverage guided fuzzing
+	/// </summary>
+	using Fuzz = Machine<TraceOff, ProfileOff, MmioDevices, FlagsBranchless, DecodeUnchecked, CoverageEdges>;
+
+	/// <summary>
+	/// Release with every load, store and fetch checked by the sanitizer.
+	/// Loads from RAM need MmioChecked to reach it.
+	/// </summary>
+	using Sanitize = Machine<TraceOff, ProfileOff, MmioChecked, FlagsBranchless, DecodeUnchecked, CoverageOff,
+		SanitizeShadow>;
+}
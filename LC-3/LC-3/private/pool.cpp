@@ -0,0 +1,104 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif // WIN32
+
+namespace
+{
+	size_t RoundUp(size_t size, size_t unit)
+	{
+		return (size + unit - 1) / unit * unit;
+	}
+
+	/// <summary>
+	/// Zero filled memory aligned to kChunkSize, backed by huge pages when
+	/// the OS agrees
+	/// </summary>
+	void* MapChunk(size_t size)
+	{
+#ifdef WIN32
+		// NOTE: large pages need the "Lock pages in memory" privilege, plain
+		// pages are used without it
+		if (auto large = GetLargePageMinimum(); large && size % large == 0)
+		{
+			if (auto p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)) {
+				return p;
+			}
+		}
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		// NOTE: map one chunk more and trim, transparent huge pages need
+		// aligned ranges
+		auto extra = size + PoolArena::kChunkSize;
+		auto raw = mmap(nullptr, extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED) {
+			return nullptr;
+		}
+		auto base = reinterpret_cast<uintptr_t>(raw);
+		auto aligned = RoundUp(base, PoolArena::kChunkSize);
+		if (aligned > base) {
+			munmap(raw, aligned - base);
+		}
+		if (auto tail = base + extra - (aligned + size)) {
+			munmap(reinterpret_cast<void*>(aligned + size), tail);
+		}
+#ifdef MADV_HUGEPAGE
+		madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+		return reinterpret_cast<void*>(aligned);
+#endif // WIN32
+	}
+
+	void UnmapChunk(void* base, size_t size)
+	{
+#ifdef WIN32
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, size);
+#endif // WIN32
+	}
+}
+
+PoolArena::PoolArena(size_t slotSize, size_t alignment) :
+	m_slotSize(RoundUp(slotSize, alignment)),
+	m_slotsPerChunk(std::max<size_t>(1, kChunkSize / m_slotSize))
+{
+}
+
+PoolArena::~PoolArena()
+{
+	for (const auto& chunk : m_chunks)
+	{
+		UnmapChunk(chunk.base, chunk.size);
+	}
+}
+
+void* PoolArena::Allocate()
+{
+	if (!m_left && !Grow()) {
+		return nullptr;
+	}
+	auto slot = m_next;
+	m_next += m_slotSize;
+	--m_left;
+	return slot;
+}
+
+bool PoolArena::Grow()
+{
+	auto size = RoundUp(m_slotsPerChunk * m_slotSize, kChunkSize);
+	auto base = MapChunk(size);
+	if (!base) {
+		return false;
+	}
+	m_chunks.push_back({ base, size });
+	m_next = static_cast<char*>(base);
+	m_left = size / m_slotSize;
+	return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/// <summary>
+/// Storage for pooled objects, taken from the OS in chunks of huge pages
+/// where the system provides them and never given back before destruction.
+/// </summary>
+class PoolArena
+{
+public:
+	/// <summary>
+	/// Size the chunks are rounded up to, a huge page on x86-64 and ARM64
+	/// </summary>
+	inline static const size_t kChunkSize = size_t(2) << 20;
+
+	PoolArena(size_t slotSize, size_t alignment);
+	PoolArena(const PoolArena&) = delete;
+	PoolArena& operator=(const PoolArena&) = delete;
+	~PoolArena();
+
+	/// <summary>
+	/// Next free slot, zero filled
+	/// </summary>
+	/// <returns>nullptr when the OS refuses more memory</returns>
+	void* Allocate();
+
+private:
+	struct Chunk
+	{
+		void* base;
+		size_t size;
+	};
+
+	bool Grow();
+
+	size_t m_slotSize;
+	size_t m_slotsPerChunk;
+	std::vector<Chunk> m_chunks;
+	char* m_next{ nullptr };
+	size_t m_left{ 0 };
+};
+
+/// <summary>
+/// Recycles machines for many short runs: a released machine is reset,
+/// which only clears the memory pages its run touched, and handed out
+/// again by the next <see cref="Acquire"/>.
+/// </summary>
+/// <remarks>
+/// Machine is a <see cref="BasicVirtualMachine"/> instantiation. Handles
+/// must not outlive the pool. Acquire and release may be called from
+/// several threads.
+/// </remarks>
+template<typename Machine>
+class MachinePool
+{
+public:
+	struct Recycle
+	{
+		MachinePool* pool;
+		void operator()(Machine* vm) const { pool->Release(vm); };
+	};
+	using Handle = std::unique_ptr<Machine, Recycle>;
+
+	explicit MachinePool(bool traceModeOn = false) :
+		m_arena(sizeof(Machine), alignof(Machine)),
+		m_traceMode(traceModeOn)
+	{
+	};
+	MachinePool(const MachinePool&) = delete;
+	MachinePool& operator=(const MachinePool&) = delete;
+
+	~MachinePool()
+	{
+		for (auto vm : m_all)
+		{
+			vm->~Machine();
+		}
+	};
+
+	/// <summary>
+	/// A machine in its just constructed state
+	/// </summary>
+	/// <returns>empty handle when out of memory</returns>
+	Handle Acquire()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (!m_free.empty())
+			{
+				auto vm = m_free.back();
+				m_free.pop_back();
+				return Handle(vm, Recycle{ this });
+			}
+		}
+
+		// NOTE: construction zeroes 128 KiB, done outside the lock
+		void* slot;
+		{
+			std::lock_guard lock(m_mutex);
+			slot = m_arena.Allocate();
+		}
+		if (!slot) {
+			return Handle(nullptr, Recycle{ this });
+		}
+		auto vm = new (slot) Machine(m_traceMode);
+
+		std::lock_guard lock(m_mutex);
+		m_all.push_back(vm);
+		return Handle(vm, Recycle{ this });
+	};
+
+	/// <summary>
+	/// Machines constructed so far
+	/// </summary>
+	size_t Size() const
+	{
+		std::lock_guard lock(m_mutex);
+		return m_all.size();
+	};
+
+private:
+	void Release(Machine* vm)
+	{
+		vm->Reset();
+		std::lock_guard lock(m_mutex);
+		m_free.push_back(vm);
+	};
+
+	PoolArena m_arena;
+	bool m_traceMode;
+	std::vector<Machine*> m_all;
+	std::vector<Machine*> m_free;
+	mutable std::mutex m_mutex;
+};
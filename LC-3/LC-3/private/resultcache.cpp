@@ -0,0 +1,115 @@
+#include "resultcache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+	const char kMagic[4] = { 'L', 'C', '3', 'R' };
+}
+
+bool ResultCache::Open(const std::filesystem::path& path)
+{
+	auto heapStart = sizeof(Header) + kSlots * sizeof(Slot);
+	if (!m_file.Open(path, heapStart)) {
+		return false;
+	}
+
+	MappedFile::Guard guard(m_file, true);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+	auto header = GetHeader();
+	if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+		header->version == kVersion && header->slots == kSlots)
+	{
+		return true;
+	}
+
+	// NOTE: a new file, or one written by another version
+	std::fill_n(m_file.Data(), heapStart, uint8_t(0));
+	std::memcpy(header->magic, kMagic, sizeof(kMagic));
+	header->version = kVersion;
+	header->slots = kSlots;
+	header->entries = 0;
+	header->heapEnd = heapStart;
+	return true;
+}
+
+ResultCache::Slot* ResultCache::Probe(const Hash128& key) const
+{
+	auto slots = Slots();
+	for (uint64_t i = 0; i < kSlots; ++i)
+	{
+		auto& slot = slots[(key.lo + i) & (kSlots - 1)];
+		if (!slot.used || slot.key == key) {
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+bool ResultCache::Find(const Hash128& key, Entry& entry)
+{
+	MappedFile::Guard guard(m_file, false);
+	if (!m_file.Refresh()) {
+		return false;
+	}
+
+	auto slot = Probe(key);
+	if (!slot || !slot->used || slot->offset + slot->size > m_file.Size()) {
+		return false;
+	}
+	auto data = reinterpret_cast<const char*>(m_file.Data() + slot->offset);
+	entry.output.assign(data, slot->size);
+	entry.instructions = slot->instructions;
+	entry.state = slot->state;
+	return true;
+}
+
+void ResultCache::Insert(const Hash128& key, const Entry& entry)
+{
+	MappedFile::Guard guard(m_file, true);
+	if (!m_file.Refresh()) {
+		return;
+	}
+
+	// NOTE: probes stay short while the table is at most 3/4 full
+	auto header = GetHeader();
+	if (header->entries >= kSlots / 4 * 3)
+	{
+		if (!std::exchange(m_full, true)) {
+			std::cerr << "Result cache is full, new results are not kept\n";
+		}
+		return;
+	}
+
+	auto slot = Probe(key);
+	if (!slot || slot->used) {
+		return;
+	}
+
+	auto offset = header->heapEnd;
+	auto end = offset + entry.output.size();
+	if (end > m_file.Size())
+	{
+		auto slotIndex = slot - Slots();
+		if (!m_file.Resize(std::max<size_t>(end, m_file.Size() * 2))) {
+			return;
+		}
+		header = GetHeader();
+		slot = Slots() + slotIndex;
+	}
+
+	std::memcpy(m_file.Data() + offset, entry.output.data(), entry.output.size());
+	header->heapEnd = end;
+	slot->key = key;
+	slot->state = entry.state;
+	slot->instructions = entry.instructions;
+	slot->offset = offset;
+	slot->size = static_cast<uint32_t>(entry.output.size());
+	slot->used = 1;
+	++header->entries;
+}
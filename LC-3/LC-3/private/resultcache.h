@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "hash.h"
+#include "mapfile.h"
+
+/// <summary>
+/// Results of finished runs on disk, keyed by the hash of everything that
+/// determines a run: loaded image, initial registers and keyboard input.
+/// </summary>
+/// <remarks>
+/// File layout: a header, an open addressing table of fixed size slots
+/// and a heap with the outputs. Entries are only ever added, the heap
+/// grows at the end of the file. The file is mapped and can be used by
+/// several processes at once, writers take the file lock exclusively.
+/// The cache is best effort: when the table is full new results are not
+/// kept.
+/// </remarks>
+class ResultCache
+{
+public:
+	struct Entry
+	{
+		std::string output;
+		uint64_t instructions{ 0 };
+		/// <summary>
+		/// Hash of the final registers and memory below the device page
+		/// </summary>
+		Hash128 state;
+	};
+
+	/// <summary>
+	/// Bump on any change of execution semantics, stale caches are cleared
+	/// </summary>
+	inline static const uint32_t kVersion = 2;
+	inline static const uint64_t kSlots = uint64_t(1) << 16;
+
+	bool Open(const std::filesystem::path& path);
+
+	bool Find(const Hash128& key, Entry& entry);
+	void Insert(const Hash128& key, const Entry& entry);
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t slots;
+		uint64_t entries;
+		/// <summary>
+		/// End of the used part of the heap, from the start of the file
+		/// </summary>
+		uint64_t heapEnd;
+	};
+
+	struct Slot
+	{
+		Hash128 key;
+		Hash128 state;
+		uint64_t instructions;
+		uint64_t offset;
+		uint32_t size;
+		uint32_t used;
+	};
+
+	Header* GetHeader() const { return reinterpret_cast<Header*>(m_file.Data()); };
+	Slot* Slots() const { return reinterpret_cast<Slot*>(m_file.Data() + sizeof(Header)); };
+
+	/// <summary>
+	/// Slot holding key or the empty one where it belongs
+	/// </summary>
+	/// <returns>nullptr when the table is full</returns>
+	Slot* Probe(const Hash128& key) const;
+
+	MappedFile m_file;
+	bool m_full{ false };
+};
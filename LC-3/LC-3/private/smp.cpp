@@ -0,0 +1,364 @@
+#include "smp.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+#include "hosttraps.h"
+#include "masks.h"
+
+namespace
+{
+	using ValueType = Memory::ValueType;
+
+	const ValueType KBSR = 0xFE00; // keyboard status
+	const ValueType KBDR = 0xFE02; // keyboard data
+
+	ValueType Flags(ValueType v)
+	{
+		return static_cast<ValueType>(v == 0 ? FL::ZRO : (v >> 15 ? FL::NEG : FL::POS));
+	}
+
+	constexpr bool IsCompareAndSwap(ValueType instr) { return instr & (1 << 5); }
+	constexpr bool IsValidAtomic(ValueType instr) { return !(instr & 0b11000); }
+
+	/// <summary>
+	/// Stop a core on bad helper arguments as HostTraps does, pc is past
+	/// the TRAP
+	/// </summary>
+	bool Fail(std::string_view message, ValueType pc)
+	{
+		std::cerr << "LC-3 VM: " << message << " at x" << std::hex << std::uppercase
+			<< std::setw(4) << std::setfill('0') << static_cast<ValueType>(pc - 1) << std::dec << std::nouppercase << std::setfill(' ') << '\n';
+		return false;
+	}
+}
+
+SmpMachine::SmpMachine(const Memory& image, size_t cores, ValueType pc) :
+	m_memory(std::make_unique<ValueType[]>(Memory::kMemorySize)),
+	m_cores(cores),
+	m_entry(pc),
+	m_out(&std::cout)
+{
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		auto data = image.Page(page);
+		std::copy(data, data + Memory::kPageSize, m_memory.get() + page * Memory::kPageSize);
+	}
+	m_memory[kMachineControl] = 1 << 15;
+}
+
+void SmpMachine::Run()
+{
+	for (auto& core : m_cores)
+	{
+		core = Core();
+		core.reg[static_cast<size_t>(R::PC)] = m_entry;
+	}
+	m_stop = false;
+
+	std::vector<std::thread> threads;
+	for (size_t id = 1; id < m_cores.size(); ++id)
+	{
+		threads.emplace_back([this, id] { RunCore(id); });
+	}
+	RunCore(0);
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	m_out->flush();
+}
+
+void SmpMachine::RunCore(size_t id)
+{
+	// NOTE: registers live in a copy on this thread's stack while running
+	auto core = m_cores[id];
+	auto& pc = core.reg[static_cast<size_t>(R::PC)];
+	for (;;)
+	{
+		if (!(core.instructions & kCheckMask) && m_stop.load(std::memory_order_relaxed)) {
+			break;
+		}
+		auto instr = Fetch(pc++);
+		++core.instructions;
+		if (!Execute(core, id, instr)) {
+			break;
+		}
+	}
+	m_cores[id] = core;
+}
+
+bool SmpMachine::Execute(Core& core, size_t id, ValueType instr)
+{
+	auto& reg = core.reg;
+	auto& pc = reg[static_cast<size_t>(R::PC)];
+	auto dr = masks::DR(instr);
+
+	switch (masks::OpCode(instr))
+	{
+	case OP::ADD:
+	case OP::AND:
+	{
+		auto src2 = masks::IsImmediate(instr) ? masks::Imm5(instr) : reg[masks::SR2(instr)];
+		auto src1 = reg[masks::SR1(instr)];
+		reg[dr] = masks::OpCode(instr) == OP::ADD ? static_cast<ValueType>(src1 + src2) : static_cast<ValueType>(src1 & src2);
+		SetFlags(core, reg[dr]);
+	}
+	break;
+	case OP::NOT:
+		reg[dr] = static_cast<ValueType>(~reg[masks::SR1(instr)]);
+		SetFlags(core, reg[dr]);
+		break;
+	case OP::BR:
+		if (masks::NZP(instr) & reg[static_cast<size_t>(R::COND)]) {
+			pc += masks::PCOffset9(instr);
+		}
+		break;
+	case OP::JMP:
+		pc = reg[masks::BaseR(instr)];
+		break;
+	case OP::JSR:
+	{
+		auto target = masks::IsJsrOffset(instr) ? static_cast<ValueType>(pc + masks::PCOffset11(instr)) : reg[masks::BaseR(instr)];
+		reg[static_cast<size_t>(R::R7)] = pc;
+		pc = target;
+	}
+	break;
+	case OP::LD:
+		reg[dr] = Load(id, pc + masks::PCOffset9(instr));
+		SetFlags(core, reg[dr]);
+		break;
+	case OP::LDI:
+		reg[dr] = Load(id, Load(id, pc + masks::PCOffset9(instr)));
+		SetFlags(core, reg[dr]);
+		break;
+	case OP::LDR:
+		reg[dr] = Load(id, reg[masks::BaseR(instr)] + masks::Offset6(instr));
+		SetFlags(core, reg[dr]);
+		break;
+	case OP::LEA:
+		reg[dr] = static_cast<ValueType>(pc + masks::PCOffset9(instr));
+		SetFlags(core, reg[dr]);
+		break;
+	case OP::ST:
+		Store(pc + masks::PCOffset9(instr), reg[masks::SR(instr)]);
+		break;
+	case OP::STI:
+		Store(Load(id, pc + masks::PCOffset9(instr)), reg[masks::SR(instr)]);
+		break;
+	case OP::STR:
+		Store(reg[masks::BaseR(instr)] + masks::Offset6(instr), reg[masks::SR(instr)]);
+		break;
+	case OP::RES:
+		return Atomic(core, instr);
+	case OP::TRAP:
+		return Trap(core, masks::TrapVect8(instr));
+	case OP::RTI:
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool SmpMachine::Atomic(Core& core, ValueType instr)
+{
+	auto& reg = core.reg;
+	auto dr = masks::DR(instr);
+	auto addr = reg[masks::BaseR(instr)];
+	// NOTE: device registers have side effects no atomic can undo
+	if (!IsValidAtomic(instr) || addr >= Memory::kDeviceBase) {
+		return false;
+	}
+
+	std::atomic_ref<ValueType> word(m_memory[addr]);
+	auto val = reg[masks::SR2(instr)];
+	if (IsCompareAndSwap(instr))
+	{
+		auto expected = reg[dr];
+		auto swapped = word.compare_exchange_strong(expected, val);
+		reg[dr] = expected;
+		reg[static_cast<size_t>(R::COND)] = static_cast<ValueType>(swapped ? FL::ZRO : FL::POS);
+		return true;
+	}
+	reg[dr] = word.exchange(val);
+	SetFlags(core, reg[dr]);
+	return true;
+}
+
+void SmpMachine::SetFlags(Core& core, ValueType value)
+{
+	core.reg[static_cast<size_t>(R::COND)] = Flags(value);
+}
+
+SmpMachine::ValueType SmpMachine::Load(size_t id, ValueType addr)
+{
+	if (addr >= Memory::kDeviceBase) {
+		return DeviceLoad(id, addr);
+	}
+	return std::atomic_ref<ValueType>(m_memory[addr]).load(std::memory_order_acquire);
+}
+
+void SmpMachine::Store(ValueType addr, ValueType val)
+{
+	if (addr >= Memory::kDeviceBase) {
+		return DeviceStore(addr, val);
+	}
+	std::atomic_ref<ValueType>(m_memory[addr]).store(val, std::memory_order_release);
+}
+
+SmpMachine::ValueType SmpMachine::DeviceLoad(size_t id, ValueType addr)
+{
+	if (addr == kCoreId) {
+		return static_cast<ValueType>(id);
+	}
+	if (addr == kCoreCount) {
+		return static_cast<ValueType>(m_cores.size());
+	}
+
+	std::lock_guard lock(m_io);
+	if (addr == KBSR)
+	{
+		char ch;
+		if (m_keyboard.Poll(ch))
+		{
+			m_memory[KBSR] = 1 << 15;
+			m_memory[KBDR] = static_cast<uint8_t>(ch);
+		}
+		else {
+			m_memory[KBSR] = 0;
+		}
+	}
+	return m_memory[addr];
+}
+
+void SmpMachine::DeviceStore(ValueType addr, ValueType val)
+{
+	std::lock_guard lock(m_io);
+	m_memory[addr] = val;
+	if (addr == kMachineControl && !(val >> 15)) {
+		m_stop = true;
+	}
+}
+
+bool SmpMachine::Trap(Core& core, ValueType vector)
+{
+	// NOTE: helpers only touch RAM, they don't take the device lock
+	if (vector >= static_cast<ValueType>(TR::FIRST_HOST) && vector <= static_cast<ValueType>(TR::LAST)) {
+		return HostTrap(core, vector);
+	}
+
+	auto& r0 = core.reg[static_cast<size_t>(R::R0)];
+	std::lock_guard lock(m_io);
+
+	switch (static_cast<TR>(vector))
+	{
+	case TR::IN:
+	case TR::GETC:
+	{
+		if (static_cast<TR>(vector) == TR::IN) {
+			(*m_out) << "Enter a character: ";
+		}
+		m_out->flush();
+		char c = m_keyboard.GetChar(static_cast<TR>(vector) == TR::IN);
+		if (m_keyboard.Starved()) {
+			return false;
+		}
+		if (static_cast<TR>(vector) == TR::IN) {
+			(*m_out) << c;
+		}
+		r0 = static_cast<ValueType>(c);
+		SetFlags(core, r0);
+	}
+	break;
+	case TR::OUT:
+		(*m_out) << static_cast<char>(r0);
+		break;
+	case TR::PUTS:
+		for (ValueType addr = r0; auto ch = Fetch(addr); ++addr)
+		{
+			m_out->put(static_cast<char>(ch));
+		}
+		break;
+	case TR::PUTSP:
+		for (ValueType addr = r0; auto ch = Fetch(addr); ++addr)
+		{
+			m_out->put(static_cast<char>(ch & 0xFF));
+			if (ch >> 8) {
+				m_out->put(static_cast<char>(ch >> 8));
+			}
+		}
+		break;
+	case TR::HALT:
+		(*m_out) << "HALT\n";
+		m_out->flush();
+		return false;
+	default:
+		std::cerr << "LC-3 VM: TRAP x" << std::hex << std::uppercase << vector << std::dec << std::nouppercase
+			<< " not supported with --cores\n";
+		return false;
+	}
+	m_out->flush();
+	return true;
+}
+
+bool SmpMachine::HostTrap(Core& core, ValueType vector)
+{
+	auto& reg = core.reg;
+	auto& r0 = reg[static_cast<size_t>(R::R0)];
+	auto& r1 = reg[static_cast<size_t>(R::R1)];
+	auto count = reg[static_cast<size_t>(R::R2)];
+	auto pc = reg[static_cast<size_t>(R::PC)];
+	auto word = [this](size_t addr) { return std::atomic_ref<ValueType>(m_memory[addr]); };
+
+	switch (static_cast<TR>(vector))
+	{
+	case TR::MUL:
+		r0 = HostTraps::Multiply(r0, r1);
+		SetFlags(core, r0);
+		return true;
+	case TR::DIV:
+		if (!HostTraps::Divide(r0, r1)) {
+			return Fail("DIV by zero", pc);
+		}
+		SetFlags(core, r0);
+		return true;
+	case TR::MEMCPY:
+		if (!Memory::InRam(r0, count) || !Memory::InRam(r1, count)) {
+			return Fail("MEMCPY past RAM", pc);
+		}
+		// NOTE: word by word as a guest loop would, in the direction that
+		// handles overlapping ranges
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto k = r0 <= r1 ? i : count - 1 - i;
+			word(r0 + k).store(word(r1 + k).load(std::memory_order_acquire), std::memory_order_release);
+		}
+		return true;
+	case TR::MEMSET:
+		if (!Memory::InRam(r0, count)) {
+			return Fail("MEMSET past RAM", pc);
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			word(r0 + i).store(r1, std::memory_order_release);
+		}
+		return true;
+	case TR::STRCMP:
+		for (size_t a = r0, b = r1; a < Memory::kDeviceBase && b < Memory::kDeviceBase; ++a, ++b)
+		{
+			auto x = word(a).load(std::memory_order_acquire);
+			auto y = word(b).load(std::memory_order_acquire);
+			if (x != y || !x)
+			{
+				r0 = static_cast<ValueType>((x > y) - (x < y));
+				SetFlags(core, r0);
+				return true;
+			}
+		}
+		return Fail("STRCMP past RAM", pc);
+	default:
+		return false;
+	}
+}
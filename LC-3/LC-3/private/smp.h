@@ -0,0 +1,126 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "identifiers.h"
+#include "keyboard.h"
+#include "memory.h"
+
+/// <summary>
+/// N LC-3 cores sharing one memory, each core is run by a host thread of
+/// its own.
+/// </summary>
+/// <remarks>
+/// Every core has its own registers and starts at the same PC, a program
+/// tells the cores apart by reading kCoreId. The RES opcode is the atomic
+/// instruction:
+///
+///   |15  12|11 9|8   6|5|4 3|2  0|
+///   | 1101 | DR |BaseR|c| 00| SR |
+///
+/// c = 0, XCHG DR, BaseR, SR: DR gets mem[BaseR] and mem[BaseR] gets SR,
+/// the flags are set from DR. c = 1, CAS DR, BaseR, SR: mem[BaseR] gets
+/// SR if it equals DR, DR gets the old mem[BaseR], the flags are Z when
+/// the store was made and P when not.
+///
+/// Memory model: word accesses are atomic, loads acquire and stores
+/// release, so a core seeing a value another core stored also sees the
+/// stores that core made before it. A load may still pass an earlier store
+/// of the same core to another address; XCHG and CAS are sequentially
+/// consistent and order all accesses around them. Instruction fetches see
+/// code written by other cores eventually.
+///
+/// Host threads only share the cache lines the guest program shares:
+/// device registers, traps and the keyboard are serialized by a lock,
+/// ordinary loads and stores are plain atomic accesses.
+/// </remarks>
+class SmpMachine
+{
+public:
+	using ValueType = Memory::ValueType;
+
+	/// <summary>
+	/// Index of the reading core
+	/// </summary>
+	inline static const ValueType kCoreId = 0xFE10;
+	inline static const ValueType kCoreCount = 0xFE12;
+	/// <summary>
+	/// Machine control register, clearing bit 15 stops every core
+	/// </summary>
+	inline static const ValueType kMachineControl = 0xFFFE;
+
+	SmpMachine(const Memory& image, size_t cores, ValueType pc = 0x3000);
+
+	size_t Cores() const { return m_cores.size(); };
+
+	/// <summary>
+	/// Keyboard input shared by the cores instead of the terminal, a core
+	/// stops once it wants more
+	/// </summary>
+	void SetInput(std::string input) { m_keyboard.Feed(std::move(input)); };
+	void SetOutput(std::ostream* out) { m_out = out; };
+
+	/// <summary>
+	/// Run every core on its own thread until all have stopped: on HALT,
+	/// an illegal instruction, input exhaustion or MCR
+	/// </summary>
+	void Run();
+
+	ValueType Register(size_t core, R r) const { return m_cores[core].reg[static_cast<size_t>(r)]; };
+	uint64_t InstructionCount(size_t core) const { return m_cores[core].instructions; };
+	ValueType Peek(ValueType addr) const { return m_memory[addr]; };
+
+private:
+	/// <summary>
+	/// A cache line per core, the running core is the only one writing it
+	/// </summary>
+	struct alignas(64) Core
+	{
+		std::array<ValueType, static_cast<size_t>(R::NREG)> reg{};
+		uint64_t instructions{ 0 };
+	};
+
+	/// <summary>
+	/// The MCR stop is looked at once per this many instructions, the other
+	/// cores run up to that many more after one clears MCR
+	/// </summary>
+	inline static const uint64_t kCheckMask = 0xFFF;
+
+	void RunCore(size_t id);
+	/// <returns>false when the core stops</returns>
+	bool Execute(Core& core, size_t id, ValueType instr);
+	bool Atomic(Core& core, ValueType instr);
+	bool Trap(Core& core, ValueType vector);
+	/// <summary>
+	/// The built-in helpers of <see cref="HostTraps"/>, bulk moves are
+	/// word accesses under the memory model of guest loads and stores
+	/// </summary>
+	bool HostTrap(Core& core, ValueType vector);
+
+	ValueType Fetch(ValueType addr)
+	{
+		return std::atomic_ref<ValueType>(m_memory[addr]).load(std::memory_order_relaxed);
+	};
+	ValueType Load(size_t id, ValueType addr);
+	void Store(ValueType addr, ValueType val);
+	ValueType DeviceLoad(size_t id, ValueType addr);
+	void DeviceStore(ValueType addr, ValueType val);
+	void SetFlags(Core& core, ValueType value);
+
+	std::unique_ptr<ValueType[]> m_memory;
+	std::vector<Core> m_cores;
+	ValueType m_entry;
+	alignas(64) std::atomic<bool> m_stop{ false };
+
+	/// <summary>
+	/// Devices and traps, guarded by m_io
+	/// </summary>
+	alignas(64) std::mutex m_io;
+	Keyboard m_keyboard;
+	std::ostream* m_out;
+};
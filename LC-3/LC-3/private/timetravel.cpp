@@ -0,0 +1,132 @@
+#include "timetravel.h"
+
+#include <algorithm>
+#include <bitset>
+
+void TimeTravel::Checkpoint(uint64_t tick, const Registers& regs)
+{
+	if (!m_checkpoints.empty() && m_checkpoints.back().tick >= tick) {
+		return;
+	}
+
+	Snapshot cp{ tick, regs, 0, m_writes.size(), {}, {} };
+
+	// NOTE: the first checkpoint is the base image, later ones only keep
+	// pages stamped with the epoch started by the previous checkpoint
+	auto epoch = m_mem.Epoch();
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		if (m_checkpoints.empty() || m_mem.PageEpoch(page) == epoch)
+		{
+			cp.pages.push_back(static_cast<uint8_t>(page));
+			cp.data.insert(cp.data.end(), m_mem.Page(page), m_mem.Page(page) + Memory::kPageSize);
+		}
+	}
+	cp.epoch = m_mem.NextEpoch();
+
+	m_checkpoints.push_back(std::move(cp));
+
+	if (m_checkpoints.size() > kMaxCheckpoints) {
+		Thin();
+	}
+	if (m_writes.size() > kMaxWrites) {
+		TrimWrites();
+	}
+}
+
+bool TimeTravel::Restore(uint64_t tick, uint64_t& restoredTick, Registers& regs)
+{
+	auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), tick,
+		[](uint64_t t, const Snapshot& cp) { return t < cp.tick; });
+	if (it == m_checkpoints.begin()) {
+		return false;
+	}
+	auto k = std::distance(m_checkpoints.begin(), it) - 1;
+	const auto& target = m_checkpoints[k];
+
+	std::bitset<Memory::kPageCount> stale;
+	for (size_t page = 0; page < Memory::kPageCount; ++page)
+	{
+		stale[page] = m_mem.PageEpoch(page) >= target.epoch;
+	}
+
+	// NOTE: a restored page is stamped as written right before the target
+	// checkpoint, so rolling back further will restore it again
+	for (auto j = k; j >= 0 && stale.any(); --j)
+	{
+		const auto& cp = m_checkpoints[j];
+		for (size_t i = 0; i < cp.pages.size(); ++i)
+		{
+			if (stale[cp.pages[i]])
+			{
+				m_mem.RestorePage(cp.pages[i], cp.data.data() + i * Memory::kPageSize, target.epoch - 1);
+				stale[cp.pages[i]] = false;
+			}
+		}
+	}
+	m_mem.SetEpoch(target.epoch);
+
+	restoredTick = target.tick;
+	regs = target.regs;
+
+	m_writes.resize(std::min(m_writes.size(), target.writes));
+	m_checkpoints.erase(m_checkpoints.begin() + k + 1, m_checkpoints.end());
+	return true;
+}
+
+const TimeTravel::WriteRecord* TimeTravel::LastWriter(ValueType addr, uint64_t tick) const
+{
+	for (auto it = m_writes.rbegin(); it != m_writes.rend(); ++it)
+	{
+		if (it->addr == addr && it->tick < tick) {
+			return &*it;
+		}
+	}
+	return nullptr;
+}
+
+void TimeTravel::Thin()
+{
+	// NOTE: every second checkpoint except the base and the latest is merged
+	// into its successor, which inherits the pages it does not save itself
+	std::vector<Snapshot> thinned;
+	thinned.reserve(m_checkpoints.size() / 2 + 2);
+	thinned.push_back(std::move(m_checkpoints.front()));
+
+	for (size_t i = 1; i < m_checkpoints.size(); ++i)
+	{
+		auto& cp = m_checkpoints[i];
+		if (i % 2 == 1 && i + 1 < m_checkpoints.size())
+		{
+			auto& next = m_checkpoints[i + 1];
+			std::bitset<Memory::kPageCount> saved;
+			for (auto page : next.pages) {
+				saved[page] = true;
+			}
+			for (size_t j = 0; j < cp.pages.size(); ++j)
+			{
+				if (!saved[cp.pages[j]])
+				{
+					next.pages.push_back(cp.pages[j]);
+					next.data.insert(next.data.end(),
+						cp.data.begin() + j * Memory::kPageSize,
+						cp.data.begin() + (j + 1) * Memory::kPageSize);
+				}
+			}
+			continue;
+		}
+		thinned.push_back(std::move(cp));
+	}
+
+	m_checkpoints = std::move(thinned);
+}
+
+void TimeTravel::TrimWrites()
+{
+	auto dropped = m_writes.size() / 2;
+	m_writes.erase(m_writes.begin(), m_writes.begin() + dropped);
+	for (auto& cp : m_checkpoints)
+	{
+		cp.writes = cp.writes > dropped ? cp.writes - dropped : 0;
+	}
+}
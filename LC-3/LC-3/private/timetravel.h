@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "identifiers.h"
+#include "memory.h"
+
+/// <summary>
+/// Execution history for reverse debugging.
+/// </summary>
+/// <remarks>
+/// A checkpoint keeps the registers and a copy of the pages written since
+/// the previous checkpoint, the first one keeps the whole memory. Memory at
+/// checkpoint k is rebuilt page by page from the latest checkpoint at or
+/// before k that saved the page. Stores between checkpoints are logged for
+/// "who wrote this address" queries.
+/// </remarks>
+class TimeTravel
+{
+public:
+	using ValueType = Memory::ValueType;
+	using Registers = std::array<ValueType, static_cast<size_t>(R::NREG)>;
+
+	struct WriteRecord
+	{
+		uint64_t tick;
+		ValueType addr;
+		ValueType pc;
+		ValueType value;
+	};
+
+	/// <summary>
+	/// Checkpoints kept before older ones are thinned out
+	/// </summary>
+	inline static const size_t kMaxCheckpoints = 4096;
+	/// <summary>
+	/// Write log entries kept before the oldest half is dropped
+	/// </summary>
+	inline static const size_t kMaxWrites = size_t(1) << 24;
+
+	TimeTravel(Memory& mem) : m_mem(mem) {};
+
+	/// <summary>
+	/// Take a checkpoint of the state before instruction number tick
+	/// </summary>
+	void Checkpoint(uint64_t tick, const Registers& regs);
+
+	void LogWrite(uint64_t tick, ValueType pc, ValueType addr, ValueType value)
+	{
+		m_writes.push_back({ tick, addr, pc, value });
+	};
+
+	/// <summary>
+	/// Roll memory back to the latest checkpoint at or before tick and forget
+	/// the history after it
+	/// </summary>
+	/// <param name="tick">target instruction number</param>
+	/// <param name="restoredTick">instruction number of the checkpoint</param>
+	/// <param name="regs">registers at the checkpoint</param>
+	/// <returns>false when tick precedes the oldest checkpoint</returns>
+	bool Restore(uint64_t tick, uint64_t& restoredTick, Registers& regs);
+
+	/// <summary>
+	/// Latest logged store to addr made before instruction number tick
+	/// </summary>
+	const WriteRecord* LastWriter(ValueType addr, uint64_t tick) const;
+
+	uint64_t OldestTick() const { return m_checkpoints.empty() ? 0 : m_checkpoints.front().tick; };
+
+private:
+	struct Snapshot
+	{
+		uint64_t tick;
+		Registers regs;
+		/// <summary>
+		/// Memory epoch started by this checkpoint
+		/// </summary>
+		uint32_t epoch;
+		/// <summary>
+		/// Write log size when the checkpoint was taken
+		/// </summary>
+		size_t writes;
+		std::vector<uint8_t> pages;
+		std::vector<ValueType> data;
+	};
+
+	void Thin();
+	void TrimWrites();
+
+	Memory& m_mem;
+	std::vector<Snapshot> m_checkpoints;
+	std::vector<WriteRecord> m_writes;
+};